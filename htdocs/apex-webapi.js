@@ -256,6 +256,8 @@ export class ApexWebAPI extends EventTarget {
   static WEBAPI_EVENT_LEGENDBANENUM_START = 0x46;
   static WEBAPI_EVENT_LEGENDBANENUM_END = 0x47;
   static WEBAPI_EVENT_LEGENDBANSTATUS = 0x48;
+  static WEBAPI_EVENT_LOBBYSETUP_PROGRESS = 0x49;
+  static WEBAPI_EVENT_LOBBYSETUP_DONE = 0x4a;
 
   static WEBAPI_SEND_CUSTOMMATCH_SENDCHAT = 0x50;
   static WEBAPI_SEND_CUSTOMMATCH_CREATELOBBY = 0x51;
@@ -270,11 +272,13 @@ export class ApexWebAPI extends EventTarget {
   static WEBAPI_SEND_CUSTOMMATCH_GETLEGENDBANSTATUS = 0x5a;
   static WEBAPI_SEND_CUSTOMMATCH_SETLEGENDBAN = 0x5b;
   static WEBAPI_SEND_JOINPARTYSERVER = 0x5c;
+  static WEBAPI_SEND_CUSTOMMATCH_SETUPLOBBY = 0x5d;
 
   static WEBAPI_LIVEDATA_GET_GAME = 0x60;
   static WEBAPI_LIVEDATA_GET_TEAMS = 0x61;
   static WEBAPI_LIVEDATA_GET_TEAM_PLAYERS = 0x62;
   static WEBAPI_LIVEDATA_GET_OBSERVERS_CAMERA = 0x63;
+  static WEBAPI_LIVEDATA_GET_SNAPSHOT = 0x64;
 
   static WEBAPI_LOCALDATA_SET_OBSERVER = 0x70;
   static WEBAPI_LOCALDATA_GET_OBSERVER = 0x71;
@@ -304,6 +308,9 @@ export class ApexWebAPI extends EventTarget {
   static WEBAPI_EVENT_LIVEAPI_SOCKET_STATS = 0xd0;
   static WEBAPI_HTTP_GET_STATS_FROM_CODE = 0xd1;
   static WEBAPI_MANUAL_POSTMATCH = 0xd2;
+  static WEBAPI_SUBSCRIBE = 0xd3;
+
+  static WEBAPI_EVENT_BATCH = 0xe0;
 
   static WEBAPI_BROADCAST_OBJECT = 0xf0;
 
@@ -322,6 +329,7 @@ export class ApexWebAPI extends EventTarget {
   static WEBAPI_DATA_FLOAT64 = 0x11;
   static WEBAPI_DATA_STRING = 0x20;
   static WEBAPI_DATA_JSON = 0x30;
+  static WEBAPI_DATA_BINARY = 0x40;
 
   static WEBAPI_PLAYER_STATE_ALIVE = 0x00;
   static WEBAPI_PLAYER_STATE_DOWN = 0x01;
@@ -361,6 +369,16 @@ export class ApexWebAPI extends EventTarget {
   static WEBAPI_ITEM_AMP_TYPE_HEAL_OVERFLOW = 0x04;
   static WEBAPI_ITEM_AMP_TYPE_POWER_BOOSTER = 0x05;
 
+  // 購読トピック (subscribe()に渡す)
+  static WEBAPI_TOPIC_GAME = 0x01;
+  static WEBAPI_TOPIC_POSITION = 0x02;
+  static WEBAPI_TOPIC_HEALTH = 0x04;
+  static WEBAPI_TOPIC_ITEMS = 0x08;
+  static WEBAPI_TOPIC_EXTENDED = 0x10;
+  static WEBAPI_TOPIC_LOBBY = 0x20;
+  static WEBAPI_TOPIC_RESULT = 0x40;
+  static WEBAPI_TOPIC_ALL = 0xffffffff;
+
   #uri;
   #delay;
   #socket;
@@ -392,15 +410,11 @@ export class ApexWebAPI extends EventTarget {
     this.#socket.addEventListener("message", (event) => {
       if (event.data instanceof ArrayBuffer) {
         // バイナリーフレーム
-        // データ種類
         const view = new DataView(event.data);
-        const data_type = view.getUint8(0);
-        const data_count = view.getUint8(1);
-        const data_array = event.data.slice(2);
-        if (!this.#procData(data_type, data_count, data_array)) {
-          console.log('proc_data failed. data_type=0x' + data_type.toString(16));
-          console.log('data_count=' + data_count);
-          console.log(event.data);
+        if (view.getUint8(0) == ApexWebAPI.WEBAPI_EVENT_BATCH) {
+          this.#procBatch(event.data);
+        } else {
+          this.#procFrame(event.data);
         }
       } else {
         // テキストフレーム
@@ -439,6 +453,37 @@ export class ApexWebAPI extends EventTarget {
     });
   }
 
+  #procFrame(buffer) {
+    // データ種類
+    const view = new DataView(buffer);
+    const data_type = view.getUint8(0);
+    const data_count = view.getUint8(1);
+    const data_array = buffer.slice(2);
+    if (!this.#procData(data_type, data_count, data_array)) {
+      console.log('proc_data failed. data_type=0x' + data_type.toString(16));
+      console.log('data_count=' + data_count);
+      console.log(buffer);
+    }
+  }
+
+  #procBatch(buffer) {
+    // [type][count] + ([uint32 length][event]) * count
+    const view = new DataView(buffer);
+    const count = view.getUint8(1);
+    let offset = 2;
+    for (let i = 0; i < count; ++i) {
+      if (buffer.byteLength < offset + 4) break;
+      const len = view.getUint32(offset, true);
+      offset += 4;
+      if (len < 2 || buffer.byteLength < offset + len) break;
+      this.#procFrame(buffer.slice(offset, offset + len));
+      offset += len;
+    }
+    if (buffer.byteLength != offset) {
+      console.log("batch length is not match: length=%d, offset=%d", buffer.byteLength, offset);
+    }
+  }
+
   #parseData(count, data) {
     const data_array = [];
     let offset = 0;
@@ -533,6 +578,17 @@ export class ApexWebAPI extends EventTarget {
             }
           }
           break;
+        case ApexWebAPI.WEBAPI_DATA_BINARY:
+          {
+            const len = view.getUint32(offset, true);
+            offset += 4;
+            const capedlen = (len & 0xffffff); // 16777216(16MB)
+            if (len == capedlen) {
+              data_array.push(data.slice(offset, offset + len));
+              offset += len;
+            }
+          }
+          break;
       }
     }
     
@@ -623,6 +679,19 @@ export class ApexWebAPI extends EventTarget {
     return true;
   }
 
+  #procEventLobbySetup(type, arr) {
+    const detail = {
+      sequence: arr[0],
+      done: arr[1],
+      failed: arr[2],
+      total: arr[3],
+      skipped: arr[4]
+    };
+    if (arr.length > 5) detail.duration = arr[5];
+    this.dispatchEvent(new CustomEvent(type, { detail: detail }));
+    return true;
+  }
+
   #procEventObserverSwitched(arr) {
     const oteamid = arr[0];
     const osquadindex = arr[1];
@@ -1104,6 +1173,10 @@ export class ApexWebAPI extends EventTarget {
   #procData(type, count, data) {
     const data_array = this.#parseData(count, data);
     if (data_array == null) return false;
+    return this.#procDataArray(type, count, data_array);
+  }
+
+  #procDataArray(type, count, data_array) {
     switch (type) {
       case ApexWebAPI.WEBAPI_EVENT_LOBBYPLAYER:
         if (count != 4) return false;
@@ -1135,6 +1208,14 @@ export class ApexWebAPI extends EventTarget {
         if (count != 3) return false;
         return this.#procEventLegendBanStatus(data_array);
 
+      case ApexWebAPI.WEBAPI_EVENT_LOBBYSETUP_PROGRESS:
+        if (count != 5) return false;
+        return this.#procEventLobbySetup('lobbysetupprogress', data_array);
+
+      case ApexWebAPI.WEBAPI_EVENT_LOBBYSETUP_DONE:
+        if (count != 6) return false;
+        return this.#procEventLobbySetup('lobbysetupdone', data_array);
+
       case ApexWebAPI.WEBAPI_EVENT_LEGENDBANENUM_START:
         if (count != 0) return false;
         this.dispatchEvent(new CustomEvent('legendbanenumstart', { detail: {} }));
@@ -1486,6 +1567,11 @@ export class ApexWebAPI extends EventTarget {
         this.dispatchEvent(new CustomEvent('joinpartyserver', {detail: {sequence: data_array[0]}}));
         break;
 
+      case ApexWebAPI.WEBAPI_SEND_CUSTOMMATCH_SETUPLOBBY:
+        if (count != 1) return false;
+        this.dispatchEvent(new CustomEvent('setuplobby', {detail: {sequence: data_array[0]}}));
+        break;
+
       case ApexWebAPI.WEBAPI_LIVEDATA_GET_GAME:
         if (count != 1) return false;
         if (this.#delay > 0) {
@@ -1518,6 +1604,16 @@ export class ApexWebAPI extends EventTarget {
         this.dispatchEvent(new CustomEvent('getobserverscamera', {detail: {sequence: data_array[0], observers: this.#game.observers}}));
         break;
 
+      case ApexWebAPI.WEBAPI_LIVEDATA_GET_SNAPSHOT:
+        if (count != 3) return false;
+        if (!this.#procSnapshot(data_array[2])) return false;
+        if (this.#delay > 0) {
+          setTimeout(() => { this.dispatchEvent(new CustomEvent('getsnapshot', { detail: { sequence: data_array[0], game: this.#game } })) }, this.#delay);
+          return true;
+        }
+        this.dispatchEvent(new CustomEvent('getsnapshot', {detail: {sequence: data_array[0], game: this.#game}}));
+        break;
+
       case ApexWebAPI.WEBAPI_LOCALDATA_SET_OBSERVER:
         if (count != 2) return false;
         this.dispatchEvent(new CustomEvent('setobserver', {detail: {sequence: data_array[0], hash: data_array[1]}}));
@@ -1647,6 +1743,12 @@ export class ApexWebAPI extends EventTarget {
       case ApexWebAPI.WEBAPI_MANUAL_POSTMATCH:
         if (count != 1) return false;
         this.dispatchEvent(new CustomEvent('manualpostmatch', {detail: {sequence: data_array[0]}}));
+        break;
+
+      case ApexWebAPI.WEBAPI_SUBSCRIBE:
+        if (count != 2) return false;
+        this.dispatchEvent(new CustomEvent('subscribe', {detail: {sequence: data_array[0], topics: data_array[1]}}));
+        break;
 
       case ApexWebAPI.WEBAPI_GET_VERSION:
         if (count != 2) return false;
@@ -1656,6 +1758,97 @@ export class ApexWebAPI extends EventTarget {
     return true;
   }
 
+  #readSnapshot(buffer) {
+    // core_thread.cppのスナップショット形式を読む
+    const view = new DataView(buffer);
+    let offset = 0;
+    const u8 = () => { const v = view.getUint8(offset); offset += 1; return v; };
+    const u32 = () => { const v = view.getUint32(offset, true); offset += 4; return v; };
+    const i32 = () => { const v = view.getInt32(offset, true); offset += 4; return v; };
+    const f32 = () => { const v = view.getFloat32(offset, true); offset += 4; return v; };
+    const str = () => {
+      const len = u8();
+      const v = this.#decoder.decode(buffer.slice(offset, offset + len));
+      offset += len;
+      return v;
+    };
+
+    const version = u8();
+    if (version != 1) throw new Error("unknown snapshot version: " + version);
+    const teams = [];
+    const team_count = u8();
+    for (let i = 0; i < team_count; ++i) {
+      const team = { id: u8(), name: str(), placement: u32(), eliminated: u8() > 0, players: [] };
+      const player_count = u8();
+      for (let j = 0; j < player_count; ++j) {
+        const player = {
+          id: str(), name: str(), character: str(), weapon: str(),
+          state: u8(), level: i32(),
+          hp: u32(), hp_max: u32(), shield: u32(), shield_max: u32(), damage_dealt: u32(), damage_taken: u32(),
+          x: f32(), y: f32(), angle: f32(),
+          kills: u32(), assists: u32(), knockdowns: u32(), revives: u32(), respawns: u32(), killed: u32(),
+          flags: u8(), items: [], perks: []
+        };
+        const item_count = u8();
+        for (let k = 0; k < item_count; ++k) player.items.push([u8(), u32()]);
+        const perk_count = u8();
+        for (let k = 0; k < perk_count; ++k) player.perks.push([i32(), str()]);
+        team.players.push(player);
+      }
+      teams.push(team);
+    }
+    if (buffer.byteLength != offset) throw new Error("snapshot length is not match");
+    return teams;
+  }
+
+  #procSnapshot(buffer) {
+    let teams;
+    try {
+      teams = this.#readSnapshot(buffer);
+    } catch (e) {
+      console.error("failed to parse ApexWebAPI.WEBAPI_LIVEDATA_GET_SNAPSHOT");
+      console.error(e);
+      return false;
+    }
+
+    // GET_TEAMS/GET_TEAM_PLAYERSと同じ順でイベントとして処理する
+    const proc = (type, arr) => { this.#procDataArray(type, arr.length, arr); };
+    for (const team of teams) {
+      const t = team.id;
+      if (team.name != "") proc(ApexWebAPI.WEBAPI_EVENT_TEAM_NAME, [t, team.name]);
+      if (team.placement != 0) proc(ApexWebAPI.WEBAPI_EVENT_TEAM_PLACEMENT, [t, team.placement]);
+      if (team.eliminated) proc(ApexWebAPI.WEBAPI_EVENT_SQUADELIMINATED, [t, team.placement]);
+      team.players.forEach((p, s) => {
+        if (p.id != "") proc(ApexWebAPI.WEBAPI_EVENT_PLAYER_ID, [t, s, p.id]);
+      });
+    }
+    for (const team of teams) {
+      const t = team.id;
+      team.players.forEach((p, s) => {
+        if (p.flags & 0x01) proc(ApexWebAPI.WEBAPI_EVENT_PLAYERDISCONNECTED, [t, s, (p.flags & 0x02) > 0]);
+        proc(ApexWebAPI.WEBAPI_EVENT_PLAYER_NAME, [t, s, p.name]);
+        proc(ApexWebAPI.WEBAPI_EVENT_PLAYER_CHARACTER, [t, s, p.character]);
+        proc(ApexWebAPI.WEBAPI_EVENT_PLAYER_LEVEL, [t, s, p.level]);
+        proc(ApexWebAPI.WEBAPI_EVENT_PLAYER_HP, [t, s, p.hp, p.hp_max]);
+        proc(ApexWebAPI.WEBAPI_EVENT_PLAYER_SHIELD, [t, s, p.shield, p.shield_max]);
+        proc(ApexWebAPI.WEBAPI_EVENT_PLAYER_DAMAGE, [t, s, p.damage_dealt, p.damage_taken]);
+        proc(ApexWebAPI.WEBAPI_EVENT_PLAYER_POS, [t, s, p.x, p.y, p.angle]);
+        proc(ApexWebAPI.WEBAPI_EVENT_PLAYER_STATE, [t, s, p.state]);
+        proc(ApexWebAPI.WEBAPI_EVENT_PLAYER_STATS, [t, s, p.kills, p.assists, p.knockdowns, p.revives, p.respawns]);
+        proc(ApexWebAPI.WEBAPI_EVENT_PLAYER_KILLED_COUNT, [t, s, p.killed]);
+        proc(ApexWebAPI.WEBAPI_EVENT_PLAYER_WEAPON, [t, s, p.weapon]);
+        for (const [level, name] of p.perks) {
+          proc(ApexWebAPI.WEBAPI_EVENT_PLAYER_PERK, [t, s, level, name]);
+        }
+        for (const [itemid, quantity] of p.items) {
+          proc(ApexWebAPI.WEBAPI_EVENT_PLAYER_ITEMS, [t, s, itemid, quantity]);
+        }
+        if (p.flags & 0x04) proc(ApexWebAPI.WEBAPI_EVENT_EXTENDED, [ApexWebAPI.WEBAPI_EXTENDED_CHARACTERSELECTED, t, s]);
+      });
+    }
+    return true;
+  }
+
   #initTeamObject(id) {
     return {
       id: id,
@@ -1930,20 +2123,20 @@ export class ApexWebAPI extends EventTarget {
     return this.#sendAndReceiveReply(buffer, "getobserverscamera");
   }
 
+  getSnapshot(teamid = -1) {
+    // teamid省略時は全チーム (observer含む)
+    let precheck = true;
+    const buffer = new SendBuffer(ApexWebAPI.WEBAPI_LIVEDATA_GET_SNAPSHOT);
+    if (!buffer.append(ApexWebAPI.WEBAPI_DATA_UINT8, teamid < 0 ? 0xff : teamid + 2)) precheck = false;
+    return this.#sendAndReceiveReply(buffer, "getsnapshot", precheck);
+  }
+
   getAll() {
     return new Promise((resolve, reject) => {
       this.getGame().then(() => {
-        this.getTeams().then(() => {
-          const jobs = [];
-          for (let i = 0; i < this.#game.teams.length; ++i) {
-            const team = this.#game.teams[i];
-            if (team.players.length == 0) continue;
-            jobs.push(this.getTeamPlayers(i));
-          }
-          Promise.all(jobs).then(() => {
-            this.getObserversCamera().then(() => {
-              resolve(this.#game);
-            }, reject);
+        this.getSnapshot().then(() => {
+          this.getObserversCamera().then(() => {
+            resolve(this.#game);
           }, reject);
         }, reject);
       }, reject)
@@ -2063,6 +2256,30 @@ export class ApexWebAPI extends EventTarget {
     return this.#sendAndReceiveReply(buffer, "setlegendban", precheck);
   }
 
+  /**
+   * ロビーのチーム名・スポーンポイント・レジェンドBANをまとめて設定する
+   * 現在の状態と同じものは送られず、進捗はlobbysetupprogress/lobbysetupdoneで通知される
+   * @param {{teamid: number, name?: string, spawnpoint?: number}[]} teams チームID(0～)と設定する値
+   * @param {string|null} legendrefs BANするレジェンド(カンマ区切り、nullの場合は変更しない)
+   * @returns {Promise<CustomEvent>}
+   */
+  sendSetupLobby(teams, legendrefs = null) {
+    let precheck = true;
+    const buffer = new SendBuffer(ApexWebAPI.WEBAPI_SEND_CUSTOMMATCH_SETUPLOBBY);
+    if (!buffer.append(ApexWebAPI.WEBAPI_DATA_BOOL, legendrefs != null)) precheck = false;
+    if (!buffer.append(ApexWebAPI.WEBAPI_DATA_STRING, legendrefs != null ? legendrefs : '', this.#encoder)) precheck = false;
+    for (const team of teams) {
+      let mask = 0;
+      if (typeof team.name == 'string') mask |= 0x01;
+      if (typeof team.spawnpoint == 'number') mask |= 0x02;
+      if (!buffer.append(ApexWebAPI.WEBAPI_DATA_UINT8, team.teamid + 2)) precheck = false;
+      if (!buffer.append(ApexWebAPI.WEBAPI_DATA_UINT8, mask)) precheck = false;
+      if (!buffer.append(ApexWebAPI.WEBAPI_DATA_STRING, typeof team.name == 'string' ? team.name : '', this.#encoder)) precheck = false;
+      if (!buffer.append(ApexWebAPI.WEBAPI_DATA_UINT8, typeof team.spawnpoint == 'number' ? team.spawnpoint : 0)) precheck = false;
+    }
+    return this.#sendAndReceiveReply(buffer, "setuplobby", precheck);
+  }
+
   sendJoinPartyServer() {
     const buffer = new SendBuffer(ApexWebAPI.WEBAPI_SEND_JOINPARTYSERVER);
     return this.#sendAndReceiveReply(buffer, "joinpartyserver");
@@ -2223,6 +2440,14 @@ export class ApexWebAPI extends EventTarget {
     return this.#sendAndReceiveReply(buffer, "manualpostmatch");
   }
 
+  subscribe(topics) {
+    // 接続毎の設定のため再接続時は再度呼ぶこと
+    let precheck = true;
+    const buffer = new SendBuffer(ApexWebAPI.WEBAPI_SUBSCRIBE);
+    if (!buffer.append(ApexWebAPI.WEBAPI_DATA_UINT32, topics >>> 0)) precheck = false;
+    return this.#sendAndReceiveReply(buffer, "subscribe", precheck);
+  }
+
   isConnected() {
     return this.#socket.readyState == 1;
   }
@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+#ifdef _WIN32
 #define WINVER       0x0A00 // windows10
 #define _WIN32_WINNT 0x0A00 // windows10
 
@@ -19,12 +20,23 @@
 #else
 #pragma comment(linker,"/manifestdependency:\"type='win32' name='Microsoft.Windows.Common-Controls' version='6.0.0.0' processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
 #endif
+#else
+// Windows以外 (websocket_serverをLinuxで動かすための最小限)
+#include <cstdint>
+
+using SOCKET = int;
+constexpr SOCKET INVALID_SOCKET = -1;
+using DWORD = uint32_t;
+using UINT = unsigned int;
+#endif
 
 namespace app {
+#ifdef _WIN32
 	enum : UINT {
 		CWM_DUPLICATION_OUT = WM_APP + 1,
 		CWM_CORE_OUT,
 	};
+#endif
 
 	constexpr UINT CAPTURE_SQUARE_WIDTH = 32;
 	constexpr UINT CAPTURE_COUNT = 5;
@@ -18,6 +18,9 @@ namespace {
 		if (rc == 1) return true;
 		return false;
 	}
+
+	// 展開せずに捨てるLiveAPIイベントの初期値 (livedataを更新しないもの)
+	const WCHAR default_liveapi_ignore[] = L"ArenasItemSelected,ArenasItemDeselected";
 }
 
 
@@ -26,6 +29,7 @@ namespace app {
 	const WCHAR main_section_name[] = L"MAIN";
 	const WCHAR liveapi_section_name[] = L"LIVEAPI";
 	const WCHAR webapi_section_name[] = L"WEBAPI";
+	const WCHAR itemnames_section_name[] = L"ITEMNAMES";
 
 	config_ini::config_ini()
 		: path_(get_exe_directory() + L"\\" + ini_name)
@@ -96,6 +100,40 @@ namespace app {
 		return set_uint16(liveapi_section_name, L"PORT", _port);
 	}
 
+	std::vector<std::string> config_ini::get_liveapi_ignore()
+	{
+		std::vector<WCHAR> buffer(4096, L'\0');
+		::GetPrivateProfileStringW(liveapi_section_name, L"IGNORE", default_liveapi_ignore, buffer.data(), buffer.size(), path_.c_str());
+
+		// カンマ区切りのメッセージ名
+		std::vector<std::string> names;
+		std::wstring s = buffer.data();
+		size_t start = 0;
+		while (start <= s.size())
+		{
+			auto end = s.find(L',', start);
+			if (end == std::wstring::npos) end = s.size();
+			auto name = s.substr(start, end - start);
+			auto first = name.find_first_not_of(L" \t");
+			auto last = name.find_last_not_of(L" \t");
+			if (first != std::wstring::npos) names.push_back(ws_to_s(name.substr(first, last - first + 1)));
+			start = end + 1;
+		}
+		set_liveapi_ignore(names); // 取得時に書き込み実施
+		return names;
+	}
+
+	bool config_ini::set_liveapi_ignore(const std::vector<std::string>& _names)
+	{
+		std::wstring s = L"";
+		for (const auto& name : _names)
+		{
+			if (s != L"") s += L",";
+			s += s_to_ws(name);
+		}
+		return ::WritePrivateProfileStringW(liveapi_section_name, L"IGNORE", s.c_str(), path_.c_str()) == TRUE;
+	}
+
 	std::string config_ini::get_webapi_ipaddress()
 	{
 		auto ip = get_ip_address(webapi_section_name, L"IP", L"127.0.0.1");
@@ -136,6 +174,95 @@ namespace app {
 		return set_uint16(webapi_section_name, L"CONNECTIONS", _maxcon);
 	}
 
+	uint16_t config_ini::get_webapi_flush_interval()
+	{
+		uint16_t interval = get_uint16(webapi_section_name, L"FLUSH_INTERVAL", 16);
+		if (1000 < interval) interval = 16;
+		set_webapi_flush_interval(interval); // 取得時に書き込み実施
+		return interval;
+	}
+
+	bool config_ini::set_webapi_flush_interval(uint16_t _interval)
+	{
+		if (1000 < _interval) return false; // 0～1000ms (0はまとめずに即時送信)
+		return set_uint16(webapi_section_name, L"FLUSH_INTERVAL", _interval);
+	}
+
+	uint16_t config_ini::get_webapi_tick_rate()
+	{
+		uint16_t rate = get_uint16(webapi_section_name, L"TICK_RATE", 0);
+		if (240 < rate) rate = 0;
+		set_webapi_tick_rate(rate); // 取得時に書き込み実施
+		return rate;
+	}
+
+	bool config_ini::set_webapi_tick_rate(uint16_t _rate)
+	{
+		// 1秒あたりの送信回数 (0～240、0は届いたらすぐ送る)
+		if (240 < _rate) return false;
+		return set_uint16(webapi_section_name, L"TICK_RATE", _rate);
+	}
+
+	uint16_t config_ini::get_webapi_send_budget()
+	{
+		uint16_t kbytes = get_uint16(webapi_section_name, L"SEND_BUDGET", 1024);
+		set_webapi_send_budget(kbytes); // 取得時に書き込み実施
+		return kbytes;
+	}
+
+	bool config_ini::set_webapi_send_budget(uint16_t _kbytes)
+	{
+		// 接続毎の送信待ちKB (超えると位置・HP等は最新値のみ残す、0は無制限)
+		return set_uint16(webapi_section_name, L"SEND_BUDGET", _kbytes);
+	}
+
+	uint16_t config_ini::get_webapi_send_limit()
+	{
+		uint16_t kbytes = get_uint16(webapi_section_name, L"SEND_LIMIT", 16384);
+		set_webapi_send_limit(kbytes); // 取得時に書き込み実施
+		return kbytes;
+	}
+
+	bool config_ini::set_webapi_send_limit(uint16_t _kbytes)
+	{
+		// 接続毎の送信待ちKB (超えると切断、0は無制限)
+		return set_uint16(webapi_section_name, L"SEND_LIMIT", _kbytes);
+	}
+
+	uint16_t config_ini::get_webapi_workers()
+	{
+		uint16_t workers = get_uint16(webapi_section_name, L"WORKERS", 1);
+		if (workers == 0 || 16 < workers) workers = 1;
+		set_webapi_workers(workers); // 取得時に書き込み実施
+		return workers;
+	}
+
+	bool config_ini::set_webapi_workers(uint16_t _workers)
+	{
+		// 接続を分担するスレッド数 (1～16)
+		if (_workers == 0 || 16 < _workers) return false;
+		return set_uint16(webapi_section_name, L"WORKERS", _workers);
+	}
+
+	std::vector<std::pair<std::string, std::string>> config_ini::get_item_aliases()
+	{
+		// 日本語等を書く場合はiniをUTF-16LE(BOM付き)で保存する
+		std::vector<WCHAR> buffer(32767, L'\0');
+		auto readed = ::GetPrivateProfileSectionW(itemnames_section_name, buffer.data(), buffer.size(), path_.c_str());
+
+		// key=value\0key=value\0\0
+		std::vector<std::pair<std::string, std::string>> aliases;
+		for (size_t i = 0; i < readed && buffer.at(i) != L'\0'; )
+		{
+			std::wstring line = buffer.data() + i;
+			i += line.size() + 1;
+			auto pos = line.find(L'=');
+			if (pos == std::wstring::npos || pos == 0) continue;
+			aliases.emplace_back(ws_to_s(line.substr(0, pos)), ws_to_s(line.substr(pos + 1)));
+		}
+		return aliases;
+	}
+
 	std::wstring config_ini::get_monitor()
 	{
 		std::vector<WCHAR> buffer(512, L'\0');
@@ -3,6 +3,8 @@
 #include "common.hpp"
 
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace app
 {
@@ -26,6 +28,8 @@ namespace app
 		bool set_liveapi_ipaddress(const std::string& _ip);
 		uint16_t get_liveapi_port();
 		bool set_liveapi_port(uint16_t _port);
+		std::vector<std::string> get_liveapi_ignore();
+		bool set_liveapi_ignore(const std::vector<std::string>& _names);
 
 		// WebAPI側の設定
 		std::string get_webapi_ipaddress();
@@ -34,6 +38,19 @@ namespace app
 		bool set_webapi_port(uint16_t _port);
 		uint16_t get_webapi_maxconnection();
 		bool set_webapi_maxconnection(uint16_t _maxcon);
+		uint16_t get_webapi_flush_interval();
+		bool set_webapi_flush_interval(uint16_t _interval);
+		uint16_t get_webapi_tick_rate();
+		bool set_webapi_tick_rate(uint16_t _rate);
+		uint16_t get_webapi_send_budget();
+		bool set_webapi_send_budget(uint16_t _kbytes);
+		uint16_t get_webapi_send_limit();
+		bool set_webapi_send_limit(uint16_t _kbytes);
+		uint16_t get_webapi_workers();
+		bool set_webapi_workers(uint16_t _workers);
+
+		// アイテム名の言語パック (ローカライズ名=既知のアイテム名)
+		std::vector<std::pair<std::string, std::string>> get_item_aliases();
 
 		// 画面キャプチャ設定
 		std::wstring get_monitor();
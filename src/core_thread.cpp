@@ -1,12 +1,16 @@
 ﻿#include "core_thread.hpp"
 
 #include "log.hpp"
+#include "item_names.hpp"
 
 #include "utils.hpp"
 #include "version.hpp"
 #include "webapi.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <regex>
+#include <string_view>
 
 
 namespace {
@@ -30,95 +34,145 @@ namespace {
 		}
 		return false;
 	}
-}
 
-namespace app {
+	// FNV-1a 64bit
+	uint64_t get_type_hash(std::string_view _s)
+	{
+		uint64_t h = 14695981039346656037ull;
+		for (const auto c : _s)
+		{
+			h ^= static_cast<uint8_t>(c);
+			h *= 1099511628211ull;
+		}
+		return h;
+	}
 
+	// 32byteを超えるhashは索引に載せない
+	bool get_player_index_key(uint8_t _teamid, std::string_view _hash, app::player_index_key& _key)
+	{
+		if (_hash.size() == 0 || _hash.size() > _key.hash.size()) return false;
+		_key.hash.fill('\0');
+		std::copy(_hash.begin(), _hash.end(), _key.hash.begin());
+		_key.teamid = _teamid;
+		return true;
+	}
 
-	const std::unordered_map<std::string, uint8_t> itemtype_map = {
-		/* english */
-		{"Syringe", WEBAPI_ITEM_SYRINGE},
-		{"Med Kit (Level 2)", WEBAPI_ITEM_MEDKIT},
-		{"Shield Cell", WEBAPI_ITEM_SHIELDCELL},
-		{"Shield Battery (Level 2)", WEBAPI_ITEM_SHIELDBATTERY},
-		{"Phoenix Kit (Level 3)", WEBAPI_ITEM_PHOENIXKIT},
-		{"Ultimate Accelerant (Level 2)", WEBAPI_ITEM_ULTIMATEACCELERANT},
-		{"Ultimate Accelerant (Level 3)", WEBAPI_ITEM_ULTIMATEACCELERANT},
-		{"Frag Grenade", WEBAPI_ITEM_FRAGGRENADE},
-		{"Thermite Grenade", WEBAPI_ITEM_THERMITEGRENADE},
-		{"Arc Star", WEBAPI_ITEM_ARCSTAR},
-		{"Knockdown Shield", WEBAPI_ITEM_KNOCKDOWNSHIELD_LV1},
-		{"Knockdown Shield (Level 2)", WEBAPI_ITEM_KNOCKDOWNSHIELD_LV2},
-		{"Knockdown Shield (Level 3)", WEBAPI_ITEM_KNOCKDOWNSHIELD_LV3},
-		{"Knockdown Shield (Level 4)", WEBAPI_ITEM_KNOCKDOWNSHIELD_LV4},
-		{"Backpack", WEBAPI_ITEM_BACKPACK_LV1},
-		{"Backpack (Level 2)", WEBAPI_ITEM_BACKPACK_LV2},
-		{"Backpack (Level 3)", WEBAPI_ITEM_BACKPACK_LV3},
-		{"Backpack (Level 4)", WEBAPI_ITEM_BACKPACK_LV4},
-		{"Mobile Respawn Beacon (Level 2)", WEBAPI_ITEM_MOBILERESPAWNBEACON},
-		{"Heat Shield (Level 2)", WEBAPI_ITEM_HEATSHIELD},
-		{"Evac Tower (Level 2)", WEBAPI_ITEM_EVACTOWER}, // not confimed yet.
-		{"Evo Shield", WEBAPI_ITEM_BODYSHIELD_LV1},
-		{"Evo Shield (Level 2)", WEBAPI_ITEM_BODYSHIELD_LV2},
-		{"Evo Shield (Level 3)", WEBAPI_ITEM_BODYSHIELD_LV3},
-		{"Evo Shield (Level 5)", WEBAPI_ITEM_BODYSHIELD_LV5},
-		{"Body Shield", WEBAPI_ITEM_BODYSHIELD_LV1},
-		{"Body Shield (Level 2)", WEBAPI_ITEM_BODYSHIELD_LV2},
-		{"Body Shield (Level 3)", WEBAPI_ITEM_BODYSHIELD_LV3},
-		{"Body Shield (Level 4)", WEBAPI_ITEM_BODYSHIELD_LV4},
-		{"Shield Core", WEBAPI_ITEM_SHIELDCORE},
-		{"Infinite Ammo Amp (Level 3)", WEBAPI_ITEM_AMP_INFINITE_AMMO},
-		{"Bottomless Batteries Amp (Level 3)", WEBAPI_ITEM_AMP_BOTTOMLESS_BATTERIES},
-		{"Over Armor Amp (Level 3)", WEBAPI_ITEM_AMP_OVER_ARMOR},
-		{"Heal Overflow Amp (Level 3)", WEBAPI_ITEM_AMP_HEAL_OVERFLOW},
-		{"Power Booster Amp (Level 3)", WEBAPI_ITEM_AMP_POWER_BOOSTER},
-
-		/* 日本語 */
-		{(const char*)u8"注射器", WEBAPI_ITEM_SYRINGE},
-		{(const char*)u8"医療キット (Level 2)", WEBAPI_ITEM_MEDKIT},
-		{(const char*)u8"シールドセル", WEBAPI_ITEM_SHIELDCELL},
-		{(const char*)u8"シールドバッテリー (Level 2)", WEBAPI_ITEM_SHIELDBATTERY},
-		{(const char*)u8"フェニックスキット (Level 3)", WEBAPI_ITEM_PHOENIXKIT},
-		{(const char*)u8"アルティメット促進剤 (Level 2)", WEBAPI_ITEM_ULTIMATEACCELERANT},
-		{(const char*)u8"アルティメット促進剤 (Level 3)", WEBAPI_ITEM_ULTIMATEACCELERANT},
-		{(const char*)u8"フラググレネード", WEBAPI_ITEM_FRAGGRENADE},
-		{(const char*)u8"テルミットグレネード", WEBAPI_ITEM_THERMITEGRENADE},
-		{(const char*)u8"アークスター", WEBAPI_ITEM_ARCSTAR},
-		{(const char*)u8"ノックダウンシールド", WEBAPI_ITEM_KNOCKDOWNSHIELD_LV1},
-		{(const char*)u8"ノックダウンシールド (Level 2)", WEBAPI_ITEM_KNOCKDOWNSHIELD_LV2},
-		{(const char*)u8"ノックダウンシールド (Level 3)", WEBAPI_ITEM_KNOCKDOWNSHIELD_LV3},
-		{(const char*)u8"ノックダウンシールド (Level 4)", WEBAPI_ITEM_KNOCKDOWNSHIELD_LV4},
-		{(const char*)u8"バックパック", WEBAPI_ITEM_BACKPACK_LV1},
-		{(const char*)u8"バックパック (Level 2)", WEBAPI_ITEM_BACKPACK_LV2},
-		{(const char*)u8"バックパック (Level 3)", WEBAPI_ITEM_BACKPACK_LV3},
-		{(const char*)u8"バックパック (Level 4)", WEBAPI_ITEM_BACKPACK_LV4},
-		{(const char*)u8"モバイルリスポーンビーコン (Level 2)", WEBAPI_ITEM_MOBILERESPAWNBEACON},
-		{(const char*)u8"ヒートシールド (Level 2)", WEBAPI_ITEM_HEATSHIELD},
-		{(const char*)u8"脱出タワー (Level 2)", WEBAPI_ITEM_EVACTOWER},
-		{(const char*)u8"進化式ボディーシールド", WEBAPI_ITEM_BODYSHIELD_LV1},
-		{(const char*)u8"進化式ボディーシールド (Level 2)", WEBAPI_ITEM_BODYSHIELD_LV2},
-		{(const char*)u8"進化式ボディーシールド (Level 3)", WEBAPI_ITEM_BODYSHIELD_LV3},
-		{(const char*)u8"進化式ボディーシールド (Level 5)", WEBAPI_ITEM_BODYSHIELD_LV5},
-		{(const char*)u8"ボディーシールド", WEBAPI_ITEM_BODYSHIELD_LV1},
-		{(const char*)u8"ボディーシールド (Level 2)", WEBAPI_ITEM_BODYSHIELD_LV2},
-		{(const char*)u8"ボディーシールド (Level 3)", WEBAPI_ITEM_BODYSHIELD_LV3},
-		{(const char*)u8"ボディーシールド (Level 4)", WEBAPI_ITEM_BODYSHIELD_LV4},
-		{(const char*)u8"シールドコア", WEBAPI_ITEM_SHIELDCORE},
-		{(const char*)u8"無限弾薬増幅器 (Level 3)", WEBAPI_ITEM_AMP_INFINITE_AMMO},
-		{(const char*)u8"バッテリー無限増幅器 (Level 3)", WEBAPI_ITEM_AMP_BOTTOMLESS_BATTERIES},
-		{(const char*)u8"無限バッテリー増幅器 (Level 3)", WEBAPI_ITEM_AMP_BOTTOMLESS_BATTERIES},
-		{(const char*)u8"オーバーアーマー増幅器 (Level 3)", WEBAPI_ITEM_AMP_OVER_ARMOR},
-		{(const char*)u8"オーバーフロー回復増幅器 (Level 3)", WEBAPI_ITEM_AMP_HEAL_OVERFLOW},
-		{(const char*)u8"パワーブースト増幅器 (Level 3)", WEBAPI_ITEM_AMP_POWER_BOOSTER},
-		{(const char*)u8"パワーブースター増幅器 (Level 3)", WEBAPI_ITEM_AMP_POWER_BOOSTER},
-	};
+	template <typename T>
+	std::string get_full_name()
+	{
+		return std::string(T::descriptor()->full_name());
+	}
+
+	// livedataスナップショットの形式 (リトルエンディアン、文字列は1byte長+UTF-8)
+	//   version(u8) team数(u8)
+	//   team: teamid(u8) name(str) placement(u32) eliminated(u8) player数(u8)
+	//   player: id(str) name(str) character(str) weapon(str) state(u8) level(i32)
+	//           hp(u32) hp_max(u32) shield(u32) shield_max(u32) damage_dealt(u32) damage_taken(u32)
+	//           x(f32) y(f32) angle(f32)
+	//           kills(u32) assists(u32) knockdowns(u32) revives(u32) respawns(u32) killed(u32)
+	//           flags(u8: 0x01 disconnected, 0x02 canreconnect, 0x04 characterselected)
+	//           item数(u8) + (itemid(u8) quantity(u32)) * item数
+	//           perk数(u8) + (level(i32) name(str)) * perk数
+	constexpr uint8_t LIVEDATA_SNAPSHOT_VERSION = 1;
 
-	uint8_t string_to_itemid(const std::string& _str)
+	void snapshot_u8(std::vector<uint8_t>& _b, uint8_t _v)
 	{
-		if (itemtype_map.contains(_str)) {
-			return itemtype_map.at(_str);
+		_b.push_back(_v);
+	}
+
+	void snapshot_u32(std::vector<uint8_t>& _b, uint32_t _v)
+	{
+		for (auto i = 0u; i < 4; ++i)
+		{
+			_b.push_back(_v & 0xff);
+			_v >>= 8;
 		}
-		return 0;
+	}
+
+	void snapshot_i32(std::vector<uint8_t>& _b, int32_t _v)
+	{
+		uint32_t u;
+		std::memcpy(&u, &_v, 4);
+		snapshot_u32(_b, u);
+	}
+
+	void snapshot_f32(std::vector<uint8_t>& _b, float _v)
+	{
+		uint32_t u;
+		std::memcpy(&u, &_v, 4);
+		snapshot_u32(_b, u);
+	}
+
+	void snapshot_str(std::vector<uint8_t>& _b, std::string_view _v)
+	{
+		// WEBAPI_DATA_STRINGと同じく255byteまで (超える場合は空文字列)
+		if (_v.size() > 0xffu) _v = "";
+		_b.push_back(_v.size() & 0xff);
+		_b.insert(_b.end(), _v.begin(), _v.end());
+	}
+
+	// WebAPIで送るアイテムの一覧
+	template <typename F>
+	void for_each_webapi_item(const livedata::items& _items, F&& _f)
+	{
+		_f(app::WEBAPI_ITEM_SYRINGE, _items.syringe);
+		_f(app::WEBAPI_ITEM_MEDKIT, _items.medkit);
+		_f(app::WEBAPI_ITEM_SHIELDCELL, _items.shield_cell);
+		_f(app::WEBAPI_ITEM_SHIELDBATTERY, _items.shield_battery);
+		_f(app::WEBAPI_ITEM_PHOENIXKIT, _items.phoenixkit);
+		_f(app::WEBAPI_ITEM_ULTIMATEACCELERANT, _items.ultimateaccelerant);
+		_f(app::WEBAPI_ITEM_THERMITEGRENADE, _items.thermitegrenade);
+		_f(app::WEBAPI_ITEM_FRAGGRENADE, _items.fraggrenade);
+		_f(app::WEBAPI_ITEM_ARCSTAR, _items.arcstar);
+		_f(app::WEBAPI_ITEM_BODYSHIELD, _items.bodyshield);
+		_f(app::WEBAPI_ITEM_BACKPACK, _items.backpack);
+		_f(app::WEBAPI_ITEM_KNOCKDOWNSHIELD, _items.knockdownshield);
+		_f(app::WEBAPI_ITEM_MOBILERESPAWNBEACON, _items.mobilerespawnbeacon);
+		_f(app::WEBAPI_ITEM_HEATSHIELD, _items.heatshield);
+		_f(app::WEBAPI_ITEM_EVACTOWER, _items.evactower);
+		_f(app::WEBAPI_ITEM_SHIELDCORE, _items.shieldcore);
+		_f(app::WEBAPI_ITEM_AMP, _items.amp);
+	}
+
+	// tick毎にまとめて送るプレイヤーの値
+	enum : uint8_t {
+		WEBAPI_PLAYER_DIRTY_HP = 0x01u,
+		WEBAPI_PLAYER_DIRTY_SHIELD = 0x02u,
+		WEBAPI_PLAYER_DIRTY_POS = 0x04u,
+		WEBAPI_PLAYER_DIRTY_DAMAGE = 0x08u
+	};
+
+	// tick毎にまとめて送るチームの値
+	enum : uint8_t {
+		WEBAPI_TEAM_DIRTY_NAME = 0x01u
+	};
+
+	// LiveAPIへの要求のResponse待ちの上限 (ms)
+	constexpr uint64_t LIVEAPI_RESPONSE_TIMEOUT = 2000;
+
+	// LiveAPIデコード用Arenaの初期ブロックサイズ
+	constexpr size_t LIVEAPI_ARENA_BLOCK_SIZE = 64 * 1024;
+
+	// Arenaのブロック確保回数
+	uint64_t arena_block_alloc_count = 0;
+
+	void* arena_block_alloc(size_t _size)
+	{
+		++arena_block_alloc_count;
+		return ::operator new(_size);
+	}
+
+	void arena_block_dealloc(void* _p, size_t _size)
+	{
+		::operator delete(_p, _size);
+	}
+}
+
+namespace app {
+
+	size_t player_index_key_hash::operator()(const player_index_key& _key) const
+	{
+		return get_type_hash(std::string_view(_key.hash.data(), _key.hash.size())) ^ _key.teamid;
 	}
 
 	inline uint32_t update_quantity(uint32_t& _store, int _quantity)
@@ -141,30 +195,292 @@ namespace app {
 		return _store;
 	}
 
-	void core_thread::sendto_liveapi(std::vector<uint8_t>&& _data)
+	void core_thread::sendto_liveapi(std::vector<uint8_t>&& _data, uint8_t _priority, uint32_t _key, liveapi_response_func&& _on_response)
 	{
-		liveapi_queue_.push(std::move(_data));
+		auto& lane = liveapi_queue_.at(_priority);
+
+		// まだ送っていない同じ種類の要求は後勝ちで置き換える (順番と待ち始めた時間はそのまま)
+		if (_key != 0)
+		{
+			for (auto& queued : lane)
+			{
+				if (queued.key != _key) continue;
+				liveapi_response_func superseded = nullptr;
+				if (queued.data == _data)
+				{
+					// 同じ内容なので両方に同じ結果を返す
+					if (queued.on_response && _on_response)
+					{
+						queued.on_response = [prev = std::move(queued.on_response), next = std::move(_on_response)](liveapi_result _result) {
+							prev(_result);
+							next(_result);
+						};
+					}
+					else if (_on_response)
+					{
+						queued.on_response = std::move(_on_response);
+					}
+				}
+				else
+				{
+					// 置き換えられた側の内容は送らないので、成功として扱わせない
+					superseded = std::move(queued.on_response);
+					queued.data = std::move(_data);
+					queued.on_response = std::move(_on_response);
+				}
+				++liveapi_coalesced_count_;
+				sendto_liveapi_queuecheck();
+
+				// コールバック内で次の要求が積まれることがあるのでキューを触り終えてから呼ぶ
+				if (superseded) superseded(liveapi_result::superseded);
+				return;
+			}
+		}
+
+		lane.push_back({ std::move(_data), std::move(_on_response), _key, ::GetTickCount64() });
 		sendto_liveapi_queuecheck();
 	}
 
+	void core_thread::sendto_liveapi(rtech::liveapi::Request& _req, uint8_t _priority, uint32_t _key, liveapi_response_func&& _on_response)
+	{
+		_req.set_withack(true);
+
+		std::vector<uint8_t> buf;
+		buf.resize(_req.ByteSizeLong());
+		if (buf.size() > 0)
+		{
+			_req.SerializeToArray(buf.data(), buf.size());
+			sendto_liveapi(std::move(buf), _priority, _key, std::move(_on_response));
+		}
+	}
+
+	size_t core_thread::get_liveapi_queue_size() const
+	{
+		size_t size = 0;
+		for (const auto& lane : liveapi_queue_) size += lane.size();
+		return size;
+	}
+
 	void core_thread::sendto_liveapi_noqueue(std::vector<uint8_t>&& _data)
 	{
 		liveapi_.send_binary(INVALID_SOCKET, std::move(_data));
-		liveapi_available_ = false;
-		liveapi_lastsend_ = get_millis();
+		liveapi_sent(nullptr);
+	}
+
+	void core_thread::liveapi_sent(liveapi_response_func&& _on_response)
+	{
+		liveapi_inflight_.push_back(std::move(_on_response));
+		liveapi_deadline_ = ::GetTickCount64() + LIVEAPI_RESPONSE_TIMEOUT;
+	}
+
+	void core_thread::liveapi_responded(bool _success)
+	{
+		if (!liveapi_inflight_.empty())
+		{
+			auto on_response = std::move(liveapi_inflight_.front());
+			liveapi_inflight_.pop_front();
+			if (on_response) on_response(_success ? liveapi_result::success : liveapi_result::failed);
+		}
+		sendto_liveapi_queuecheck();
+	}
+
+	void core_thread::liveapi_abandon()
+	{
+		// コールバック内で次の要求が積まれることがあるので先に空にする
+		auto inflight = std::move(liveapi_inflight_);
+		liveapi_inflight_.clear();
+		for (auto& on_response : inflight)
+		{
+			if (on_response) on_response(liveapi_result::failed);
+		}
 	}
 
 	void core_thread::sendto_liveapi_queuecheck()
 	{
-		uint64_t current = get_millis();
-		if ((!liveapi_available_) && current < liveapi_lastsend_ + 2000) return; // timeout
-		liveapi_available_ = true;
-		if (current < liveapi_lastresponse_ + 500) return; // 少なくとも500ms待つ
-		if (liveapi_queue_.empty()) return;
-		liveapi_.send_binary(INVALID_SOCKET, std::move(liveapi_queue_.front()));
-		liveapi_queue_.pop();
-		liveapi_available_ = false;
-		liveapi_lastsend_ = current;
+		// 優先度の高いレーンから取り出す
+		auto lane = std::find_if(liveapi_queue_.begin(), liveapi_queue_.end(), [](const auto& _lane) { return !_lane.empty(); });
+		if (lane == liveapi_queue_.end()) return;
+		if (!liveapi_inflight_.empty())
+		{
+			if (::GetTickCount64() < liveapi_deadline_) return;
+
+			// Responseが来なかった分は諦める
+			log(LOG_CORE, std::format(L"Info: LiveAPI response timeout. inflight = {}", liveapi_inflight_.size()));
+			liveapi_abandon();
+			sendto_liveapi_queuecheck();
+			return;
+		}
+		auto req = std::move(lane->front());
+		lane->pop_front();
+
+		const auto now = ::GetTickCount64();
+		const auto wait = now > req.queued ? now - req.queued : 0;
+		liveapi_wait_total_ += wait;
+		liveapi_wait_max_ = std::max(liveapi_wait_max_, wait);
+		++liveapi_wait_count_;
+
+		liveapi_.send_binary(INVALID_SOCKET, std::move(req.data));
+		liveapi_sent(std::move(req.on_response));
+	}
+
+	DWORD core_thread::get_liveapi_queue_timeout()
+	{
+		if (get_liveapi_queue_size() == 0) return INFINITE;
+		if (liveapi_inflight_.empty()) return 0;
+		auto now = ::GetTickCount64();
+		if (now >= liveapi_deadline_) return 0;
+		return static_cast<DWORD>(liveapi_deadline_ - now);
+	}
+
+	void core_thread::start_lobby_setup(std::shared_ptr<lobby_setup> _setup)
+	{
+		// 差分を取る前に現在の状態を取り直す (Resultは完了通知より先に反映される)
+		rtech::liveapi::Request getlobbyplayers;
+		rtech::liveapi::Request getlegendbanstatus;
+		if (!_setup->teams.empty())
+		{
+			getlobbyplayers.mutable_custommatch_getlobbyplayers();
+			++_setup->refreshing;
+		}
+		if (_setup->set_legendban)
+		{
+			getlegendbanstatus.mutable_custommatch_getlegendbanstatus();
+			++_setup->refreshing;
+		}
+
+		if (_setup->refreshing == 0)
+		{
+			proc_lobby_setup(_setup);
+			return;
+		}
+
+		auto refreshed = [this, _setup](liveapi_result) {
+			// 取れなかった場合は分かっている範囲で差分を取る
+			if (--_setup->refreshing == 0) proc_lobby_setup(_setup);
+		};
+		if (!_setup->teams.empty()) sendto_liveapi(getlobbyplayers, LIVEAPI_PRIORITY_NORMAL, liveapi_coalesce_key(WEBAPI_SEND_CUSTOMMATCH_GETLOBBYPLAYERS), refreshed);
+		if (_setup->set_legendban) sendto_liveapi(getlegendbanstatus, LIVEAPI_PRIORITY_NORMAL, liveapi_coalesce_key(WEBAPI_SEND_CUSTOMMATCH_GETLEGENDBANSTATUS), refreshed);
+	}
+
+	void core_thread::proc_lobby_setup(std::shared_ptr<lobby_setup> _setup)
+	{
+		std::vector<rtech::liveapi::Request> reqs;
+		std::vector<uint32_t> keys;
+		std::vector<liveapi_response_func> funcs;
+
+		for (const auto& team : _setup->teams)
+		{
+			const auto it = lobby_teams_.find(team.teamid);
+			const bool known = it != lobby_teams_.end();
+
+			if (team.mask & LOBBY_SETUP_NAME)
+			{
+				if (known && it->second.name == team.name)
+				{
+					++_setup->skipped;
+				}
+				else
+				{
+					auto& req = reqs.emplace_back();
+					auto act = req.mutable_custommatch_setteamname();
+					act->set_teamid((int32_t)team.teamid);
+					act->set_teamname(team.name);
+					keys.push_back(liveapi_coalesce_key(WEBAPI_SEND_CUSTOMMATCH_SETTEAMNAME, team.teamid));
+					funcs.emplace_back([this, _setup, teamid = team.teamid, name = team.name](liveapi_result _result) {
+						if (_result == liveapi_result::success) lobby_applied_name(teamid, name);
+						lobby_setup_completed(_setup, _result == liveapi_result::success);
+					});
+				}
+			}
+
+			if (team.mask & LOBBY_SETUP_SPAWNPOINT)
+			{
+				if (known && it->second.spawnpoint == team.spawnpoint)
+				{
+					++_setup->skipped;
+				}
+				else
+				{
+					auto& req = reqs.emplace_back();
+					auto act = req.mutable_custommatch_setspawnpoint();
+					act->set_teamid((int32_t)team.teamid);
+					act->set_spawnpoint(team.spawnpoint);
+					keys.push_back(liveapi_coalesce_key(WEBAPI_SEND_CUSTOMMATCH_SETSPAWNPOINT, team.teamid));
+					funcs.emplace_back([this, _setup, teamid = team.teamid, spawnpoint = team.spawnpoint](liveapi_result _result) {
+						if (_result == liveapi_result::success) lobby_applied_spawnpoint(teamid, spawnpoint);
+						lobby_setup_completed(_setup, _result == liveapi_result::success);
+					});
+				}
+			}
+		}
+
+		if (_setup->set_legendban)
+		{
+			if (lobby_legendbans_known_ && lobby_legendbans_ == _setup->legendrefs)
+			{
+				++_setup->skipped;
+			}
+			else
+			{
+				auto& req = reqs.emplace_back();
+				auto act = req.mutable_custommatch_setlegendban();
+				for (const auto& legendref : _setup->legendrefs)
+				{
+					act->add_legendrefs(legendref);
+				}
+				keys.push_back(liveapi_coalesce_key(WEBAPI_SEND_CUSTOMMATCH_SETLEGENDBAN));
+				funcs.emplace_back([this, _setup](liveapi_result _result) {
+					if (_result == liveapi_result::success) lobby_applied_legendbans(_setup->legendrefs);
+					lobby_setup_completed(_setup, _result == liveapi_result::success);
+				});
+			}
+		}
+
+		log(LOG_CORE, std::format(L"Info: lobby setup started. (total={}, skipped={})", reqs.size(), _setup->skipped));
+
+		// 完了通知は送信後にしか来ないので、先に総数を確定させておく
+		_setup->total = static_cast<uint32_t>(reqs.size());
+		if (_setup->total == 0)
+		{
+			send_webapi_lobbysetup_done(*_setup);
+			return;
+		}
+
+		for (size_t i = 0; i < reqs.size(); ++i)
+		{
+			sendto_liveapi(reqs[i], LIVEAPI_PRIORITY_NORMAL, keys[i], std::move(funcs[i]));
+		}
+	}
+
+	void core_thread::lobby_setup_completed(std::shared_ptr<lobby_setup> _setup, bool _success)
+	{
+		if (_success) ++_setup->done;
+		else ++_setup->failed;
+
+		send_webapi_lobbysetup_progress(*_setup);
+		if (_setup->done + _setup->failed < _setup->total) return;
+
+		log(LOG_CORE, std::format(L"Info: lobby setup done. (done={}, failed={}, skipped={}, time={}ms)", _setup->done, _setup->failed, _setup->skipped, ::GetTickCount64() - _setup->start));
+		send_webapi_lobbysetup_done(*_setup);
+	}
+
+	void core_thread::lobby_applied_name(uint8_t _teamid, const std::string& _name)
+	{
+		auto it = lobby_teams_.find(_teamid);
+		if (it != lobby_teams_.end()) it->second.name = _name;
+	}
+
+	void core_thread::lobby_applied_spawnpoint(uint8_t _teamid, uint8_t _spawnpoint)
+	{
+		auto it = lobby_teams_.find(_teamid);
+		if (it != lobby_teams_.end()) it->second.spawnpoint = _spawnpoint;
+	}
+
+	void core_thread::lobby_applied_legendbans(std::vector<std::string> _legendrefs)
+	{
+		std::sort(_legendrefs.begin(), _legendrefs.end());
+		lobby_legendbans_ = std::move(_legendrefs);
+		lobby_legendbans_known_ = true;
 	}
 
 	void core_thread::sendto_webapi(std::vector<uint8_t>&& _data)
@@ -174,31 +490,107 @@ namespace app {
 
 	void core_thread::sendto_webapi(SOCKET _sock, std::vector<uint8_t>&& _data)
 	{
-		webapi_.send_binary(_sock, std::move(_data));
+		// 1回の処理 (TICK_RATE指定時は1ティック) で溜まった分はflush_webapi_pending()でまとめて送る
+		webapi_pending_.emplace_back(_sock, std::move(_data));
 	}
 
-	core_thread::core_thread(const std::string& _lip, uint16_t _lport, const std::string& _wip, uint16_t _wport, uint16_t _wmaxconn)
+	void core_thread::flush_webapi_pending()
+	{
+		// 送信先と購読トピックが同じものが連続している間はWEBAPI_EVENT_BATCHにまとめる (順序は変えない)
+		auto get_topic = [](const std::pair<SOCKET, std::vector<uint8_t>>& _p) -> uint32_t {
+			if (_p.first != INVALID_SOCKET || _p.second.size() == 0) return WEBAPI_TOPIC_ALL;
+			return get_webapi_topic(_p.second.at(0));
+		};
+		size_t i = 0;
+		while (i < webapi_pending_.size())
+		{
+			auto sock = webapi_pending_.at(i).first;
+			auto topic = get_topic(webapi_pending_.at(i));
+			size_t end = i + 1;
+			while (end < webapi_pending_.size() && webapi_pending_.at(end).first == sock && get_topic(webapi_pending_.at(end)) == topic) ++end;
+
+			if (end - i == 1)
+			{
+				auto key = get_webapi_coalesce_key(webapi_pending_.at(i).second);
+				webapi_.send_binary(sock, std::move(webapi_pending_.at(i).second), topic, key);
+				i = end;
+				continue;
+			}
+
+			// バッチ全体は置き換えず、送信待ちが溢れている接続にはイベント単体のフレームに分けて送る (キーはイベント毎)
+			while (i < end)
+			{
+				send_webapi_batch batch;
+				std::vector<wspart_t> parts;
+				while (i < end)
+				{
+					const auto& event = webapi_pending_.at(i).second;
+					const auto offset = batch.buffer_.size() + 4;
+					if (!batch.append(event)) break;
+					parts.push_back({ offset, event.size(), get_webapi_coalesce_key(event) });
+					++i;
+				}
+				webapi_.send_binary(sock, std::move(batch.buffer_), topic, 0, std::move(parts));
+			}
+		}
+		webapi_pending_.clear();
+	}
+
+	core_thread::core_thread(const std::string& _lip, uint16_t _lport, const std::string& _wip, uint16_t _wport, uint16_t _wmaxconn, uint16_t _wflush, uint16_t _wtick, uint16_t _wbudget, uint16_t _wlimit, uint16_t _wworkers, const std::vector<std::string>& _lignore)
 		: window_(NULL)
 		, thread_(NULL)
 		, event_close_(NULL)
 		, event_in_(NULL)
-		, mtx_in_()
 		, mtx_out_()
-		, q_in_()
+		, q_in_(CORE_RING_IN_SIZE)
 		, q_out_()
 		, liveapi_(LOG_LIVEAPI, _lip, _lport, 2)
-		, webapi_(LOG_WEBAPI, _wip, _wport, _wmaxconn)
+		, webapi_(LOG_WEBAPI, _wip, _wport, _wmaxconn, size_t(_wbudget) * 1024, size_t(_wlimit) * 1024, _wworkers)
 		, local_(LOG_LOCAL)
 		, http_get_(LOG_HTTP_GET)
 		, filedump_()
 		, game_()
+		, player_index_()
 		, camera_()
 		, observer_hash_("")
 		, liveapi_queue_()
-		, liveapi_available_(true)
-		, liveapi_lastsend_(0)
-		, liveapi_lastresponse_(0)
-	{
+		, liveapi_coalesced_count_(0)
+		, liveapi_wait_total_(0)
+		, liveapi_wait_count_(0)
+		, liveapi_wait_max_(0)
+		, liveapi_inflight_()
+		, liveapi_deadline_(0)
+		, lobby_teams_()
+		, lobby_legendbans_()
+		, lobby_legendbans_known_(false)
+		, liveapi_any_table_()
+		, liveapi_any_unknown_count_(0)
+		, liveapi_any_ignore_()
+		, liveapi_arena_block_(LIVEAPI_ARENA_BLOCK_SIZE)
+		, liveapi_arena_()
+		, liveapi_event_count_(0)
+		, liveapi_wire_count_(0)
+		, liveapi_wire_fallback_count_(0)
+		, webapi_flush_interval_(_wflush)
+		, webapi_flush_next_(0)
+		, webapi_tick_rate_(_wtick)
+		, webapi_tick_start_(0)
+		, webapi_tick_next_(0)
+		, webapi_dirty_(false)
+		, webapi_player_dirty_()
+		, webapi_team_dirty_()
+		, webapi_pending_()
+	{
+		init_liveapi_any_table();
+		init_liveapi_any_ignore(_lignore);
+
+		// 通常のフレームは初期ブロック内に収まる
+		google::protobuf::ArenaOptions options;
+		options.initial_block = liveapi_arena_block_.data();
+		options.initial_block_size = liveapi_arena_block_.size();
+		options.block_alloc = arena_block_alloc;
+		options.block_dealloc = arena_block_dealloc;
+		liveapi_arena_ = std::make_unique<google::protobuf::Arena>(options);
 	}
 
 	core_thread::~core_thread()
@@ -220,6 +612,10 @@ namespace app {
 	DWORD core_thread::proc()
 	{
 		log(LOG_CORE, L"Info: thread start.");
+		if (webapi_tick_rate_ > 0)
+		{
+			log(LOG_CORE, std::format(L"Info: webapi tick rate = {}Hz", webapi_tick_rate_));
+		}
 
 		enum : DWORD {
 			WAIT_OBJECT_0_CLOSE = WAIT_OBJECT_0,
@@ -245,7 +641,9 @@ namespace app {
 		while (true)
 		{
 
-			auto id = ::WaitForMultipleObjects(ARRAYSIZE(events), events, FALSE, INFINITE);
+			// 次にやることがある時刻まで待つ
+			auto timeout = std::min(get_webapi_flush_timeout(), get_liveapi_queue_timeout());
+			auto id = ::WaitForMultipleObjects(ARRAYSIZE(events), events, FALSE, timeout);
 			if (id == WAIT_OBJECT_0_CLOSE)
 			{
 				// 終了
@@ -255,33 +653,37 @@ namespace app {
 			else if (id == WAIT_OBJECT_0_LIVEAPI)
 			{
 				// liveapiからデータ到達
-				auto q = liveapi_.pull_q_out();
-				while (q.size() > 0)
-				{
+				liveapi_.consume_out([&](websocket_message_out& _msg) {
 					std::visit(overloaded{
 						[&](const websocket_message_out_connected& _m) {
 							log(LOG_CORE, L"Info: liveapi connected.");
 						},
 						[&](const websocket_message_out_disconnected& _m) {
 							log(LOG_CORE, L"Info: liveapi disconnected.");
+
+							// 切れた接続からResponseは来ない
+							liveapi_abandon();
+							lobby_teams_.clear();
+							lobby_legendbans_known_ = false;
 						},
 						[&](websocket_message_out_recv_binary& _m) {
 							proc_liveapi_data(_m.sock, std::move(_m.data));
 						},
 						[&](const websocket_message_out_get_stats& _m) {
-							push_out(core_message_out_liveapi_stats{_m.conn_count, _m.recv_count, _m.send_count});
+							const uint64_t wait_avg = liveapi_wait_count_ > 0 ? liveapi_wait_total_ / liveapi_wait_count_ : 0;
+							push_out(core_message_out_liveapi_stats{_m.conn_count, _m.recv_count, _m.send_count, _m.rbuf_bytes, _m.pool_bytes, _m.queued_bytes, get_liveapi_queue_size(), wait_avg, liveapi_wait_max_, liveapi_coalesced_count_});
+							liveapi_wait_total_ = 0;
+							liveapi_wait_count_ = 0;
+							liveapi_wait_max_ = 0;
 							send_webapi_liveapi_socket_stats(_m.conn_count, _m.recv_count, _m.send_count);
 						}
-						}, q.front());
-					q.pop();
-				}
+						}, _msg);
+					});
 			}
 			else if (id == WAIT_OBJECT_0_WEBAPI)
 			{
 				// ブラウザからデータ到達
-				auto q = webapi_.pull_q_out();
-				while (q.size() > 0)
-				{
+				webapi_.consume_out([&](websocket_message_out& _msg) {
 					std::visit(overloaded{
 						[&](const websocket_message_out_connected& _m) {
 							log(LOG_CORE, L"Info: webapi connected.");
@@ -293,11 +695,10 @@ namespace app {
 							proc_webapi_data(_m.sock, std::move(_m.data));
 						},
 						[&](const websocket_message_out_get_stats& _m) {
-							push_out(core_message_out_webapi_stats{_m.conn_count, _m.recv_count, _m.send_count});
+							push_out(core_message_out_webapi_stats{_m.conn_count, _m.recv_count, _m.send_count, _m.rbuf_bytes, _m.pool_bytes, _m.queued_bytes});
 						}
-						}, q.front());
-					q.pop();
-				}
+						}, _msg);
+					});
 			}
 			else if (id == WAIT_OBJECT_0_LOCAL)
 			{
@@ -312,11 +713,11 @@ namespace app {
 			else if (id == WAIT_OBJECT_0_IN)
 			{
 				// main_windowからメッセージ到達
-				auto q = pull_q_in();
-				while (q.size() > 0)
+				if (q_in_.consume([&](core_message_in& _msg) {
+					proc_message(std::move(_msg));
+					}))
 				{
-					proc_message(std::move(q.front()));
-					q.pop();
+					::SetEvent(event_in_);
 				}
 			}
 			else if (id == WAIT_OBJECT_0_HTTPGET)
@@ -329,7 +730,15 @@ namespace app {
 					q.pop();
 				}
 			}
+
+			// 溜まった値の送信
+			webapi_tick();
+
+			// 送れるようになったLiveAPIへの要求を送信
+			sendto_liveapi_queuecheck();
 		}
+		q_in_.close();
+		log_liveapi_any_stats();
 		log(LOG_CORE, L"Info: thread end.");
 
 		return 0;
@@ -345,25 +754,40 @@ namespace app {
 		// メッセージとして処理
 		if (!result)
 		{
-			rtech::liveapi::LiveAPIEvent ev;
-			result = ev.ParseFromArray(_data.data(), _data.size());
+			// フレームのバッファを参照したまま取り出す
+			liveapi_wire_any any;
+			bool has_gamemessage = false;
+			result = liveapi_wire_parse_event(std::string_view(reinterpret_cast<const char*>(_data.data()), _data.size()), any, has_gamemessage);
+			if (!result)
+			{
+				// 生成コードにフォールバック
+				auto& ev = create_liveapi_message<rtech::liveapi::LiveAPIEvent>();
+				result = ev.ParseFromArray(_data.data(), _data.size());
+				if (result)
+				{
+					has_gamemessage = ev.has_gamemessage();
+					any = { ev.gamemessage().type_url(), ev.gamemessage().value() };
+				}
+			}
 			if (result)
 			{
-				if (ev.has_gamemessage())
+				if (has_gamemessage)
 				{
 					// メッセージの場合は書き込む
-					proc_liveapi_any(ev.gamemessage());
+					liveapi_event_count_++;
+					proc_liveapi_any(any);
 
 					// ファイルに書き込む
 					filedump_.append(std::move(_data));
-
-					return;
 				}
 				else
 				{
 					result = false;
 				}
 			}
+
+			// フレーム毎に解放
+			liveapi_arena_->Reset();
 		}
 
 		if (!result)
@@ -439,7 +863,7 @@ namespace app {
 			if (buf.size() > 0)
 			{
 				req.SerializeToArray(buf.data(), buf.size());
-				sendto_liveapi(std::move(buf));
+				sendto_liveapi(std::move(buf), LIVEAPI_PRIORITY_NORMAL, 0);
 				reply_webapi_send_custommatch_createlobby(socket, sequence);
 			}
 			break;
@@ -459,7 +883,7 @@ namespace app {
 			if (buf.size() > 0)
 			{
 				req.SerializeToArray(buf.data(), buf.size());
-				sendto_liveapi(std::move(buf));
+				sendto_liveapi(std::move(buf), LIVEAPI_PRIORITY_NORMAL, liveapi_coalesce_key(WEBAPI_SEND_CUSTOMMATCH_GETLOBBYPLAYERS));
 				reply_webapi_send_custommatch_getlobbyplayers(socket, sequence);
 			}
 			break;
@@ -497,6 +921,27 @@ namespace app {
 			log(LOG_CORE, L"Info: WEBAPI_LIVEDATA_GET_OBSERVERS_CAMERA received.");
 			livedata_get_observers_camera(socket, sequence);
 			break;
+		case WEBAPI_LIVEDATA_GET_SNAPSHOT:
+			log(LOG_CORE, L"Info: WEBAPI_LIVEDATA_GET_SNAPSHOT received.");
+			if (wdata.size() != 2)
+			{
+				log(LOG_CORE, std::format(L"Error: sended data size is not 2. (size={})", wdata.size()));
+				return;
+			}
+			try
+			{
+				auto teamid = wdata.get_uint8(1);
+				livedata_get_snapshot(socket, sequence, teamid);
+			}
+			catch (std::out_of_range& oor)
+			{
+				log(LOG_CORE, std::format(L"Error: data parse failed({})", s_to_ws(oor.what())));
+			}
+			catch (...)
+			{
+				log(LOG_CORE, L"Error: data parse failed.");
+			}
+			break;
 		case WEBAPI_LOCALDATA_GET_OBSERVER:
 		{
 			log(LOG_CORE, L"Info: WEBAPI_SEND_GET_OBSERVER received.");
@@ -909,7 +1354,7 @@ namespace app {
 			if (buf.size() > 0)
 			{
 				req.SerializeToArray(buf.data(), buf.size());
-				sendto_liveapi(std::move(buf));
+				sendto_liveapi(std::move(buf), LIVEAPI_PRIORITY_LOW, liveapi_coalesce_key(WEBAPI_SEND_CUSTOMMATCH_SETSETTINGS));
 				reply_webapi_send_custommatch_setsettings(socket, sequence);
 			}
 			break;
@@ -929,7 +1374,7 @@ namespace app {
 			if (buf.size() > 0)
 			{
 				req.SerializeToArray(buf.data(), buf.size());
-				sendto_liveapi(std::move(buf));
+				sendto_liveapi(std::move(buf), LIVEAPI_PRIORITY_LOW, liveapi_coalesce_key(WEBAPI_SEND_CUSTOMMATCH_GETSETTINGS));
 				reply_webapi_send_custommatch_getsettings(socket, sequence);
 			}
 			break;
@@ -967,7 +1412,10 @@ namespace app {
 			if (buf.size() > 0)
 			{
 				req.SerializeToArray(buf.data(), buf.size());
-				sendto_liveapi(std::move(buf));
+				const uint8_t teamid = act->teamid() & 0xff;
+				sendto_liveapi(std::move(buf), LIVEAPI_PRIORITY_NORMAL, liveapi_coalesce_key(WEBAPI_SEND_CUSTOMMATCH_SETTEAMNAME, teamid), [this, teamid, name = act->teamname()](liveapi_result _result) {
+					if (_result == liveapi_result::success) lobby_applied_name(teamid, name);
+				});
 				reply_webapi_send_custommatch_setteamname(socket, sequence);
 			}
 			break;
@@ -1005,7 +1453,7 @@ namespace app {
 			if (buf.size() > 0)
 			{
 				req.SerializeToArray(buf.data(), buf.size());
-				sendto_liveapi(std::move(buf));
+				sendto_liveapi(std::move(buf), LIVEAPI_PRIORITY_LOW, 0);
 				reply_webapi_send_custommatch_sendchat(socket, sequence);
 			}
 			break;
@@ -1043,7 +1491,10 @@ namespace app {
 			if (buf.size() > 0)
 			{
 				req.SerializeToArray(buf.data(), buf.size());
-				sendto_liveapi(std::move(buf));
+				const uint8_t teamid = act->teamid() & 0xff;
+				sendto_liveapi(std::move(buf), LIVEAPI_PRIORITY_NORMAL, liveapi_coalesce_key(WEBAPI_SEND_CUSTOMMATCH_SETSPAWNPOINT, teamid), [this, teamid, spawnpoint = static_cast<uint8_t>(act->spawnpoint() & 0xff)](liveapi_result _result) {
+					if (_result == liveapi_result::success) lobby_applied_spawnpoint(teamid, spawnpoint);
+				});
 				reply_webapi_send_custommatch_setspawnpoint(socket, sequence);
 			}
 			break;
@@ -1098,7 +1549,7 @@ namespace app {
 			if (buf.size() > 0)
 			{
 				req.SerializeToArray(buf.data(), buf.size());
-				sendto_liveapi(std::move(buf));
+				sendto_liveapi(std::move(buf), LIVEAPI_PRIORITY_NORMAL, liveapi_coalesce_key(WEBAPI_SEND_CUSTOMMATCH_SETENDRINGEXCLUSION));
 				reply_webapi_send_custommatch_setendringexclusion(socket, sequence);
 			}
 			break;
@@ -1118,7 +1569,7 @@ namespace app {
 			if (buf.size() > 0)
 			{
 				req.SerializeToArray(buf.data(), buf.size());
-				sendto_liveapi(std::move(buf));
+				sendto_liveapi(std::move(buf), LIVEAPI_PRIORITY_NORMAL, liveapi_coalesce_key(WEBAPI_SEND_CUSTOMMATCH_GETLEGENDBANSTATUS));
 				reply_webapi_send_custtommatch_getlegendbanstatus(socket, sequence);
 			}
 			break;
@@ -1174,11 +1625,85 @@ namespace app {
 			if (buf.size() > 0)
 			{
 				req.SerializeToArray(buf.data(), buf.size());
-				sendto_liveapi(std::move(buf));
+				sendto_liveapi(std::move(buf), LIVEAPI_PRIORITY_NORMAL, liveapi_coalesce_key(WEBAPI_SEND_CUSTOMMATCH_SETLEGENDBAN), [this, legendrefs = std::vector<std::string>(act->legendrefs().begin(), act->legendrefs().end())](liveapi_result _result) {
+					if (_result == liveapi_result::success) lobby_applied_legendbans(legendrefs);
+				});
 				reply_webapi_send_custtommatch_setlegendban(socket, sequence);
 			}
 			break;
 		}
+		case WEBAPI_SEND_CUSTOMMATCH_SETUPLOBBY:
+		{
+			log(LOG_CORE, L"Info: WEBAPI_SEND_CUSTOMMATCH_SETUPLOBBY received.");
+
+			// [1]:レジェンドBANを設定するか [2]:BANするレジェンド(カンマ区切り)
+			// 以降チームごとに [teamid][設定する項目][チーム名][スポーンポイント]
+			if (wdata.size() < 3 || (wdata.size() - 3) % 4 != 0)
+			{
+				log(LOG_CORE, std::format(L"Error: sended data size is invalid. (size={})", wdata.size()));
+				return;
+			}
+
+			auto setup = std::make_shared<lobby_setup>();
+			setup->sock = socket;
+			setup->sequence = sequence;
+			setup->start = ::GetTickCount64();
+			setup->refreshing = 0;
+			setup->total = 0;
+			setup->done = 0;
+			setup->failed = 0;
+			setup->skipped = 0;
+
+			try
+			{
+				setup->set_legendban = wdata.get_bool(1);
+
+				const auto legendrefsstr = wdata.get_string(2);
+				std::string legendref = "";
+				for (const auto c : legendrefsstr)
+				{
+					if (c == ',')
+					{
+						if (legendref != "")
+						{
+							setup->legendrefs.push_back(legendref);
+							legendref = "";
+						}
+					}
+					else
+					{
+						legendref += c;
+					}
+				}
+				if (legendref != "")
+				{
+					setup->legendrefs.push_back(legendref);
+					legendref = "";
+				}
+				std::sort(setup->legendrefs.begin(), setup->legendrefs.end());
+				setup->legendrefs.erase(std::unique(setup->legendrefs.begin(), setup->legendrefs.end()), setup->legendrefs.end());
+
+				for (uint8_t i = 3; i + 3 < wdata.size(); i += 4)
+				{
+					lobby_setup_team team;
+					team.teamid = wdata.get_uint8(i);
+					team.mask = wdata.get_uint8(static_cast<uint8_t>(i + 1));
+					team.name = wdata.get_string(static_cast<uint8_t>(i + 2));
+					team.spawnpoint = wdata.get_uint8(static_cast<uint8_t>(i + 3));
+					if (team.mask == 0) continue;
+					setup->teams.push_back(std::move(team));
+				}
+			}
+			catch (...)
+			{
+				log(LOG_CORE, L"Error: data parse failed.");
+				return;
+			}
+
+			reply_webapi_send_custommatch_setuplobby(socket, sequence);
+			start_lobby_setup(setup);
+			break;
+		}
 		case WEBAPI_SEND_CHANGECAMERA:
 		{
 			log(LOG_CORE, L"Info: WEBAPI_SEND_CHANGECAMERA received.");
@@ -1221,7 +1746,7 @@ namespace app {
 			if (buf.size() > 0)
 			{
 				req.SerializeToArray(buf.data(), buf.size());
-				sendto_liveapi_noqueue(std::move(buf));
+				sendto_liveapi(std::move(buf), LIVEAPI_PRIORITY_HIGH, liveapi_coalesce_key(WEBAPI_SEND_CHANGECAMERA));
 				reply_webapi_send_changecamera(socket, sequence);
 			}
 			break;
@@ -1262,7 +1787,7 @@ namespace app {
 			if (buf.size() > 0)
 			{
 				req.SerializeToArray(buf.data(), buf.size());
-				sendto_liveapi(std::move(buf));
+				sendto_liveapi(std::move(buf), LIVEAPI_PRIORITY_HIGH, 0);
 				reply_webapi_send_pausetoggle(socket, sequence);
 			}
 			break;
@@ -1368,6 +1893,28 @@ namespace app {
 			reply_webapi_manual_postmatch(socket, sequence);
 			break;
 		}
+		case WEBAPI_SUBSCRIBE:
+		{
+			log(LOG_CORE, L"Info: WEBAPI_SUBSCRIBE received.");
+
+			if (wdata.size() != 2)
+			{
+				log(LOG_CORE, std::format(L"Error: sended data size is not 2. (size={})", wdata.size()));
+				return;
+			}
+
+			try
+			{
+				auto topics = wdata.get_uint32(1);
+				webapi_.subscribe(socket, topics);
+				reply_webapi_subscribe(socket, sequence, topics);
+			}
+			catch (...)
+			{
+				log(LOG_CORE, L"Error: data parse failed.");
+			}
+			break;
+		}
 		case WEBAPI_BROADCAST_OBJECT:
 		{
 			log(LOG_CORE, L"Info: WEBAPI_BROADCAST_OBJECT received.");
@@ -1480,41 +2027,190 @@ namespace app {
 		reply_webapi_get_stats_from_code(_data.sock, _data.sequence, _data.code, _data.status_code, _data.json);
 	}
 
+	//---------------------------------------------------------------------------------
+	// LIVEAPI ANY TABLE
+	//---------------------------------------------------------------------------------
+	void core_thread::init_liveapi_any_table()
+	{
+		namespace api = rtech::liveapi;
+		const std::vector<std::pair<uint8_t, std::string>> types = {
+			{ LIVEAPI_ANY_RESPONSE, get_full_name<api::Response>() },
+			{ LIVEAPI_ANY_REQUESTSTATUS, get_full_name<api::RequestStatus>() },
+			{ LIVEAPI_ANY_INIT, get_full_name<api::Init>() },
+			{ LIVEAPI_ANY_CUSTOMMATCH_LOBBYPLAYERS, get_full_name<api::CustomMatch_LobbyPlayers>() },
+			{ LIVEAPI_ANY_CUSTOMMATCH_SETSETTINGS, get_full_name<api::CustomMatch_SetSettings>() },
+			{ LIVEAPI_ANY_CUSTOMMATCH_LEGENDBANSTATUS, get_full_name<api::CustomMatch_LegendBanStatus>() },
+			{ LIVEAPI_ANY_OBSERVERSWITCHED, get_full_name<api::ObserverSwitched>() },
+			{ LIVEAPI_ANY_MATCHSETUP, get_full_name<api::MatchSetup>() },
+			{ LIVEAPI_ANY_GAMESTATECHANGED, get_full_name<api::GameStateChanged>() },
+			{ LIVEAPI_ANY_CHARACTERSELECTED, get_full_name<api::CharacterSelected>() },
+			{ LIVEAPI_ANY_MATCHSTATEEND, get_full_name<api::MatchStateEnd>() },
+			{ LIVEAPI_ANY_RINGSTARTCLOSING, get_full_name<api::RingStartClosing>() },
+			{ LIVEAPI_ANY_RINGFINISHEDCLOSING, get_full_name<api::RingFinishedClosing>() },
+			{ LIVEAPI_ANY_PLAYERCONNECTED, get_full_name<api::PlayerConnected>() },
+			{ LIVEAPI_ANY_PLAYERDISCONNECTED, get_full_name<api::PlayerDisconnected>() },
+			{ LIVEAPI_ANY_PLAYERUPGRADETIERCHANGED, get_full_name<api::PlayerUpgradeTierChanged>() },
+			{ LIVEAPI_ANY_LEGENDUPGRADESELECTED, get_full_name<api::LegendUpgradeSelected>() },
+			{ LIVEAPI_ANY_PLAYERSTATCHANGED, get_full_name<api::PlayerStatChanged>() },
+			{ LIVEAPI_ANY_PLAYERDAMAGED, get_full_name<api::PlayerDamaged>() },
+			{ LIVEAPI_ANY_PLAYERKILLED, get_full_name<api::PlayerKilled>() },
+			{ LIVEAPI_ANY_PLAYERDOWNED, get_full_name<api::PlayerDowned>() },
+			{ LIVEAPI_ANY_PLAYERASSIST, get_full_name<api::PlayerAssist>() },
+			{ LIVEAPI_ANY_SQUADELIMINATED, get_full_name<api::SquadEliminated>() },
+			{ LIVEAPI_ANY_REVENANTFORGEDSHADOWDAMAGED, get_full_name<api::RevenantForgedShadowDamaged>() },
+			{ LIVEAPI_ANY_GIBRALTARSHIELDABSORBED, get_full_name<api::GibraltarShieldAbsorbed>() },
+			{ LIVEAPI_ANY_PLAYERRESPAWNTEAM, get_full_name<api::PlayerRespawnTeam>() },
+			{ LIVEAPI_ANY_RESPAWNFROMDEATHBOX, get_full_name<api::RespawnFromDeathbox>() },
+			{ LIVEAPI_ANY_PLAYERREVIVE, get_full_name<api::PlayerRevive>() },
+			{ LIVEAPI_ANY_ARENASITEMSELECTED, get_full_name<api::ArenasItemSelected>() },
+			{ LIVEAPI_ANY_ARENASITEMDESELECTED, get_full_name<api::ArenasItemDeselected>() },
+			{ LIVEAPI_ANY_INVENTORYPICKUP, get_full_name<api::InventoryPickUp>() },
+			{ LIVEAPI_ANY_INVENTORYDROP, get_full_name<api::InventoryDrop>() },
+			{ LIVEAPI_ANY_INVENTORYUSE, get_full_name<api::InventoryUse>() },
+			{ LIVEAPI_ANY_BANNERCOLLECTED, get_full_name<api::BannerCollected>() },
+			{ LIVEAPI_ANY_PLAYERABILITYUSED, get_full_name<api::PlayerAbilityUsed>() },
+			{ LIVEAPI_ANY_PLAYERULTIMATECHARGED, get_full_name<api::PlayerUltimateCharged>() },
+			{ LIVEAPI_ANY_ZIPLINEUSED, get_full_name<api::ZiplineUsed>() },
+			{ LIVEAPI_ANY_GRENADETHROWN, get_full_name<api::GrenadeThrown>() },
+			{ LIVEAPI_ANY_BLACKMARKETACTION, get_full_name<api::BlackMarketAction>() },
+			{ LIVEAPI_ANY_WRAITHPORTAL, get_full_name<api::WraithPortal>() },
+			{ LIVEAPI_ANY_WARPGATEUSED, get_full_name<api::WarpGateUsed>() },
+			{ LIVEAPI_ANY_AMMOUSED, get_full_name<api::AmmoUsed>() },
+			{ LIVEAPI_ANY_WEAPONSWITCHED, get_full_name<api::WeaponSwitched>() },
+			{ LIVEAPI_ANY_CAREPACKAGELAUNCHED, get_full_name<api::CarePackageLaunched>() },
+			{ LIVEAPI_ANY_CAREPACKAGELANDED, get_full_name<api::CarePackageLanded>() },
+			{ LIVEAPI_ANY_CAREPACKAGEOPENED, get_full_name<api::CarePackageOpened>() },
+		};
+
+		for (const auto& [type, name] : types)
+		{
+			liveapi_any_table_.try_emplace(get_type_hash(name), liveapi_any_entry{ type, name, 0 });
+		}
+	}
+
+	void core_thread::init_liveapi_any_ignore(const std::vector<std::string>& _names)
+	{
+		const std::string prefix = "rtech.liveapi.";
+		for (const auto& name : _names)
+		{
+			// rtech.liveapi.は省略可能
+			auto full = name.starts_with(prefix) ? name : prefix + name;
+			auto it = liveapi_any_table_.find(get_type_hash(full));
+			if (it == liveapi_any_table_.end() || it->second.name != full)
+			{
+				log(LOG_CORE, std::format(L"Error: unknown LiveAPI event in ignore list. ({})", s_to_ws(name)));
+				continue;
+			}
+
+			// 応答系は無視しない
+			auto type = it->second.type;
+			if (type == LIVEAPI_ANY_RESPONSE || type == LIVEAPI_ANY_REQUESTSTATUS)
+			{
+				log(LOG_CORE, std::format(L"Error: LiveAPI event cannot be ignored. ({})", s_to_ws(name)));
+				continue;
+			}
+			liveapi_any_ignore_.set(type);
+			log(LOG_CORE, std::format(L"Info: LiveAPI event ignored. ({})", s_to_ws(full)));
+		}
+	}
+
+	uint8_t core_thread::get_liveapi_any_type(const liveapi_wire_any& _any)
+	{
+		// type.googleapis.com/rtech.liveapi.XXX の最後の部分で判定
+		auto url = _any.type_url();
+		auto pos = url.rfind('/');
+		auto name = pos == std::string_view::npos ? url : url.substr(pos + 1);
+
+		auto it = liveapi_any_table_.find(get_type_hash(name));
+		if (it != liveapi_any_table_.end() && it->second.name == name)
+		{
+			it->second.count++;
+			return it->second.type;
+		}
+		liveapi_any_unknown_count_++;
+		return LIVEAPI_ANY_UNKNOWN;
+	}
+
+	void core_thread::log_liveapi_any_stats()
+	{
+		// 種別順に並べる
+		std::vector<const liveapi_any_entry*> entries;
+		for (const auto& [hash, entry] : liveapi_any_table_)
+		{
+			if (entry.count > 0) entries.push_back(&entry);
+		}
+		std::sort(entries.begin(), entries.end(), [](const auto* _a, const auto* _b) { return _a->type < _b->type; });
+
+		for (const auto entry : entries)
+		{
+			auto ignored = liveapi_any_ignore_.test(entry->type) ? L" (ignored)" : L"";
+			log(LOG_CORE, std::format(L"Info: LiveAPI event count {} = {}{}", s_to_ws(entry->name), entry->count, ignored));
+		}
+		if (liveapi_any_unknown_count_ > 0)
+		{
+			log(LOG_CORE, std::format(L"Info: LiveAPI event count unknown = {}", liveapi_any_unknown_count_));
+		}
+
+		// デコード時のヒープ確保回数
+		if (liveapi_event_count_ > 0)
+		{
+			double per_event = static_cast<double>(arena_block_alloc_count) / liveapi_event_count_;
+			log(LOG_CORE, std::format(L"Info: LiveAPI decode events = {}, allocations = {} ({:.4f}/event)", liveapi_event_count_, arena_block_alloc_count, per_event));
+			log(LOG_CORE, std::format(L"Info: LiveAPI wire decode = {}, fallback = {}", liveapi_wire_count_, liveapi_wire_fallback_count_));
+		}
+
+		if (liveapi_coalesced_count_ > 0)
+		{
+			log(LOG_CORE, std::format(L"Info: LiveAPI request coalesced = {}", liveapi_coalesced_count_));
+		}
+	}
+
 	//---------------------------------------------------------------------------------
 	// PROC LIVEAPI ANY
 	//---------------------------------------------------------------------------------
-	void core_thread::proc_liveapi_any(const google::protobuf::Any& _any)
+	void core_thread::proc_liveapi_any(const liveapi_wire_any& _any)
 	{
 		namespace api = rtech::liveapi;
-		if (_any.Is<api::Response>())
+		auto type = get_liveapi_any_type(_any);
+
+		// 無視リストのイベントは展開しない (filedumpには記録される)
+		if (type < liveapi_any_ignore_.size() && liveapi_any_ignore_.test(type)) return;
+
+		switch (type)
+		{
+		case LIVEAPI_ANY_RESPONSE:
 		{
-			api::Response p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::Response>();
+			if (!parse_liveapi_any(p, _any)) return;
 
-			// 溜まってるメッセージを確認
-			liveapi_available_ = true;
-			liveapi_lastresponse_ = get_millis();
-			sendto_liveapi_queuecheck();
-			
 			log(LOG_CORE, std::format(L"Info: Response received. success = {}", p.success() ? 1 : 0));
-			if (!p.has_result()) return;
-			proc_liveapi_any(p.result());
+			const bool success = p.success();
+			if (p.has_result())
+			{
+				proc_liveapi_any({ p.result().type_url(), p.result().value() });
+			}
+
+			// 待っていた要求の完了 (結果を反映してから通知し、溜まってる要求があればすぐ送る)
+			liveapi_responded(success);
+			break;
 		}
-		else if (_any.Is<api::RequestStatus>())
+		case LIVEAPI_ANY_REQUESTSTATUS:
 		{
-			api::RequestStatus p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::RequestStatus>();
+			if (!parse_liveapi_any(p, _any)) return;
 			auto wstatus = s_to_ws(p.status());
 			log(LOG_CORE, std::format(L"Info: RequestStatus received. [{}]", wstatus));
+			break;
 		}
-		else if (_any.Is<api::Init>())
+		case LIVEAPI_ANY_INIT:
 		{
 			log(LOG_CORE, L"Info: Init received.");
+			break;
 		}
-		else if (_any.Is<api::CustomMatch_LobbyPlayers>())
+		case LIVEAPI_ANY_CUSTOMMATCH_LOBBYPLAYERS:
 		{
-			api::CustomMatch_LobbyPlayers p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::CustomMatch_LobbyPlayers>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: CustomMatch_LobbyPlayers received.");
 
@@ -1522,6 +2218,8 @@ namespace app {
 
 			send_webapi_lobbytoken(p.playertoken());
 
+			lobby_teams_.clear();
+
 			for (int i = 0; i < p.players_size(); ++i)
 			{
 				auto name = p.players(i).name();
@@ -1538,14 +2236,16 @@ namespace app {
 				auto spawnpoint_i32 = p.teams(i).spawnpoint();
 				uint8_t spawnpoint = spawnpoint_i32 < 0 ? 0 : spawnpoint_i32 & 0xff;
 				send_webapi_lobbyteam(teamid, name, spawnpoint);
+				lobby_teams_[teamid & 0xff] = { name, spawnpoint };
 			}
 
 			send_webapi_lobbyenum_end();
+			break;
 		}
-		else if (_any.Is<api::CustomMatch_SetSettings>())
+		case LIVEAPI_ANY_CUSTOMMATCH_SETSETTINGS:
 		{
-			api::CustomMatch_SetSettings p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::CustomMatch_SetSettings>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: CustomMatch_SetSettings received.");
 
@@ -1556,28 +2256,34 @@ namespace app {
 			auto aimassist = p.aimassist();
 			auto anonmode = p.anonmode();
 			send_webapi_custommatch_settings(playlistname, adminchat, teamrename, selfassign, aimassist, anonmode);
+			break;
 		}
-		else if (_any.Is<api::CustomMatch_LegendBanStatus>())
+		case LIVEAPI_ANY_CUSTOMMATCH_LEGENDBANSTATUS:
 		{
-			api::CustomMatch_LegendBanStatus p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::CustomMatch_LegendBanStatus>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: CustomMatch_LegendBanStatus received.");
 
 			send_webapi_legendbanenum_start();
+			lobby_legendbans_.clear();
 			for (int i = 0; i < p.legends_size(); ++i)
 			{
 				const auto& name = p.legends(i).name();
 				const auto& reference = p.legends(i).reference();
 				const auto banned = p.legends(i).banned();
 				send_webapi_legendbanstatus(name, reference, banned);
+				if (banned) lobby_legendbans_.push_back(reference);
 			}
 			send_webapi_legendbanenum_end();
+			std::sort(lobby_legendbans_.begin(), lobby_legendbans_.end());
+			lobby_legendbans_known_ = true;
+			break;
 		}
-		else if (_any.Is<api::ObserverSwitched>())
+		case LIVEAPI_ANY_OBSERVERSWITCHED:
 		{
-			api::ObserverSwitched p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::ObserverSwitched>();
+			if (!parse_liveapi_any(p, _any)) return;
 			
 			log(LOG_CORE, L"Info: ObserverSwitched received.");
 			if (p.has_target() && p.has_observer())
@@ -1602,11 +2308,12 @@ namespace app {
 
 				send_webapi_observerswitched(INVALID_SOCKET, oteamid, osquadindex, tteamid, tsquadindex, observer.nucleushash() == observer_hash_);
 			}
+			break;
 		}
-		else if (_any.Is<api::MatchSetup>())
+		case LIVEAPI_ANY_MATCHSETUP:
 		{
-			api::MatchSetup p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::MatchSetup>();
+			if (!parse_liveapi_any(p, _any)) return;
 			
 			log(LOG_CORE, L"Info: MatchSetup received.");
 
@@ -1695,10 +2402,10 @@ namespace app {
 				}
 
 				// 既に送信しているユーザー分のアイテムを更新
-				for (size_t teamid = 0; teamid < game_.teams.size(); ++teamid)
+				for (size_t teamid = 0; teamid < game_.team_count; ++teamid)
 				{
 					const auto& team = game_.teams.at(teamid);
-					for (size_t squadindex = 0; squadindex < team.players.size(); ++squadindex)
+					for (size_t squadindex = 0; squadindex < team.size; ++squadindex)
 					{
 						proc_player_reset_items_from_loadout(teamid, squadindex);
 					}
@@ -1711,11 +2418,12 @@ namespace app {
 			send_webapi_matchsetup_aimassiston(INVALID_SOCKET, game_.aimassiston);
 			send_webapi_matchsetup_anonymousmode(INVALID_SOCKET, game_.anonymousmode);
 			send_webapi_matchsetup_serverid(INVALID_SOCKET, game_.serverid);
+			break;
 		}
-		else if (_any.Is<api::GameStateChanged>())
+		case LIVEAPI_ANY_GAMESTATECHANGED:
 		{
-			api::GameStateChanged p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::GameStateChanged>();
+			if (!parse_liveapi_any(p, _any)) return;
 			
 			log(LOG_CORE, L"Info: GameStateChanged received.");
 			game_.gamestate = p.state();
@@ -1744,11 +2452,12 @@ namespace app {
 					filedump_.reset();
 				}
 			}
+			break;
 		}
-		else if (_any.Is<api::CharacterSelected>())
+		case LIVEAPI_ANY_CHARACTERSELECTED:
 		{
-			api::CharacterSelected p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::CharacterSelected>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: CharacterSelected received.");
 			if (!p.has_player()) return;
@@ -1757,11 +2466,12 @@ namespace app {
 			uint8_t squadindex = get_squadindex(p.player());
 
 			proc_characterselected(teamid, squadindex);
+			break;
 		}
-		else if (_any.Is<api::MatchStateEnd>())
+		case LIVEAPI_ANY_MATCHSTATEEND:
 		{
-			api::MatchStateEnd p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::MatchStateEnd>();
+			if (!parse_liveapi_any(p, _any)) return;
 			
 			log(LOG_CORE, L"Info: MatchStateEnd received.");
 			game_.matchendreason = p.state();
@@ -1777,11 +2487,12 @@ namespace app {
 					send_webapi_matchstateend_winnerdetermined(INVALID_SOCKET, teamid);
 				}
 			}
+			break;
 		}
-		else if (_any.Is<api::RingStartClosing>())
+		case LIVEAPI_ANY_RINGSTARTCLOSING:
 		{
-			api::RingStartClosing p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::RingStartClosing>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: RingStartClosing received.");
 			auto timestamp = get_millis();
@@ -1801,11 +2512,12 @@ namespace app {
 				duration
 			});
 			send_webapi_ringinfo(INVALID_SOCKET, timestamp, stage, x, y, current, end, duration);
+			break;
 		}
-		else if (_any.Is<api::RingFinishedClosing>())
+		case LIVEAPI_ANY_RINGFINISHEDCLOSING:
 		{
-			api::RingFinishedClosing p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::RingFinishedClosing>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: RingFinishedClosing received.");
 			auto timestamp = get_millis();
@@ -1824,11 +2536,12 @@ namespace app {
 				duration
 			});
 			send_webapi_ringinfo(INVALID_SOCKET, timestamp, stage, x, y, current, current, duration);
+			break;
 		}
-		else if (_any.Is<api::PlayerConnected>())
+		case LIVEAPI_ANY_PLAYERCONNECTED:
 		{
-			api::PlayerConnected p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::PlayerConnected>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: PlayerConnected received.");
 			if (p.has_player())
@@ -1841,11 +2554,12 @@ namespace app {
 
 				proc_connected(teamid, squadindex);
 			}
+			break;
 		}
-		else if (_any.Is<api::PlayerDisconnected>())
+		case LIVEAPI_ANY_PLAYERDISCONNECTED:
 		{
-			api::PlayerDisconnected p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::PlayerDisconnected>();
+			if (!parse_liveapi_any(p, _any)) return;
 			
 			log(LOG_CORE, L"Info: PlayerDisconnected received.");
 			if (p.has_player())
@@ -1856,11 +2570,12 @@ namespace app {
 
 				proc_disconnected(teamid, squadindex, p.canreconnect(), p.isalive());
 			}
+			break;
 		}
-		else if (_any.Is<api::PlayerUpgradeTierChanged>())
+		case LIVEAPI_ANY_PLAYERUPGRADETIERCHANGED:
 		{
-			api::PlayerUpgradeTierChanged p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::PlayerUpgradeTierChanged>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: PlayerUpgradeTierChanged received.");
 			if (p.has_player())
@@ -1871,11 +2586,12 @@ namespace app {
 
 				proc_upgradetierchanged(teamid, squadindex, p.level());
 			}
+			break;
 		}
-		else if (_any.Is<api::LegendUpgradeSelected>())
+		case LIVEAPI_ANY_LEGENDUPGRADESELECTED:
 		{
-			api::LegendUpgradeSelected p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::LegendUpgradeSelected>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: LegendUpgradeSelected received.");
 			if (p.has_player())
@@ -1886,63 +2602,65 @@ namespace app {
 
 				proc_upgradeselected(teamid, squadindex, p.level(), p.upgradename(), p.upgradedesc());
 			}
+			break;
 		}
-		else if (_any.Is<api::PlayerStatChanged>())
-		{
-			api::PlayerStatChanged p;
-			if (!_any.UnpackTo(&p)) return;
-			log(LOG_CORE, L"Info: PlayerStatChanged received.");
-			if (p.has_player())
-			{
-				proc_player(p.player());
+		case LIVEAPI_ANY_PLAYERSTATCHANGED:
+		{
+			proc_liveapi_wire<liveapi_wire_player_stat_changed, api::PlayerStatChanged>(_any, [&](const auto& p) {
+				log(LOG_CORE, L"Info: PlayerStatChanged received.");
+				if (p.has_player())
+				{
+					proc_player(p.player());
 
-				uint8_t teamid = p.player().teamid();
-				uint8_t squadindex = get_squadindex(p.player());
+					uint8_t teamid = p.player().teamid();
+					uint8_t squadindex = get_squadindex(p.player());
 
-				proc_player_stats(teamid, squadindex, p.statname(), p.newvalue());
-			}
+					proc_player_stats(teamid, squadindex, p.statname(), p.newvalue());
+				}
+				});
+			break;
 		}
-		else if (_any.Is<api::PlayerDamaged>())
+		case LIVEAPI_ANY_PLAYERDAMAGED:
 		{
-			api::PlayerDamaged p;
-			if (!_any.UnpackTo(&p)) return;
-			
-			log(LOG_CORE, L"Info: PlayerDamaged received.");
-			if (p.has_attacker())
-			{
-				proc_player(p.attacker());
-				uint8_t teamid = p.attacker().teamid();
-				uint8_t squadindex = get_squadindex(p.attacker());
-				if (teamid >= 2)
+			proc_liveapi_wire<liveapi_wire_player_damaged, api::PlayerDamaged>(_any, [&](const auto& p) {
+				log(LOG_CORE, L"Info: PlayerDamaged received.");
+				if (p.has_attacker())
 				{
-					if (p.has_victim())
+					proc_player(p.attacker());
+					uint8_t teamid = p.attacker().teamid();
+					uint8_t squadindex = get_squadindex(p.attacker());
+					if (teamid >= 2)
 					{
-						const uint8_t victim_teamid = p.victim().teamid();
-						const uint8_t victim_squadindex = get_squadindex(p.victim());
-						if (teamid != victim_teamid || squadindex != victim_squadindex)
+						if (p.has_victim())
 						{
-							// 自分自身からのダメージを除外
-							proc_damage_dealt(teamid, squadindex, p.damageinflicted());
-							send_webapi_extended_damage(teamid, squadindex, victim_teamid, victim_squadindex, p.weapon(), p.damageinflicted());
+							const uint8_t victim_teamid = p.victim().teamid();
+							const uint8_t victim_squadindex = get_squadindex(p.victim());
+							if (teamid != victim_teamid || squadindex != victim_squadindex)
+							{
+								// 自分自身からのダメージを除外
+								proc_damage_dealt(teamid, squadindex, p.damageinflicted());
+								send_webapi_extended_damage(teamid, squadindex, victim_teamid, victim_squadindex, p.weapon(), p.damageinflicted());
+							}
 						}
 					}
 				}
-			}
-			if (p.has_victim())
-			{
-				proc_player(p.victim());
-				uint8_t teamid = p.victim().teamid();
-				uint8_t squadindex = get_squadindex(p.victim());
-				if (teamid >= 2)
+				if (p.has_victim())
 				{
-					proc_damage_taken(teamid, squadindex, p.damageinflicted());
+					proc_player(p.victim());
+					uint8_t teamid = p.victim().teamid();
+					uint8_t squadindex = get_squadindex(p.victim());
+					if (teamid >= 2)
+					{
+						proc_damage_taken(teamid, squadindex, p.damageinflicted());
+					}
 				}
-			}
+				});
+			break;
 		}
-		else if (_any.Is<api::PlayerKilled>())
+		case LIVEAPI_ANY_PLAYERKILLED:
 		{
-			api::PlayerKilled p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::PlayerKilled>();
+			if (!parse_liveapi_any(p, _any)) return;
 			
 			log(LOG_CORE, L"Info: PlayerKilled received.");
 			if (p.has_attacker())
@@ -1958,7 +2676,7 @@ namespace app {
 				if (teamid >= 2)
 				{
 					proc_killed(teamid, squadindex);
-					auto killed = game_.teams.at(teamid).players.at(squadindex).killed;
+					auto killed = game_.get_player(teamid, squadindex).killed;
 					send_webapi_player_killed_count(INVALID_SOCKET, teamid, squadindex, killed);
 				}
 			}
@@ -1974,11 +2692,12 @@ namespace app {
 					send_webapi_extended_kill(attacker_teamid, attacker_squadindex, victim_teamid, victim_squadindex, p.weapon());
 				}
 			}
+			break;
 		}
-		else if (_any.Is<api::PlayerDowned>())
+		case LIVEAPI_ANY_PLAYERDOWNED:
 		{
-			api::PlayerDowned p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::PlayerDowned>();
+			if (!parse_liveapi_any(p, _any)) return;
 			
 			log(LOG_CORE, L"Info: PlayerDowned received.");
 
@@ -2010,11 +2729,12 @@ namespace app {
 					send_webapi_extended_knockdown(attacker_teamid, attacker_squadindex, victim_teamid, victim_squadindex, p.weapon());
 				}
 			}
+			break;
 		}
-		else if (_any.Is<api::PlayerAssist>())
+		case LIVEAPI_ANY_PLAYERASSIST:
 		{
-			api::PlayerAssist p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::PlayerAssist>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: PlayerAssist received.");
 			if (p.has_assistant())
@@ -2026,11 +2746,12 @@ namespace app {
 			{
 				proc_player(p.victim());
 			}
+			break;
 		}
-		else if (_any.Is<api::SquadEliminated>())
+		case LIVEAPI_ANY_SQUADELIMINATED:
 		{
-			api::SquadEliminated p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::SquadEliminated>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: SquadEliminated received.");
 			if (p.players_size() == 0) return;
@@ -2046,12 +2767,13 @@ namespace app {
 			{
 				proc_squad_eliminated(teamid);
 			}
+			break;
 		}
-		else if (_any.Is<api::RevenantForgedShadowDamaged>())
+		case LIVEAPI_ANY_REVENANTFORGEDSHADOWDAMAGED:
 		{
 			// 通常のダメージと同様に扱う
-			api::RevenantForgedShadowDamaged p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::RevenantForgedShadowDamaged>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: RevenantForgedShadowDamaged received.");
 			if (p.has_attacker())
@@ -2085,12 +2807,13 @@ namespace app {
 					proc_damage_taken(teamid, squadindex, p.damageinflicted());
 				}
 			}
+			break;
 		}
-		else if (_any.Is<api::GibraltarShieldAbsorbed>())
+		case LIVEAPI_ANY_GIBRALTARSHIELDABSORBED:
 		{
 			// 通常のダメージと同様に扱う
-			api::GibraltarShieldAbsorbed p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::GibraltarShieldAbsorbed>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: GibraltarShieldAbsorbed received.");
 			if (p.has_attacker())
@@ -2124,11 +2847,12 @@ namespace app {
 					proc_damage_taken(teamid, squadindex, p.damageinflicted());
 				}
 			}
+			break;
 		}
-		else if (_any.Is<api::PlayerRespawnTeam>())
+		case LIVEAPI_ANY_PLAYERRESPAWNTEAM:
 		{
-			api::PlayerRespawnTeam p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::PlayerRespawnTeam>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: PlayerRespawnTeam received.");
 			if (!p.has_player()) return;
@@ -2144,7 +2868,7 @@ namespace app {
 					const auto& teammate = p.respawnedteammates().at(i);
 					proc_player(teammate);
 					uint8_t squadindex = get_squadindex(teammate);
-					const auto& target = game_.teams.at(teamid).players.at(squadindex);
+					const auto& target = game_.get_player(teamid, squadindex);
 					if (target.state != WEBAPI_PLAYER_STATE_ALIVE)
 					{
 						targets.push_back(squadindex);
@@ -2155,9 +2879,9 @@ namespace app {
 			}
 			else
 			{
-				for (uint8_t squadindex = 0; squadindex < game_.teams.at(teamid).players.size(); ++squadindex)
+				for (uint8_t squadindex = 0; squadindex < game_.teams.at(teamid).size; ++squadindex)
 				{
-					auto& target = game_.teams.at(teamid).players.at(squadindex);
+					auto& target = game_.get_player(teamid, squadindex);
 					if (target.state == WEBAPI_PLAYER_STATE_COLLECTED)
 					{
 						targets.push_back(squadindex);
@@ -2176,11 +2900,12 @@ namespace app {
 			{
 				send_webapi_extended_respawn(teamid, player_squadindex, respawned_squadindex);
 			}
+			break;
 		}
-		else if (_any.Is<api::RespawnFromDeathbox>())
+		case LIVEAPI_ANY_RESPAWNFROMDEATHBOX:
 		{
-			api::RespawnFromDeathbox p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::RespawnFromDeathbox>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: RespawnFromDeathbox received.");
 			if (!p.has_player()) return;
@@ -2197,7 +2922,7 @@ namespace app {
 					const auto& teammate = p.respawnedteammates().at(i);
 					proc_player(teammate);
 					uint8_t squadindex = get_squadindex(teammate);
-					const auto& target = game_.teams.at(teamid).players.at(squadindex);
+					const auto& target = game_.get_player(teamid, squadindex);
 					if (target.state != WEBAPI_PLAYER_STATE_ALIVE)
 					{
 						targets.push_back(squadindex);
@@ -2229,11 +2954,12 @@ namespace app {
 			{
 				send_webapi_extended_respawn(teamid, player_squadindex, respawned_squadindex);
 			}
+			break;
 		}
-		else if (_any.Is<api::PlayerRevive>())
+		case LIVEAPI_ANY_PLAYERREVIVE:
 		{
-			api::PlayerRevive p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::PlayerRevive>();
+			if (!parse_liveapi_any(p, _any)) return;
 			
 			log(LOG_CORE, L"Info: PlayerRevive received.");
 
@@ -2249,81 +2975,84 @@ namespace app {
 			uint8_t revived_squadindex = get_squadindex(p.revived());
 			proc_revive(teamid, revived_squadindex);
 			send_webapi_extended_revive(teamid, player_squadindex, revived_squadindex);
+			break;
 		}
-		else if (_any.Is<api::ArenasItemSelected>())
+		case LIVEAPI_ANY_ARENASITEMSELECTED:
 		{
 
+			break;
 		}
-		else if (_any.Is<api::ArenasItemDeselected>())
+		case LIVEAPI_ANY_ARENASITEMDESELECTED:
 		{
 
+			break;
 		}
-		else if (_any.Is<api::InventoryPickUp>())
+		case LIVEAPI_ANY_INVENTORYPICKUP:
 		{
-			api::InventoryPickUp p;
-			if (!_any.UnpackTo(&p)) return;
-
-			log(LOG_CORE, L"Info: InventoryPickUp received.");
-			if (!p.has_player()) return;
-			proc_player(p.player());
+			proc_liveapi_wire<liveapi_wire_inventory, api::InventoryPickUp>(_any, [&](const auto& p) {
+				log(LOG_CORE, L"Info: InventoryPickUp received.");
+				if (!p.has_player()) return;
+				proc_player(p.player());
 
-			uint8_t item = string_to_itemid(p.item());
-			if (item == 0) return;
+				uint8_t item = string_to_itemid(p.item());
+				if (item == 0) return;
 
-			uint8_t teamid = p.player().teamid();
-			uint8_t squadindex = get_squadindex(p.player());
-			proc_item(teamid, squadindex, item, p.quantity());
+				uint8_t teamid = p.player().teamid();
+				uint8_t squadindex = get_squadindex(p.player());
+				proc_item(teamid, squadindex, item, p.quantity());
+				});
+			break;
 		}
-		else if (_any.Is<api::InventoryDrop>())
+		case LIVEAPI_ANY_INVENTORYDROP:
 		{
-			api::InventoryDrop p;
-			if (!_any.UnpackTo(&p)) return;
-
-			log(LOG_CORE, L"Info: InventoryDrop received.");
-			if (!p.has_player()) return;
-			proc_player(p.player());
+			proc_liveapi_wire<liveapi_wire_inventory, api::InventoryDrop>(_any, [&](const auto& p) {
+				log(LOG_CORE, L"Info: InventoryDrop received.");
+				if (!p.has_player()) return;
+				proc_player(p.player());
 
-			uint8_t item = string_to_itemid(p.item());
-			if (item == 0) return;
+				uint8_t item = string_to_itemid(p.item());
+				if (item == 0) return;
 			
-			uint8_t teamid = p.player().teamid();
-			uint8_t squadindex = get_squadindex(p.player());
-			proc_item(teamid, squadindex, item, -p.quantity());
+				uint8_t teamid = p.player().teamid();
+				uint8_t squadindex = get_squadindex(p.player());
+				proc_item(teamid, squadindex, item, -p.quantity());
+				});
+			break;
 		}
-		else if (_any.Is<api::InventoryUse>())
+		case LIVEAPI_ANY_INVENTORYUSE:
 		{
-			api::InventoryUse p;
-			if (!_any.UnpackTo(&p)) return;
-			
-			log(LOG_CORE, L"Info: InventoryUse received.");
-			if (!p.has_player()) return;
-			proc_player(p.player());
+			proc_liveapi_wire<liveapi_wire_inventory, api::InventoryUse>(_any, [&](const auto& p) {
+				log(LOG_CORE, L"Info: InventoryUse received.");
+				if (!p.has_player()) return;
+				proc_player(p.player());
 
-			uint8_t item = string_to_itemid(p.item());
-			if (item == 0) return;
+				uint8_t item = string_to_itemid(p.item());
+				if (item == 0) return;
 			
-			uint8_t teamid = p.player().teamid();
-			uint8_t squadindex = get_squadindex(p.player());
+				uint8_t teamid = p.player().teamid();
+				uint8_t squadindex = get_squadindex(p.player());
 
-			bool skip = false;
-			if (item == WEBAPI_ITEM_SHIELDBATTERY)
-			{
-				// バッテリー使用の際に例外処理
-				auto& player = game_.teams.at(teamid).players.at(squadindex);
-				if (player.items.amp == WEBAPI_ITEM_AMP_TYPE_BOTTOMLESS_BATTERIES)
+				bool skip = false;
+				if (item == WEBAPI_ITEM_SHIELDBATTERY)
 				{
-					if (player.items.shield_battery >= 2) // 2個以上所有
+					// バッテリー使用の際に例外処理
+					auto& player = game_.get_player(teamid, squadindex);
+					if (player.items.amp == WEBAPI_ITEM_AMP_TYPE_BOTTOMLESS_BATTERIES)
 					{
-						skip = true;
+						if (player.items.shield_battery >= 2) // 2個以上所有
+						{
+							skip = true;
+						}
 					}
 				}
-			}
-			if (!skip) proc_item(teamid, squadindex, item, -p.quantity());
+				if (!skip) proc_item(teamid, squadindex, item, -p.quantity());
+				});
+			break;
 		}
-		else if (_any.Is<api::BannerCollected>())
+		case LIVEAPI_ANY_BANNERCOLLECTED:
 		{
-			api::BannerCollected p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::BannerCollected>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: BannerCollected received.");
 			if (!p.has_player()) return;
@@ -2339,11 +3068,12 @@ namespace app {
 
 			proc_banner_collected(teamid, collected_squadindex);
 			send_webapi_extended_collected(teamid, player_squadindex, collected_squadindex);
+			break;
 		}
-		else if (_any.Is<api::PlayerAbilityUsed>())
+		case LIVEAPI_ANY_PLAYERABILITYUSED:
 		{
-			api::PlayerAbilityUsed p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::PlayerAbilityUsed>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: PlayerAbilityUsed received.");
 			if (!p.has_player()) return;
@@ -2357,11 +3087,12 @@ namespace app {
 			{
 				sendto_webapi(std::move(sdata.buffer_));
 			}
+			break;
 		}
-		else if (_any.Is<api::PlayerUltimateCharged>())
+		case LIVEAPI_ANY_PLAYERULTIMATECHARGED:
 		{
-			api::PlayerUltimateCharged p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::PlayerUltimateCharged>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: PlayerUltimateCharged received.");
 			if (!p.has_player()) return;
@@ -2375,20 +3106,22 @@ namespace app {
 			{
 				sendto_webapi(std::move(sdata.buffer_));
 			}
-			}
-		else if (_any.Is<api::ZiplineUsed>())
+			break;
+		}
+		case LIVEAPI_ANY_ZIPLINEUSED:
 		{
-			api::ZiplineUsed p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::ZiplineUsed>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: ZiplineUsed received.");
 			if (!p.has_player()) return;
 			proc_player(p.player());
+			break;
 		}
-		else if (_any.Is<api::GrenadeThrown>())
+		case LIVEAPI_ANY_GRENADETHROWN:
 		{
-			api::GrenadeThrown p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::GrenadeThrown>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: GrenadeThrown received.");
 			if (!p.has_player()) return;
@@ -2401,75 +3134,81 @@ namespace app {
 				uint8_t squadindex = get_squadindex(p.player());
 				proc_item(teamid, squadindex, grenade, -1);
 			}
+			break;
 		}
-		else if (_any.Is<api::BlackMarketAction>())
+		case LIVEAPI_ANY_BLACKMARKETACTION:
 		{
-			api::BlackMarketAction p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::BlackMarketAction>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: BlackMarketAction received.");
 			if (!p.has_player()) return;
 			proc_player(p.player());
+			break;
 		}
-		else if (_any.Is<api::WraithPortal>())
+		case LIVEAPI_ANY_WRAITHPORTAL:
 		{
-			api::WraithPortal p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::WraithPortal>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: WraithPortal received.");
 			if (!p.has_player()) return;
 			proc_player(p.player());
+			break;
 		}
-		else if (_any.Is<api::WarpGateUsed>())
+		case LIVEAPI_ANY_WARPGATEUSED:
 		{
-			api::WarpGateUsed p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::WarpGateUsed>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: WarpGateUsed received.");
 			if (!p.has_player()) return;
 			proc_player(p.player());
+			break;
 		}
-		else if (_any.Is<api::AmmoUsed>())
+		case LIVEAPI_ANY_AMMOUSED:
 		{
-			api::AmmoUsed p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::AmmoUsed>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: AmmoUsed received.");
 			if (!p.has_player()) return;
 			proc_player(p.player());
+			break;
 		}
-		else if (_any.Is<api::WeaponSwitched>())
+		case LIVEAPI_ANY_WEAPONSWITCHED:
 		{
-			api::WeaponSwitched p;
-			if (!_any.UnpackTo(&p)) return;
-			
-			log(LOG_CORE, L"Info: WeaponSwitched received.");
-			if (!p.has_player()) return;
-			proc_player(p.player());
-
-			{
-				uint8_t teamid = p.player().teamid();
-				uint8_t squadindex = get_squadindex(p.player());
-				auto& player = game_.teams.at(teamid).players.at(squadindex);
+			proc_liveapi_wire<liveapi_wire_weapon_switched, api::WeaponSwitched>(_any, [&](const auto& p) {
+				log(LOG_CORE, L"Info: WeaponSwitched received.");
+				if (!p.has_player()) return;
+				proc_player(p.player());
 
-				// TDM/CTL/GG用処理
-				if (player.state == WEBAPI_PLAYER_STATE_KILLED && player.shield > 0 && player.shield_max > 0)
 				{
-					proc_respawn(teamid, squadindex);
-					proc_player_reset_items_from_loadout(teamid, squadindex);
-				}
+					uint8_t teamid = p.player().teamid();
+					uint8_t squadindex = get_squadindex(p.player());
+					auto& player = game_.get_player(teamid, squadindex);
 
-				if (player.weapon != p.newweapon())
-				{
-					player.weapon = p.newweapon();
-					send_webapi_player_weapon(INVALID_SOCKET, teamid, squadindex, player.weapon);
+					// TDM/CTL/GG用処理
+					uint8_t slot = game_.slot(teamid, squadindex);
+					if (player.state == WEBAPI_PLAYER_STATE_KILLED && game_.stats.shield[slot] > 0 && game_.stats.shield_max[slot] > 0)
+					{
+						proc_respawn(teamid, squadindex);
+						proc_player_reset_items_from_loadout(teamid, squadindex);
+					}
+
+					if (p.newweapon() != livedata::symbol_string(player.weapon))
+					{
+						player.weapon = livedata::intern(p.newweapon());
+						send_webapi_player_weapon(INVALID_SOCKET, teamid, squadindex, livedata::symbol_string(player.weapon));
+					}
 				}
-			}
+				});
+			break;
 		}
-		else if (_any.Is<api::CarePackageLaunched>())
+		case LIVEAPI_ANY_CAREPACKAGELAUNCHED:
 		{
-			api::CarePackageLaunched p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::CarePackageLaunched>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: CarePackageLaunched received.");
 
@@ -2485,11 +3224,12 @@ namespace app {
 				it->second.x = p.position().x();
 				it->second.y = p.position().y();
 			}
+			break;
 		}
-		else if (_any.Is<api::CarePackageLanded>())
+		case LIVEAPI_ANY_CAREPACKAGELANDED:
 		{
-			api::CarePackageLanded p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::CarePackageLanded>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: CarePackageLanded received.");
 
@@ -2501,11 +3241,12 @@ namespace app {
 				it->second.x = p.position().x();
 				it->second.y = p.position().y();
 			}
+			break;
 		}
-		else if (_any.Is<api::CarePackageOpened>())
+		case LIVEAPI_ANY_CAREPACKAGEOPENED:
 		{
-			api::CarePackageOpened p;
-			if (!_any.UnpackTo(&p)) return;
+			auto& p = create_liveapi_message<api::CarePackageOpened>();
+			if (!parse_liveapi_any(p, _any)) return;
 
 			log(LOG_CORE, L"Info: CarePackageOpened received.");
 
@@ -2521,10 +3262,13 @@ namespace app {
 				it->second.y = p.position().y();
 			}
 			it->second.player = p.player().nucleushash();
+			break;
 		}
-		else
+		default:
 		{
-			log(LOG_CORE, std::format(L"Error: unknown Any type.({})", s_to_ws(_any.type_url())));
+			log(LOG_CORE, std::format(L"Error: unknown Any type.({})", s_to_ws(std::string(_any.type_url()))));
+			break;
+		}
 		}
 	}
 
@@ -2547,9 +3291,6 @@ namespace app {
 				webapi_.get_stats();
 				http_get_.ping();
 			},
-			[&](core_message_in_queuecheck&& _m) {
-				sendto_liveapi_queuecheck();
-			},
 			[&](core_message_in_ping&& _m) {
 				liveapi_.ping();
 				webapi_.ping();
@@ -2852,7 +3593,7 @@ namespace app {
 		}
 	}
 
-	void core_thread::send_webapi_extended_damage(uint8_t _pteamid, uint8_t _psquadindex, uint8_t _vteamid, uint8_t _vsquadindex, const std::string& _weapon, uint32_t _damage)
+	void core_thread::send_webapi_extended_damage(uint8_t _pteamid, uint8_t _psquadindex, uint8_t _vteamid, uint8_t _vsquadindex, std::string_view _weapon, uint32_t _damage)
 	{
 		send_webapi_data sdata(WEBAPI_EVENT_EXTENDED);
 		if (sdata.append(WEBAPI_EXTENDED_DAMAGE) && sdata.append(_pteamid) && sdata.append(_psquadindex) && sdata.append(_vteamid) && sdata.append(_vsquadindex) && sdata.append(_weapon) && sdata.append(_damage))
@@ -2967,6 +3708,25 @@ namespace app {
 		}
 	}
 
+	void core_thread::send_webapi_lobbysetup_progress(const lobby_setup& _setup)
+	{
+		send_webapi_data sdata(WEBAPI_EVENT_LOBBYSETUP_PROGRESS);
+		if (sdata.append(_setup.sequence) && sdata.append(_setup.done) && sdata.append(_setup.failed) && sdata.append(_setup.total) && sdata.append(_setup.skipped))
+		{
+			sendto_webapi(_setup.sock, std::move(sdata.buffer_));
+		}
+	}
+
+	void core_thread::send_webapi_lobbysetup_done(const lobby_setup& _setup)
+	{
+		const uint32_t elapsed = static_cast<uint32_t>(::GetTickCount64() - _setup.start);
+		send_webapi_data sdata(WEBAPI_EVENT_LOBBYSETUP_DONE);
+		if (sdata.append(_setup.sequence) && sdata.append(_setup.done) && sdata.append(_setup.failed) && sdata.append(_setup.total) && sdata.append(_setup.skipped) && sdata.append(elapsed))
+		{
+			sendto_webapi(_setup.sock, std::move(sdata.buffer_));
+		}
+	}
+
 	void core_thread::send_webapi_clear_livedata()
 	{
 		send_webapi_data sdata(WEBAPI_EVENT_CLEAR_LIVEDATA);
@@ -3055,6 +3815,15 @@ namespace app {
 		}
 	}
 
+	void core_thread::reply_webapi_send_custommatch_setuplobby(SOCKET _sock, uint32_t _sequence)
+	{
+		send_webapi_data sdata(WEBAPI_SEND_CUSTOMMATCH_SETUPLOBBY);
+		if (sdata.append(_sequence))
+		{
+			sendto_webapi(_sock, std::move(sdata.buffer_));
+		}
+	}
+
 	void core_thread::reply_webapi_set_observer(SOCKET _sock, uint32_t _sequence, const std::string& _hash)
 	{
 		send_webapi_data sdata(WEBAPI_LOCALDATA_SET_OBSERVER);
@@ -3076,7 +3845,7 @@ namespace app {
 	void core_thread::reply_webapi_get_observers(SOCKET _sock, uint32_t _sequence, const std::string& _hash)
 	{
 		send_webapi_data sdata(WEBAPI_LOCALDATA_GET_OBSERVERS);
-		if (game_.teams.size() < 2)
+		if (game_.team_count < 2)
 		{
 			if (sdata.append(_sequence))
 			{
@@ -3087,10 +3856,12 @@ namespace app {
 		{
 			bool result = true;
 			if (!sdata.append(_sequence)) result = false;
-			for (const auto& observer : game_.teams.at(1).players)
+			const auto& observers = game_.teams.at(1);
+			for (size_t i = 0; i < observers.size; ++i)
 			{
+				const auto& observer = game_.players[observers.slots[i]];
 				if (!sdata.append(observer.id)) result = false;
-				if (!sdata.append(observer.name)) result = false;
+				if (!sdata.append(livedata::symbol_string(observer.name))) result = false;
 				if (!sdata.append(observer.id == _hash)) result = false;
 			}
 			if (result) sendto_webapi(std::move(sdata.buffer_));
@@ -3124,6 +3895,15 @@ namespace app {
 		}
 	}
 
+	void core_thread::reply_livedata_get_snapshot(SOCKET _sock, uint32_t _sequence, uint8_t _teamid, const std::vector<uint8_t>& _snapshot)
+	{
+		send_webapi_data sdata(WEBAPI_LIVEDATA_GET_SNAPSHOT);
+		if (sdata.append(_sequence) && sdata.append(_teamid) && sdata.append_binary(_snapshot))
+		{
+			sendto_webapi(_sock, std::move(sdata.buffer_));
+		}
+	}
+
 	void core_thread::reply_livedata_get_observers_camera(SOCKET _sock, uint32_t _sequence)
 	{
 		send_webapi_data sdata(WEBAPI_LIVEDATA_GET_OBSERVERS_CAMERA);
@@ -3414,6 +4194,15 @@ namespace app {
 		}
 	}
 
+	void core_thread::reply_webapi_subscribe(SOCKET _sock, uint32_t _sequence, uint32_t _topics)
+	{
+		send_webapi_data sdata(WEBAPI_SUBSCRIBE);
+		if (sdata.append(_sequence) && sdata.append(_topics))
+		{
+			sendto_webapi(_sock, std::move(sdata.buffer_));
+		}
+	}
+
 	void core_thread::send_webapi_player_id(SOCKET _sock, uint8_t _teamid, uint8_t _squadindex, const std::string& _id)
 	{
 		send_webapi_player_string(_sock, _teamid, _squadindex, WEBAPI_EVENT_PLAYER_ID, _id);
@@ -3456,13 +4245,23 @@ namespace app {
 	//---------------------------------------------------------------------------------
 	// GETTER
 	//---------------------------------------------------------------------------------
-	uint8_t core_thread::get_squadindex(const rtech::liveapi::Player& _player)
+	template <typename T>
+	uint8_t core_thread::get_squadindex(const T& _player)
 	{
-		auto teamid = _player.teamid();
+		uint8_t teamid = _player.teamid();
+		player_index_key key;
+		if (get_player_index_key(teamid, _player.nucleushash(), key))
+		{
+			auto it = player_index_.find(key);
+			if (it != player_index_.end()) return it->second;
+			return 0xff;
+		}
+
+		// 索引に載らないhashは線形探索
 		const auto& team = game_.teams.at(teamid);
-		for (size_t i = 0; i < team.players.size(); ++i)
+		for (size_t i = 0; i < team.size; ++i)
 		{
-			const auto& player = team.players.at(i);
+			const auto& player = game_.players[team.slots[i]];
 			if (player.id != "" && player.id == _player.nucleushash())
 			{
 				return (i & 0xff);
@@ -3471,34 +4270,51 @@ namespace app {
 		return 0xff;
 	}
 
+	void core_thread::set_player_index(uint8_t _teamid, uint8_t _squadindex, const std::string& _hash)
+	{
+		player_index_key key;
+		if (!get_player_index_key(_teamid, _hash, key)) return;
+		player_index_.try_emplace(key, _squadindex);
+	}
+
 	//---------------------------------------------------------------------------------
 	// PROC DETAIL
 	//---------------------------------------------------------------------------------
-	void core_thread::proc_player(const rtech::liveapi::Player& _player)
+	template <typename T>
+	void core_thread::proc_player(const T& _player)
 	{
 		bool first = false;
 
 		// チーム数修正
 		uint8_t teamid = _player.teamid();
-		if (game_.teams.size() <= teamid) game_.teams.resize(teamid + 1);
+		if (game_.team_count <= teamid) game_.team_count = teamid + 1;
 		auto& team = game_.teams.at(teamid);
+
+		// 未アサイン、Worldなどはidを持たず毎回引けないので、スロットを割り当てない
+		if (teamid == 0) return;
 		
 		// プレイヤー数修正
 		uint8_t squadindex = get_squadindex(_player);
 		if (squadindex == 0xff)
 		{
-			// indexが取得できなかった場合は追加する
-			team.players.push_back({});
-			squadindex = team.players.size() - 1;
+			// indexが取得できなかった場合は空きスロットを割り当てる
+			squadindex = game_.add_player(teamid);
+			if (squadindex == livedata::SLOT_INVALID)
+			{
+				if (!team.full_logged)
+				{
+					log(LOG_CORE, std::format(L"Error: no player slot left. (teamid={})", teamid));
+					team.full_logged = true;
+				}
+				return;
+			}
 			first = true;
 		}
-		auto& player = team.players.at(squadindex);
+		uint8_t slot = team.slots[squadindex];
+		auto& player = game_.players[slot];
+		auto& stats = game_.stats;
 
-		if (teamid == 0)
-		{
-			// 未アサイン、Worldなど
-		}
-		else if (teamid >= 1)
+		if (teamid >= 1)
 		{
 			// オブザーバー以上
 
@@ -3509,6 +4325,7 @@ namespace app {
 				{
 					// 空だった場合
 					player.id = _player.nucleushash();
+					set_player_index(teamid, squadindex, player.id);
 					send_webapi_player_id(INVALID_SOCKET, teamid, squadindex, player.id);
 
 					// オブザーバーだった場合
@@ -3523,10 +4340,10 @@ namespace app {
 			}
 
 			// 名前
-			if (_player.name() != player.name)
+			if (_player.name() != livedata::symbol_string(player.name))
 			{
-				player.name = _player.name();
-				send_webapi_player_name(INVALID_SOCKET, teamid, squadindex, player.name);
+				player.name = livedata::intern(_player.name());
+				send_webapi_player_name(INVALID_SOCKET, teamid, squadindex, livedata::symbol_string(player.name));
 			}
 		}
 		
@@ -3535,35 +4352,35 @@ namespace app {
 			// プレイヤー
 
 			// 名前
-			if (_player.name() != player.name)
+			if (_player.name() != livedata::symbol_string(player.name))
 			{
-				player.name = _player.name();
-				send_webapi_player_name(INVALID_SOCKET, teamid, squadindex, player.name);
+				player.name = livedata::intern(_player.name());
+				send_webapi_player_name(INVALID_SOCKET, teamid, squadindex, livedata::symbol_string(player.name));
 			}
 
 			// キャラクター
-			if (_player.character() != player.character)
+			if (_player.character() != livedata::symbol_string(player.character))
 			{
-				player.character = _player.character();
-				send_webapi_player_character(INVALID_SOCKET, teamid, squadindex, player.character);
+				player.character = livedata::intern(_player.character());
+				send_webapi_player_character(INVALID_SOCKET, teamid, squadindex, livedata::symbol_string(player.character));
 			}
 
 			// HP/HPMAX
-			if (_player.currenthealth() != player.hp ||
-				_player.maxhealth() != player.hp_max)
+			if (_player.currenthealth() != stats.hp[slot] ||
+				_player.maxhealth() != stats.hp_max[slot])
 			{
-				player.hp = _player.currenthealth();
-				player.hp_max = _player.maxhealth();
-				send_webapi_player_hp(INVALID_SOCKET, teamid, squadindex, player.hp, player.hp_max);
+				stats.hp[slot] = _player.currenthealth();
+				stats.hp_max[slot] = _player.maxhealth();
+				mark_webapi_player_dirty(slot, WEBAPI_PLAYER_DIRTY_HP);
 			}
 
 			// SHIELD/SHIELDMAX
-			if (_player.shieldhealth() != player.shield ||
-				_player.shieldmaxhealth() != player.shield_max)
+			if (_player.shieldhealth() != stats.shield[slot] ||
+				_player.shieldmaxhealth() != stats.shield_max[slot])
 			{
-				player.shield = _player.shieldhealth();
-				player.shield_max = _player.shieldmaxhealth();
-				send_webapi_player_shield(INVALID_SOCKET, teamid, squadindex, player.shield, player.shield_max);
+				stats.shield[slot] = _player.shieldhealth();
+				stats.shield_max[slot] = _player.shieldmaxhealth();
+				mark_webapi_player_dirty(slot, WEBAPI_PLAYER_DIRTY_SHIELD);
 			}
 
 			// POS/ANGLE
@@ -3580,12 +4397,12 @@ namespace app {
 				{
 					angle = _player.angles().y();
 				}
-				if (x != player.x || y != player.y || angle != player.angle)
+				if (x != stats.x[slot] || y != stats.y[slot] || angle != stats.angle[slot])
 				{
-					player.x = x;
-					player.y = y;
-					player.angle = angle;
-					send_webapi_player_pos(INVALID_SOCKET, teamid, squadindex, x, y, angle);
+					stats.x[slot] = x;
+					stats.y[slot] = y;
+					stats.angle[slot] = angle;
+					mark_webapi_player_dirty(slot, WEBAPI_PLAYER_DIRTY_POS);
 				}
 			}
 
@@ -3597,10 +4414,10 @@ namespace app {
 
 			// チーム名
 			{
-				if (team.name != _player.teamname())
+				if (_player.teamname() != livedata::symbol_string(team.name))
 				{
-					team.name = _player.teamname();
-					send_webapi_team_name(INVALID_SOCKET, teamid, team.name);
+					team.name = livedata::intern(_player.teamname());
+					mark_webapi_team_dirty(teamid, WEBAPI_TEAM_DIRTY_NAME);
 				}
 			}
 		}
@@ -3608,7 +4425,7 @@ namespace app {
 
 	void core_thread::proc_player_reset_items(uint8_t _teamid, uint8_t _squadindex)
 	{
-		auto& player = game_.teams.at(_teamid).players.at(_squadindex);
+		auto& player = game_.get_player(_teamid, _squadindex);
 
 		auto& items = player.items;
 
@@ -3634,7 +4451,7 @@ namespace app {
 
 	void core_thread::proc_player_reset_items_from_loadout(uint8_t _teamid, uint8_t _squadindex, bool _refillonly)
 	{
-		auto& player = game_.teams.at(_teamid).players.at(_squadindex);
+		auto& player = game_.get_player(_teamid, _squadindex);
 
 		auto& items = player.items;
 		const auto& loadout = game_.loadout.items;
@@ -3687,7 +4504,7 @@ namespace app {
 
 	void core_thread::proc_connected(uint8_t _teamid, uint8_t _squadindex)
 	{
-		auto& player = game_.teams.at(_teamid).players.at(_squadindex);
+		auto& player = game_.get_player(_teamid, _squadindex);
 		if (player.disconnected)
 		{
 			player.disconnected = false;
@@ -3698,19 +4515,19 @@ namespace app {
 
 		// 接続によりチーム数がaliveに変更がないか確認する
 		uint32_t alive = 0;
-		for (size_t i = 2; i < game_.teams.size(); ++i)
+		for (size_t i = 2; i < game_.team_count; ++i)
 		{
 			const auto& t = game_.teams.at(i);
-			if (t.players.size() > 0 && !t.eliminated) ++alive;
+			if (t.size > 0 && !t.eliminated) ++alive;
 		}
 
 		// 全部いなくなった場合は何もしない
 		if (alive == 0) return;
 
-		for (size_t i = 2; i < game_.teams.size(); ++i)
+		for (size_t i = 2; i < game_.team_count; ++i)
 		{
 			auto& t = game_.teams.at(i);
-			if (t.players.size() > 0 && (!t.eliminated))
+			if (t.size > 0 && (!t.eliminated))
 			{
 				if (t.place != alive)
 				{
@@ -3723,7 +4540,7 @@ namespace app {
 
 	void core_thread::proc_disconnected(uint8_t _teamid, uint8_t _squadindex, bool _canreconnect, bool _alive)
 	{
-		auto& player = game_.teams.at(_teamid).players.at(_squadindex);
+		auto& player = game_.get_player(_teamid, _squadindex);
 		if (!player.disconnected)
 		{
 			player.disconnected = true;
@@ -3735,7 +4552,7 @@ namespace app {
 
 	void core_thread::proc_characterselected(uint8_t _teamid, uint8_t _squadindex)
 	{
-		auto& player = game_.teams.at(_teamid).players.at(_squadindex);
+		auto& player = game_.get_player(_teamid, _squadindex);
 		if (!player.characterselected)
 		{
 			player.characterselected = true;
@@ -3745,41 +4562,45 @@ namespace app {
 
 	void core_thread::proc_upgradetierchanged(uint8_t _teamid, uint8_t _squadindex, int32_t _level)
 	{
-		auto& player = game_.teams.at(_teamid).players.at(_squadindex);
+		auto& player = game_.get_player(_teamid, _squadindex);
 		player.level = _level;
 		send_webapi_player_level(INVALID_SOCKET, _teamid, _squadindex, _level);
 	}
 
 	void core_thread::proc_upgradeselected(uint8_t _teamid, uint8_t _squadindex, int32_t _level, const std::string& _name, const std::string& _desc)
 	{
-		auto& player = game_.teams.at(_teamid).players.at(_squadindex);
+		auto& player = game_.get_player(_teamid, _squadindex);
 		player.perks[_level] = { _name, _desc };
 		send_webapi_player_perk(INVALID_SOCKET, _teamid, _squadindex, _level, _name);
 	}
 
 	void core_thread::proc_damage_dealt(uint8_t _teamid, uint8_t _squadindex, uint32_t _damage)
 	{
-		auto& player = game_.teams.at(_teamid).players.at(_squadindex);
+		uint8_t slot = game_.slot(_teamid, _squadindex);
+		auto& stats = game_.stats;
 		if (_damage != 0)
 		{
-			player.damage_dealt += _damage;
-			send_webapi_player_damage(INVALID_SOCKET, _teamid, _squadindex, player.damage_dealt, player.damage_taken);
+			stats.damage_dealt[slot] += _damage;
+			mark_webapi_player_dirty(slot, WEBAPI_PLAYER_DIRTY_DAMAGE);
 		}
 	}
 
 	void core_thread::proc_damage_taken(uint8_t _teamid, uint8_t _squadindex, uint32_t _damage)
 	{
-		auto& player = game_.teams.at(_teamid).players.at(_squadindex);
+		uint8_t slot = game_.slot(_teamid, _squadindex);
+		auto& stats = game_.stats;
 		if (_damage != 0)
 		{
-			player.damage_taken += _damage;
-			send_webapi_player_damage(INVALID_SOCKET, _teamid, _squadindex, player.damage_dealt, player.damage_taken);
+			stats.damage_taken[slot] += _damage;
+			mark_webapi_player_dirty(slot, WEBAPI_PLAYER_DIRTY_DAMAGE);
 		}
 	}
 	
-	void core_thread::proc_player_stats(uint8_t _teamid, uint8_t _squadindex, const std::string& _stat, uint32_t _v)
+	void core_thread::proc_player_stats(uint8_t _teamid, uint8_t _squadindex, std::string_view _stat, uint32_t _v)
 	{
-		auto& player = game_.teams.at(_teamid).players.at(_squadindex);
+		uint8_t slot = game_.slot(_teamid, _squadindex);
+		auto& player = game_.players[slot];
+		auto& kills = game_.stats.kills[slot];
 		bool send = false;
 		if (_stat == "assists")
 		{
@@ -3791,9 +4612,9 @@ namespace app {
 		}
 		else if (_stat == "kills")
 		{
-			if (_v != player.kills)
+			if (_v != kills)
 			{
-				player.kills = _v;
+				kills = _v;
 				send = true;
 			}
 		}
@@ -3823,13 +4644,13 @@ namespace app {
 		}
 		if (send)
 		{
-			send_webapi_player_stats(INVALID_SOCKET, _teamid, _squadindex, player.kills, player.assists, player.knockdowns, player.revives, player.respawns);
+			send_webapi_player_stats(INVALID_SOCKET, _teamid, _squadindex, kills, player.assists, player.knockdowns, player.revives, player.respawns);
 		}
 	}
 
 	void core_thread::proc_item(uint8_t _teamid, uint8_t _squadindex, uint8_t _item, int _quantity)
 	{
-		auto& player = game_.teams.at(_teamid).players.at(_squadindex);
+		auto& player = game_.get_player(_teamid, _squadindex);
 		switch (_item)
 		{
 		case WEBAPI_ITEM_BODYSHIELD_LV1:
@@ -3934,51 +4755,56 @@ namespace app {
 
 	void core_thread::proc_respawn(uint8_t _teamid, uint8_t _squadindex)
 	{
-		auto& player = game_.teams.at(_teamid).players.at(_squadindex);
+		auto& player = game_.get_player(_teamid, _squadindex);
 		if (player.state != WEBAPI_PLAYER_STATE_ALIVE)
 		{
 			player.state = WEBAPI_PLAYER_STATE_ALIVE;
+			flush_webapi_player(game_.slot(_teamid, _squadindex)); // 状態変化より前の値を先に送る
 			send_webapi_player_state(INVALID_SOCKET, _teamid, _squadindex, player.state);
 		}
 	}
 
 	void core_thread::proc_revive(uint8_t _teamid, uint8_t _squadindex)
 	{
-		auto& player = game_.teams.at(_teamid).players.at(_squadindex);
+		auto& player = game_.get_player(_teamid, _squadindex);
 		if (player.state != WEBAPI_PLAYER_STATE_ALIVE)
 		{
 			player.state = WEBAPI_PLAYER_STATE_ALIVE;
+			flush_webapi_player(game_.slot(_teamid, _squadindex)); // 状態変化より前の値を先に送る
 			send_webapi_player_state(INVALID_SOCKET, _teamid, _squadindex, player.state);
 		}
 	}
 
 	void core_thread::proc_down(uint8_t _teamid, uint8_t _squadindex)
 	{
-		auto& player = game_.teams.at(_teamid).players.at(_squadindex);
+		auto& player = game_.get_player(_teamid, _squadindex);
 		if (player.state != WEBAPI_PLAYER_STATE_DOWN)
 		{
 			player.state = WEBAPI_PLAYER_STATE_DOWN;
+			flush_webapi_player(game_.slot(_teamid, _squadindex)); // 状態変化より前の値を先に送る
 			send_webapi_player_state(INVALID_SOCKET, _teamid, _squadindex, player.state);
 		}
 	}
 
 	void core_thread::proc_killed(uint8_t _teamid, uint8_t _squadindex)
 	{
-		auto& player = game_.teams.at(_teamid).players.at(_squadindex);
+		auto& player = game_.get_player(_teamid, _squadindex);
 		player.killed++;
 		if (player.state != WEBAPI_PLAYER_STATE_KILLED)
 		{
 			player.state = WEBAPI_PLAYER_STATE_KILLED;
+			flush_webapi_player(game_.slot(_teamid, _squadindex)); // 状態変化より前の値を先に送る
 			send_webapi_player_state(INVALID_SOCKET, _teamid, _squadindex, player.state);
 		}
 	}
 
 	void core_thread::proc_banner_collected(uint8_t _teamid, uint8_t _squadindex)
 	{
-		auto& player = game_.teams.at(_teamid).players.at(_squadindex);
+		auto& player = game_.get_player(_teamid, _squadindex);
 		if (player.state != WEBAPI_PLAYER_STATE_COLLECTED)
 		{
 			player.state = WEBAPI_PLAYER_STATE_COLLECTED;
+			flush_webapi_player(game_.slot(_teamid, _squadindex)); // 状態変化より前の値を先に送る
 			send_webapi_player_state(INVALID_SOCKET, _teamid, _squadindex, player.state);
 		}
 	}
@@ -3987,16 +4813,16 @@ namespace app {
 	{
 		// 生存チーム数の確認
 		uint32_t alive = 0;
-		for (size_t i = 2; i < game_.teams.size(); ++i)
+		for (size_t i = 2; i < game_.team_count; ++i)
 		{
 			const auto& t = game_.teams.at(i);
-			if (t.players.size() > 0 && !t.eliminated) ++alive;
+			if (t.size > 0 && !t.eliminated) ++alive;
 		}
 
-		for (size_t i = 2; i < game_.teams.size(); ++i)
+		for (size_t i = 2; i < game_.team_count; ++i)
 		{
 			auto& t = game_.teams.at(i);
-			if (t.players.size() > 0 &&(!t.eliminated))
+			if (t.size > 0 &&(!t.eliminated))
 			{
 				if (i == _teamid)
 				{
@@ -4017,6 +4843,123 @@ namespace app {
 		send_webapi_squad_eliminated(INVALID_SOCKET, _teamid, alive);
 	}
 
+	//---------------------------------------------------------------------------------
+	// DIRTY
+	//---------------------------------------------------------------------------------
+	void core_thread::mark_webapi_player_dirty(uint8_t _slot, uint8_t _bits)
+	{
+		webapi_player_dirty_[_slot] |= _bits;
+		if (webapi_flush_interval_ == 0 && webapi_tick_rate_ == 0)
+		{
+			flush_webapi_player(_slot);
+			return;
+		}
+		if (!webapi_dirty_)
+		{
+			webapi_dirty_ = true;
+			webapi_flush_next_ = ::GetTickCount64() + webapi_flush_interval_;
+		}
+	}
+
+	void core_thread::mark_webapi_team_dirty(uint8_t _teamid, uint8_t _bits)
+	{
+		webapi_team_dirty_[_teamid] |= _bits;
+		if (webapi_flush_interval_ == 0 && webapi_tick_rate_ == 0)
+		{
+			flush_webapi_team(_teamid);
+			return;
+		}
+		if (!webapi_dirty_)
+		{
+			webapi_dirty_ = true;
+			webapi_flush_next_ = ::GetTickCount64() + webapi_flush_interval_;
+		}
+	}
+
+	void core_thread::flush_webapi_player(uint8_t _slot)
+	{
+		auto bits = webapi_player_dirty_[_slot];
+		if (bits == 0) return;
+		webapi_player_dirty_[_slot] = 0;
+
+		const auto& stats = game_.stats;
+		uint8_t teamid = game_.slot_teamid[_slot];
+		uint8_t squadindex = game_.slot_squadindex[_slot];
+		if (bits & WEBAPI_PLAYER_DIRTY_HP) send_webapi_player_hp(INVALID_SOCKET, teamid, squadindex, stats.hp[_slot], stats.hp_max[_slot]);
+		if (bits & WEBAPI_PLAYER_DIRTY_SHIELD) send_webapi_player_shield(INVALID_SOCKET, teamid, squadindex, stats.shield[_slot], stats.shield_max[_slot]);
+		if (bits & WEBAPI_PLAYER_DIRTY_POS) send_webapi_player_pos(INVALID_SOCKET, teamid, squadindex, stats.x[_slot], stats.y[_slot], stats.angle[_slot]);
+		if (bits & WEBAPI_PLAYER_DIRTY_DAMAGE) send_webapi_player_damage(INVALID_SOCKET, teamid, squadindex, stats.damage_dealt[_slot], stats.damage_taken[_slot]);
+	}
+
+	void core_thread::flush_webapi_team(uint8_t _teamid)
+	{
+		auto bits = webapi_team_dirty_[_teamid];
+		if (bits == 0) return;
+		webapi_team_dirty_[_teamid] = 0;
+
+		const auto& team = game_.teams.at(_teamid);
+		if (bits & WEBAPI_TEAM_DIRTY_NAME) send_webapi_team_name(INVALID_SOCKET, _teamid, livedata::symbol_string(team.name));
+	}
+
+	void core_thread::flush_webapi_dirty()
+	{
+		webapi_dirty_ = false;
+
+		// チーム名を先に送る
+		for (size_t i = 0; i < game_.team_count; ++i)
+		{
+			flush_webapi_team(i);
+		}
+		for (size_t i = 0; i < game_.player_count; ++i)
+		{
+			flush_webapi_player(i);
+		}
+	}
+
+	DWORD core_thread::get_webapi_flush_timeout()
+	{
+		if (webapi_tick_rate_ > 0)
+		{
+			// 送るものがある時だけ次のティックで起きる
+			if (!webapi_dirty_ && webapi_pending_.empty()) return INFINITE;
+			auto now = ::GetTickCount64();
+			if (now >= webapi_tick_next_) return 0;
+			return static_cast<DWORD>(webapi_tick_next_ - now);
+		}
+
+		if (!webapi_dirty_) return INFINITE;
+		auto now = ::GetTickCount64();
+		if (now >= webapi_flush_next_) return 0;
+		return static_cast<DWORD>(webapi_flush_next_ - now);
+	}
+
+	void core_thread::webapi_tick()
+	{
+		auto now = ::GetTickCount64();
+
+		if (webapi_tick_rate_ == 0)
+		{
+			if (webapi_dirty_ && now >= webapi_flush_next_)
+			{
+				flush_webapi_dirty();
+			}
+			flush_webapi_pending();
+			return;
+		}
+
+		// 入力はgame_に反映済みなので、ティックごとにまとめて作って送る
+		if (now < webapi_tick_next_) return;
+		if (!webapi_dirty_ && webapi_pending_.empty()) return;
+
+		if (webapi_dirty_) flush_webapi_dirty();
+		flush_webapi_pending();
+
+		// 開始時刻からの位置で次を決める (ずれを溜めず、遅れた分は飛ばす)
+		if (webapi_tick_start_ == 0) webapi_tick_start_ = now;
+		uint64_t index = (now - webapi_tick_start_) * webapi_tick_rate_ / 1000 + 1;
+		webapi_tick_next_ = webapi_tick_start_ + index * 1000 / webapi_tick_rate_;
+	}
+
 	//---------------------------------------------------------------------------------
 	// LIVEDATA
 	//---------------------------------------------------------------------------------
@@ -4042,15 +4985,15 @@ namespace app {
 	void core_thread::livedata_get_teams(SOCKET _sock, uint32_t _sequence)
 	{
 		// observerも送る
-		for (size_t i = 1; i < game_.teams.size(); ++i)
+		for (size_t i = 1; i < game_.team_count; ++i)
 		{
 			const auto& t = game_.teams.at(i);
-			if (t.name != "") send_webapi_team_name(_sock, i, t.name);
+			if (t.name != livedata::SYMBOL_EMPTY) send_webapi_team_name(_sock, i, livedata::symbol_string(t.name));
 			if (t.place != 0) send_webapi_team_placement(_sock, i, t.place);
 			if (t.eliminated) send_webapi_squad_eliminated(_sock, i, t.place);
-			for (size_t j = 0; j < t.players.size(); ++j)
+			for (size_t j = 0; j < t.size; ++j)
 			{
-				const auto& p = t.players.at(j);
+				const auto& p = game_.players[t.slots[j]];
 				// IDだけ先に送る
 				if (p.id != "")
 				{
@@ -4064,24 +5007,26 @@ namespace app {
 
 	void core_thread::livedata_get_team_players(SOCKET _sock, uint32_t _sequence, uint8_t _teamid)
 	{
-		if (_teamid >= game_.teams.size()) return;
+		if (_teamid >= game_.team_count) return;
 		const auto& t = game_.teams.at(_teamid);
-		for (size_t i = 0; i < t.players.size(); ++i)
+		const auto& stats = game_.stats;
+		for (size_t i = 0; i < t.size; ++i)
 		{
-			const auto& p = t.players.at(i);
+			uint8_t slot = t.slots[i];
+			const auto& p = game_.players[slot];
 			// ID以外を送る
 			if (p.disconnected) send_webapi_player_disconnected(_sock, _teamid, i, p.canreconnect);
-			send_webapi_player_name(_sock, _teamid, i, p.name);
-			send_webapi_player_character(_sock, _teamid, i, p.character);
+			send_webapi_player_name(_sock, _teamid, i, livedata::symbol_string(p.name));
+			send_webapi_player_character(_sock, _teamid, i, livedata::symbol_string(p.character));
 			send_webapi_player_level(_sock, _teamid, i, p.level);
-			send_webapi_player_hp(_sock, _teamid, i, p.hp, p.hp_max);
-			send_webapi_player_shield(_sock, _teamid, i, p.shield, p.shield_max);
-			send_webapi_player_damage(_sock, _teamid, i, p.damage_dealt, p.damage_taken);
-			send_webapi_player_pos(_sock, _teamid, i, p.x, p.y, p.angle);
+			send_webapi_player_hp(_sock, _teamid, i, stats.hp[slot], stats.hp_max[slot]);
+			send_webapi_player_shield(_sock, _teamid, i, stats.shield[slot], stats.shield_max[slot]);
+			send_webapi_player_damage(_sock, _teamid, i, stats.damage_dealt[slot], stats.damage_taken[slot]);
+			send_webapi_player_pos(_sock, _teamid, i, stats.x[slot], stats.y[slot], stats.angle[slot]);
 			send_webapi_player_state(_sock, _teamid, i, p.state);
-			send_webapi_player_stats(_sock, _teamid, i, p.kills, p.assists, p.knockdowns, p.revives, p.respawns);
+			send_webapi_player_stats(_sock, _teamid, i, stats.kills[slot], p.assists, p.knockdowns, p.revives, p.respawns);
 			send_webapi_player_killed_count(_sock, _teamid, i, p.killed);
-			send_webapi_player_weapon(_sock, _teamid, i, p.weapon);
+			send_webapi_player_weapon(_sock, _teamid, i, livedata::symbol_string(p.weapon));
 
 			// パーク情報
 			for (const auto& [level, perk] : p.perks)
@@ -4090,23 +5035,9 @@ namespace app {
 			}
 
 			// アイテム
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_SYRINGE, p.items.syringe);
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_MEDKIT, p.items.medkit);
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_SHIELDCELL, p.items.shield_cell);
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_SHIELDBATTERY, p.items.shield_battery);
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_PHOENIXKIT, p.items.phoenixkit);
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_ULTIMATEACCELERANT, p.items.ultimateaccelerant);
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_THERMITEGRENADE, p.items.thermitegrenade);
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_FRAGGRENADE, p.items.fraggrenade);
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_ARCSTAR, p.items.arcstar);
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_BODYSHIELD, p.items.bodyshield);
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_BACKPACK, p.items.backpack);
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_KNOCKDOWNSHIELD, p.items.knockdownshield);
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_MOBILERESPAWNBEACON, p.items.mobilerespawnbeacon);
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_HEATSHIELD, p.items.heatshield);
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_EVACTOWER, p.items.evactower);
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_SHIELDCORE, p.items.shieldcore);
-			send_webapi_player_items(_sock, _teamid, i, WEBAPI_ITEM_AMP, p.items.amp);
+			for_each_webapi_item(p.items, [&](uint8_t _itemid, uint32_t _quantity) {
+				send_webapi_player_items(_sock, _teamid, i, _itemid, _quantity);
+				});
 
 			// キャラクター選択済み情報
 			if (p.characterselected)
@@ -4118,13 +5049,102 @@ namespace app {
 		reply_livedata_get_team_players(_sock, _sequence, _teamid);
 	}
 
+	void core_thread::livedata_get_snapshot(SOCKET _sock, uint32_t _sequence, uint8_t _teamid)
+	{
+		// 0xffは全チーム (observer含む)
+		std::vector<uint8_t> buffer;
+		buffer.reserve(64 * 1024);
+		snapshot_u8(buffer, LIVEDATA_SNAPSHOT_VERSION);
+		if (_teamid == 0xff)
+		{
+			snapshot_u8(buffer, game_.team_count > 1 ? game_.team_count - 1 : 0);
+			for (size_t i = 1; i < game_.team_count; ++i)
+			{
+				write_livedata_snapshot_team(buffer, i);
+			}
+		}
+		else if (_teamid < game_.team_count)
+		{
+			snapshot_u8(buffer, 1);
+			write_livedata_snapshot_team(buffer, _teamid);
+		}
+		else
+		{
+			snapshot_u8(buffer, 0);
+		}
+
+		reply_livedata_get_snapshot(_sock, _sequence, _teamid, buffer);
+	}
+
+	void core_thread::write_livedata_snapshot_team(std::vector<uint8_t>& _buffer, uint8_t _teamid)
+	{
+		const auto& t = game_.teams.at(_teamid);
+		const auto& stats = game_.stats;
+		snapshot_u8(_buffer, _teamid);
+		snapshot_str(_buffer, livedata::symbol_string(t.name));
+		snapshot_u32(_buffer, t.place);
+		snapshot_u8(_buffer, t.eliminated ? 1 : 0);
+		snapshot_u8(_buffer, t.size);
+		for (size_t i = 0; i < t.size; ++i)
+		{
+			uint8_t slot = t.slots[i];
+			const auto& p = game_.players[slot];
+			snapshot_str(_buffer, p.id);
+			snapshot_str(_buffer, livedata::symbol_string(p.name));
+			snapshot_str(_buffer, livedata::symbol_string(p.character));
+			snapshot_str(_buffer, livedata::symbol_string(p.weapon));
+			snapshot_u8(_buffer, p.state);
+			snapshot_i32(_buffer, p.level);
+			snapshot_u32(_buffer, stats.hp[slot]);
+			snapshot_u32(_buffer, stats.hp_max[slot]);
+			snapshot_u32(_buffer, stats.shield[slot]);
+			snapshot_u32(_buffer, stats.shield_max[slot]);
+			snapshot_u32(_buffer, stats.damage_dealt[slot]);
+			snapshot_u32(_buffer, stats.damage_taken[slot]);
+			snapshot_f32(_buffer, stats.x[slot]);
+			snapshot_f32(_buffer, stats.y[slot]);
+			snapshot_f32(_buffer, stats.angle[slot]);
+			snapshot_u32(_buffer, stats.kills[slot]);
+			snapshot_u32(_buffer, p.assists);
+			snapshot_u32(_buffer, p.knockdowns);
+			snapshot_u32(_buffer, p.revives);
+			snapshot_u32(_buffer, p.respawns);
+			snapshot_u32(_buffer, p.killed);
+
+			uint8_t flags = 0;
+			if (p.disconnected) flags |= 0x01;
+			if (p.canreconnect) flags |= 0x02;
+			if (p.characterselected) flags |= 0x04;
+			snapshot_u8(_buffer, flags);
+
+			// アイテム
+			snapshot_u8(_buffer, 17);
+			for_each_webapi_item(p.items, [&](uint8_t _itemid, uint32_t _quantity) {
+				snapshot_u8(_buffer, _itemid);
+				snapshot_u32(_buffer, _quantity);
+				});
+
+			// パーク情報 (255個まで)
+			uint8_t perks = std::min<size_t>(p.perks.size(), 0xff);
+			snapshot_u8(_buffer, perks);
+			for (const auto& [level, perk] : p.perks)
+			{
+				if (perks == 0) break;
+				--perks;
+				snapshot_i32(_buffer, level);
+				snapshot_str(_buffer, perk.name);
+			}
+		}
+	}
+
 	void core_thread::livedata_get_observers_camera(SOCKET _sock, uint32_t _sequence)
 	{
-		if (game_.teams.size() >= 2)
+		if (game_.team_count >= 2)
 		{
-			for (size_t i = 0; i < game_.teams[1].players.size(); ++i)
+			const auto& observers = game_.teams[1];
+			for (size_t i = 0; i < observers.size; ++i)
 			{
-				const auto& observer = game_.teams[1].players[i];
+				const auto& observer = game_.players[observers.slots[i]];
 				const auto& hash = observer.id;
 				if (camera_.contains(hash))
 				{
@@ -4175,7 +5195,11 @@ namespace app {
 	//---------------------------------------------------------------------------------
 	void core_thread::clear_livedata()
 	{
-		game_.teams.clear();
+		game_.clear_players();
+		player_index_.clear();
+		webapi_dirty_ = false;
+		webapi_player_dirty_.fill(0);
+		webapi_team_dirty_.fill(0);
 		game_.matchendreason = "";
 		game_.gamestate = "";
 		game_.map = "";
@@ -4212,28 +5236,32 @@ namespace app {
 		r.rings = game_.rings;
 		r.carepackages = game_.carepackages;
 
-		for (uint8_t i = 2; i < game_.teams.size(); ++i)
+		const auto& stats = game_.stats;
+		for (uint8_t i = 2; i < game_.team_count; ++i)
 		{
 			const auto& team = game_.teams.at(i);
-			if (team.players.size() == 0) continue;
+			if (team.size == 0) continue;
 
 			r.teams[i - 2] = {};
 			auto& team_result = r.teams[i - 2];
 			uint32_t kills = 0;
-			for (const auto& player : team.players)
+			for (size_t j = 0; j < team.size; ++j)
 			{
+				uint8_t slot = team.slots[j];
+				const auto& player = game_.players[slot];
+
 				// save current items
 				std::map<std::string, uint32_t> items;
 
 				items.emplace("syringe", player.items.syringe);
 				team_result.players.push_back({
-					.kills = player.kills,
-					.damage_dealt = player.damage_dealt,
-					.damage_taken = player.damage_taken,
+					.kills = stats.kills[slot],
+					.damage_dealt = stats.damage_dealt[slot],
+					.damage_taken = stats.damage_taken[slot],
 					.assists = player.assists,
 					.id = player.id,
-					.name = player.name,
-					.character = player.character,
+					.name = livedata::symbol_string(player.name),
+					.character = livedata::symbol_string(player.character),
 					.items = {
 						{"syringe", player.items.syringe},
 						{"medkit", player.items.medkit},
@@ -4254,15 +5282,18 @@ namespace app {
 						{"amp", player.items.amp},
 					}
 				});
-				kills += player.kills;
+				kills += stats.kills[slot];
 			}
 			team_result.id = i - 2;
-			team_result.name = team.name;
+			team_result.name = livedata::symbol_string(team.name);
 			team_result.kills = kills;
 			team_result.placement = team.place;
 		}
 
 		local_.save_result(std::move(r));
+
+		// イベント数をログに残す
+		log_liveapi_any_stats();
 	}
 
 	//---------------------------------------------------------------------------------
@@ -4311,7 +5342,7 @@ namespace app {
 			return false;
 		}
 
-		event_in_ = ::CreateEventW(NULL, FALSE, FALSE, NULL);
+		event_in_ = ::CreateEventW(NULL, FALSE, TRUE, NULL); // run()前に積まれた分を拾う
 		if (event_in_ == NULL)
 		{
 			log(LOG_CORE, L"Error: CreateEvent() failed.");
@@ -4345,13 +5376,8 @@ namespace app {
 	//---------------------------------------------------------------------------------
 	void core_thread::push_in(core_message_in&& _msg)
 	{
-		{
-			std::lock_guard<std::mutex> lock(mtx_in_);
-			q_in_.push(std::move(_msg));
-		}
-
-		// 通知
-		if (event_in_)
+		// 空だったときだけ通知
+		if (q_in_.push(std::move(_msg)) && event_in_)
 		{
 			::SetEvent(event_in_);
 		}
@@ -4371,16 +5397,6 @@ namespace app {
 		}
 	}
 
-	std::queue<core_message_in> core_thread::pull_q_in()
-	{
-		std::queue<core_message_in> q;
-		{
-			std::lock_guard<std::mutex> lock(mtx_in_);
-			q.swap(q_in_);
-		}
-		return q;
-	}
-
 	std::queue<core_message_out> core_thread::pull_q_out()
 	{
 		std::queue<core_message_out> q;
@@ -4409,11 +5425,6 @@ namespace app {
 		push_in(core_message_in_get_stats{});
 	}
 
-	void core_thread::liveapi_queuecheck()
-	{
-		push_in(core_message_in_queuecheck{});
-	}
-
 	void core_thread::ping()
 	{
 		push_in(core_message_in_ping{});
@@ -7,9 +7,16 @@
 #include "http_get_thread.hpp"
 #include "filedump.hpp"
 #include "livedata.hpp"
+#include "liveapi_wire.hpp"
+#include "spsc_ring.hpp"
 
 #include "events/events.pb.h"
 
+#include <array>
+#include <bitset>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <utility>
 #include <unordered_map>
 #include <variant>
@@ -17,6 +24,75 @@
 
 namespace app {
 
+	// LiveAPI Any種別
+	enum : uint8_t {
+		LIVEAPI_ANY_RESPONSE = 0x00u,
+		LIVEAPI_ANY_REQUESTSTATUS,
+		LIVEAPI_ANY_INIT,
+		LIVEAPI_ANY_CUSTOMMATCH_LOBBYPLAYERS,
+		LIVEAPI_ANY_CUSTOMMATCH_SETSETTINGS,
+		LIVEAPI_ANY_CUSTOMMATCH_LEGENDBANSTATUS,
+		LIVEAPI_ANY_OBSERVERSWITCHED,
+		LIVEAPI_ANY_MATCHSETUP,
+		LIVEAPI_ANY_GAMESTATECHANGED,
+		LIVEAPI_ANY_CHARACTERSELECTED,
+		LIVEAPI_ANY_MATCHSTATEEND,
+		LIVEAPI_ANY_RINGSTARTCLOSING,
+		LIVEAPI_ANY_RINGFINISHEDCLOSING,
+		LIVEAPI_ANY_PLAYERCONNECTED,
+		LIVEAPI_ANY_PLAYERDISCONNECTED,
+		LIVEAPI_ANY_PLAYERUPGRADETIERCHANGED,
+		LIVEAPI_ANY_LEGENDUPGRADESELECTED,
+		LIVEAPI_ANY_PLAYERSTATCHANGED,
+		LIVEAPI_ANY_PLAYERDAMAGED,
+		LIVEAPI_ANY_PLAYERKILLED,
+		LIVEAPI_ANY_PLAYERDOWNED,
+		LIVEAPI_ANY_PLAYERASSIST,
+		LIVEAPI_ANY_SQUADELIMINATED,
+		LIVEAPI_ANY_REVENANTFORGEDSHADOWDAMAGED,
+		LIVEAPI_ANY_GIBRALTARSHIELDABSORBED,
+		LIVEAPI_ANY_PLAYERRESPAWNTEAM,
+		LIVEAPI_ANY_RESPAWNFROMDEATHBOX,
+		LIVEAPI_ANY_PLAYERREVIVE,
+		LIVEAPI_ANY_ARENASITEMSELECTED,
+		LIVEAPI_ANY_ARENASITEMDESELECTED,
+		LIVEAPI_ANY_INVENTORYPICKUP,
+		LIVEAPI_ANY_INVENTORYDROP,
+		LIVEAPI_ANY_INVENTORYUSE,
+		LIVEAPI_ANY_BANNERCOLLECTED,
+		LIVEAPI_ANY_PLAYERABILITYUSED,
+		LIVEAPI_ANY_PLAYERULTIMATECHARGED,
+		LIVEAPI_ANY_ZIPLINEUSED,
+		LIVEAPI_ANY_GRENADETHROWN,
+		LIVEAPI_ANY_BLACKMARKETACTION,
+		LIVEAPI_ANY_WRAITHPORTAL,
+		LIVEAPI_ANY_WARPGATEUSED,
+		LIVEAPI_ANY_AMMOUSED,
+		LIVEAPI_ANY_WEAPONSWITCHED,
+		LIVEAPI_ANY_CAREPACKAGELAUNCHED,
+		LIVEAPI_ANY_CAREPACKAGELANDED,
+		LIVEAPI_ANY_CAREPACKAGEOPENED,
+		LIVEAPI_ANY_UNKNOWN
+	};
+
+	struct liveapi_any_entry {
+		uint8_t type;
+		std::string name;
+		uint64_t count;
+	};
+
+	// nucleushash索引 (32byte固定長で比較)
+	struct player_index_key {
+		std::array<char, 32> hash;
+		uint8_t teamid;
+
+		bool operator==(const player_index_key&) const = default;
+	};
+
+	struct player_index_key_hash {
+		size_t operator()(const player_index_key& _key) const;
+	};
+
 	struct core_message_in_teambanner_state {
 		bool state;
 	};
@@ -28,9 +104,6 @@ namespace app {
 	struct core_message_in_get_stats {
 	};
 
-	struct core_message_in_queuecheck {
-	};
-
 	struct core_message_in_ping {
 	};
 
@@ -38,7 +111,6 @@ namespace app {
 		core_message_in_teambanner_state,
 		core_message_in_map_state,
 		core_message_in_get_stats,
-		core_message_in_queuecheck,
 		core_message_in_ping
 	>;
 
@@ -46,12 +118,22 @@ namespace app {
 		uint64_t conn_count;
 		uint64_t recv_count;
 		uint64_t send_count;
+		uint64_t rbuf_bytes;
+		uint64_t pool_bytes;
+		uint64_t queued_bytes;
+		uint64_t request_queued; // 送信待ちの要求数
+		uint64_t request_wait_avg; // 前回から送った要求の待ち時間 (ms)
+		uint64_t request_wait_max;
+		uint64_t request_coalesced; // 後勝ちでまとめた要求数 (累計)
 	};
 
 	struct core_message_out_webapi_stats {
 		uint64_t conn_count;
 		uint64_t recv_count;
 		uint64_t send_count;
+		uint64_t rbuf_bytes;
+		uint64_t pool_bytes;
+		uint64_t queued_bytes;
 	};
 
 	using core_message_out = std::variant<
@@ -59,14 +141,80 @@ namespace app {
 		core_message_out_webapi_stats
 	>;
 
+	// main_windowからの入力キューの長さ
+	constexpr size_t CORE_RING_IN_SIZE = 256;
+
+	// LiveAPIへの要求の結果
+	enum class liveapi_result : uint8_t {
+		success,
+		failed, // Responseのsuccessがfalse、タイムアウト・切断
+		superseded // 送る前に同じキーの別の内容の要求で置き換えられた (送っていない)
+	};
+
+	// LiveAPIへの要求の完了通知
+	using liveapi_response_func = std::function<void(liveapi_result)>;
+
+	// LiveAPIへの要求の優先度 (小さいほど先に送る)
+	enum : uint8_t {
+		LIVEAPI_PRIORITY_HIGH = 0, // カメラ・ポーズ
+		LIVEAPI_PRIORITY_NORMAL, // ロビー
+		LIVEAPI_PRIORITY_LOW, // チャット・設定
+		LIVEAPI_PRIORITY_COUNT
+	};
+
+	// 同じキーの送信待ちの要求は後勝ちでまとめる (0はまとめない)
+	constexpr uint32_t liveapi_coalesce_key(uint8_t _type, uint8_t _teamid = 0)
+	{
+		return (uint32_t(_type) << 8) | _teamid;
+	}
+
+	struct liveapi_request {
+		std::vector<uint8_t> data;
+		liveapi_response_func on_response;
+		uint32_t key;
+		uint64_t queued; // 積んだ時間 (待ち時間の計測用)
+	};
+
+	// 最後に分かったロビーのチーム (CustomMatch_LobbyPlayersと成功した設定から更新)
+	struct lobby_team_state {
+		std::string name;
+		uint8_t spawnpoint;
+	};
+
+	// WEBAPI_SEND_CUSTOMMATCH_SETUPLOBBYで設定する項目
+	enum : uint8_t {
+		LOBBY_SETUP_NAME = 0x01u,
+		LOBBY_SETUP_SPAWNPOINT = 0x02u
+	};
+
+	struct lobby_setup_team {
+		uint8_t teamid;
+		uint8_t mask;
+		std::string name;
+		uint8_t spawnpoint;
+	};
+
+	struct lobby_setup {
+		SOCKET sock;
+		uint32_t sequence;
+		uint64_t start;
+		bool set_legendban;
+		std::vector<std::string> legendrefs; // 並べ替え済み
+		std::vector<lobby_setup_team> teams;
+		uint32_t refreshing; // 現在の状態の取得待ち
+		uint32_t total;
+		uint32_t done;
+		uint32_t failed;
+		uint32_t skipped;
+	};
+
 	class core_thread {
 		HWND window_;
 		HANDLE thread_;
 		HANDLE event_close_;
 		HANDLE event_in_;
-		std::mutex mtx_in_;
 		std::mutex mtx_out_;
-		std::queue<core_message_in> q_in_;
+		spsc_ring<core_message_in> q_in_; // main_window -> core
 		std::queue<core_message_out> q_out_;
 		websocket_thread liveapi_;
 		websocket_thread webapi_;
@@ -74,12 +222,36 @@ namespace app {
 		http_get_thread http_get_;
 		filedump filedump_;
 		livedata::game game_;
+		std::unordered_map<player_index_key, uint8_t, player_index_key_hash> player_index_;
 		std::unordered_map<std::string, std::pair<uint8_t, uint8_t>> camera_;
 		std::string observer_hash_;
-		std::queue<std::vector<uint8_t>> liveapi_queue_;
-		bool liveapi_available_;
-		uint64_t liveapi_lastsend_;
-		uint64_t liveapi_lastresponse_;
+		std::array<std::deque<liveapi_request>, LIVEAPI_PRIORITY_COUNT> liveapi_queue_;
+		uint64_t liveapi_coalesced_count_;
+		uint64_t liveapi_wait_total_; // 統計を送るたびにリセットする
+		uint64_t liveapi_wait_count_;
+		uint64_t liveapi_wait_max_;
+		std::deque<liveapi_response_func> liveapi_inflight_; // Response待ちの要求 (Responseは要求順に返る)
+		uint64_t liveapi_deadline_; // これを過ぎたらResponseを待たずに次を送る
+		std::unordered_map<uint8_t, lobby_team_state> lobby_teams_;
+		std::vector<std::string> lobby_legendbans_; // 並べ替え済み
+		bool lobby_legendbans_known_;
+		std::unordered_map<uint64_t, liveapi_any_entry> liveapi_any_table_;
+		uint64_t liveapi_any_unknown_count_;
+		std::bitset<LIVEAPI_ANY_UNKNOWN> liveapi_any_ignore_;
+		std::vector<char> liveapi_arena_block_;
+		std::unique_ptr<google::protobuf::Arena> liveapi_arena_;
+		uint64_t liveapi_event_count_;
+		uint64_t liveapi_wire_count_;
+		uint64_t liveapi_wire_fallback_count_;
+		uint16_t webapi_flush_interval_;
+		uint64_t webapi_flush_next_;
+		uint16_t webapi_tick_rate_; // 0の場合は処理ごとに送る
+		uint64_t webapi_tick_start_;
+		uint64_t webapi_tick_next_;
+		bool webapi_dirty_;
+		std::array<uint8_t, livedata::PLAYER_MAX> webapi_player_dirty_;
+		std::array<uint8_t, livedata::TEAM_MAX> webapi_team_dirty_;
+		std::vector<std::pair<SOCKET, std::vector<uint8_t>>> webapi_pending_;
 
 		static DWORD WINAPI proc_common(LPVOID);
 		DWORD proc();
@@ -89,13 +261,52 @@ namespace app {
 		void proc_http_get_message(http_get_message_get_stats&& _data);
 		void proc_message(core_message_in&& _msg);
 
-		void proc_liveapi_any(const google::protobuf::Any& _any);
+		void proc_liveapi_any(const liveapi_wire_any& _any);
+
+		// Any種別テーブル
+		void init_liveapi_any_table();
+		void init_liveapi_any_ignore(const std::vector<std::string>& _names);
+		uint8_t get_liveapi_any_type(const liveapi_wire_any& _any);
+		void log_liveapi_any_stats();
+
+		// フレーム単位のArenaにメッセージを作成
+		template <typename T>
+		T& create_liveapi_message()
+		{
+			return *google::protobuf::Arena::Create<T>(liveapi_arena_.get());
+		}
+
+		template <typename T>
+		bool parse_liveapi_any(T& _message, const liveapi_wire_any& _any)
+		{
+			return _message.ParseFromArray(_any.value().data(), static_cast<int>(_any.value().size()));
+		}
+
+		// 直接デコードできなければ生成コードで展開して処理する
+		template <typename W, typename T, typename F>
+		void proc_liveapi_wire(const liveapi_wire_any& _any, F&& _f)
+		{
+			W w;
+			if (liveapi_wire_parse(_any.value(), w))
+			{
+				liveapi_wire_count_++;
+				_f(w);
+				return;
+			}
+			auto& p = create_liveapi_message<T>();
+			if (!parse_liveapi_any(p, _any)) return;
+			liveapi_wire_fallback_count_++;
+			_f(p);
+		}
 
 		// getter squadindex
-		uint8_t get_squadindex(const rtech::liveapi::Player& _player);
+		template <typename T>
+		uint8_t get_squadindex(const T& _player);
+		void set_player_index(uint8_t _teamid, uint8_t _squadindex, const std::string& _hash);
 
 		// player
-		void proc_player(const rtech::liveapi::Player& _player);
+		template <typename T>
+		void proc_player(const T& _player);
 		void proc_player_reset_items(uint8_t _teamid, uint8_t _squadindex);
 		void proc_player_reset_items_from_loadout(uint8_t _teamid, uint8_t _squadindex, bool _refillonly = false);
 		void proc_connected(uint8_t _teamid, uint8_t _squadindex);
@@ -103,7 +314,7 @@ namespace app {
 		void proc_characterselected(uint8_t _teamid, uint8_t _squadindex);
 		void proc_upgradetierchanged(uint8_t _teamid, uint8_t _squadindex, int32_t _level);
 		void proc_upgradeselected(uint8_t _teamid, uint8_t _squadindex, int32_t _level, const std::string& _name, const std::string& _desc);
-		void proc_player_stats(uint8_t _teamid, uint8_t _squadindex, const std::string& _stat, uint32_t _v);
+		void proc_player_stats(uint8_t _teamid, uint8_t _squadindex, std::string_view _stat, uint32_t _v);
 		void proc_item(uint8_t _teamid, uint8_t _squadindex, uint8_t _item, int _quantity);
 		void proc_respawn(uint8_t _teamid, uint8_t _squadindex);
 		void proc_revive(uint8_t _teamid, uint8_t _squadindex);
@@ -116,10 +327,26 @@ namespace app {
 		// team
 		void proc_squad_eliminated(uint8_t _teamid);
 
-		void sendto_liveapi(std::vector<uint8_t>&& _data);
+		// 頻繁に変わる値は最新値だけをtick毎にまとめて送る
+		void mark_webapi_player_dirty(uint8_t _slot, uint8_t _bits);
+		void mark_webapi_team_dirty(uint8_t _teamid, uint8_t _bits);
+		void flush_webapi_player(uint8_t _slot);
+		void flush_webapi_team(uint8_t _teamid);
+		void flush_webapi_dirty();
+		DWORD get_webapi_flush_timeout();
+		void webapi_tick();
+
+		void sendto_liveapi(std::vector<uint8_t>&& _data, uint8_t _priority, uint32_t _key, liveapi_response_func&& _on_response = nullptr);
+		void sendto_liveapi(rtech::liveapi::Request& _req, uint8_t _priority, uint32_t _key, liveapi_response_func&& _on_response);
+		size_t get_liveapi_queue_size() const;
 		void sendto_liveapi_noqueue(std::vector<uint8_t>&& _data);
+		void liveapi_sent(liveapi_response_func&& _on_response);
+		void liveapi_responded(bool _success);
+		void liveapi_abandon();
+		DWORD get_liveapi_queue_timeout();
 		void sendto_webapi(std::vector<uint8_t>&& _data);
 		void sendto_webapi(SOCKET _sock, std::vector<uint8_t>&& _data);
+		void flush_webapi_pending();
 		void sendto_liveapi_queuecheck();
 
 		void send_webapi_gamestatechanged(SOCKET _sock, const std::string& _state);
@@ -163,7 +390,7 @@ namespace app {
 
 		void send_webapi_extended_kill(uint8_t _pteamid, uint8_t _psquadindex, uint8_t _vteamid, uint8_t _vsquadindex, const std::string& _weapon);
 		void send_webapi_extended_knockdown(uint8_t _pteamid, uint8_t _psquadindex, uint8_t _vteamid, uint8_t _rsquadindex, const std::string& _weapon);
-		void send_webapi_extended_damage(uint8_t _pteamid, uint8_t _psquadindex, uint8_t _vteamid, uint8_t _vsquadindex, const std::string& _weapon, uint32_t _damage);
+		void send_webapi_extended_damage(uint8_t _pteamid, uint8_t _psquadindex, uint8_t _vteamid, uint8_t _vsquadindex, std::string_view _weapon, uint32_t _damage);
 		void send_webapi_extended_revive(uint8_t _teamid, uint8_t _psquadindex, uint8_t _rsquadindex);
 		void send_webapi_extended_collected(uint8_t _teamid, uint8_t _psquadindex, uint8_t _csquadindex);
 		void send_webapi_extended_respawn(uint8_t _teamid, uint8_t _psquadindex, uint8_t _rsquadindex);
@@ -178,6 +405,17 @@ namespace app {
 		void send_webapi_legendbanenum_start();
 		void send_webapi_legendbanenum_end();
 		void send_webapi_legendbanstatus(const std::string& _name, const std::string& _reference, const bool _banned);
+		void send_webapi_lobbysetup_progress(const lobby_setup& _setup);
+		void send_webapi_lobbysetup_done(const lobby_setup& _setup);
+
+		// ロビー一括設定 (現在の状態を取り直し、変わるものだけをResponseを待ちながら順に送る)
+		void start_lobby_setup(std::shared_ptr<lobby_setup> _setup);
+		void proc_lobby_setup(std::shared_ptr<lobby_setup> _setup);
+		void lobby_setup_completed(std::shared_ptr<lobby_setup> _setup, bool _success);
+		// 送って成功した設定だけを覚えている状態に反映する
+		void lobby_applied_name(uint8_t _teamid, const std::string& _name);
+		void lobby_applied_spawnpoint(uint8_t _teamid, uint8_t _spawnpoint);
+		void lobby_applied_legendbans(std::vector<std::string> _legendrefs);
 
 		void send_webapi_clear_livedata();
 		void send_webapi_save_result(const std::string& _tournament_id, uint8_t _gameid, const std::string& _json);
@@ -202,10 +440,12 @@ namespace app {
 		void reply_webapi_send_custtommatch_getlegendbanstatus(SOCKET _sock, uint32_t _sequence);
 		void reply_webapi_send_custtommatch_setlegendban(SOCKET _sock, uint32_t _sequence);
 		void reply_webapi_send_joinpartyserver(SOCKET _sock, uint32_t _sequence);
+		void reply_webapi_send_custommatch_setuplobby(SOCKET _sock, uint32_t _sequence);
 		void reply_livedata_get_game(SOCKET _sock, uint32_t _sequence);
 		void reply_livedata_get_teams(SOCKET _sock, uint32_t _sequence);
 		void reply_livedata_get_team_players(SOCKET _sock, uint32_t _sequence, uint8_t _teamid);
 		void reply_livedata_get_observers_camera(SOCKET _sock, uint32_t _sequence);
+		void reply_livedata_get_snapshot(SOCKET _sock, uint32_t _sequence, uint8_t _teamid, const std::vector<uint8_t>& _snapshot);
 		void reply_webapi_set_observer(SOCKET _sock, uint32_t _sequence, const std::string& _hash);
 		void reply_webapi_get_observer(SOCKET _sock, uint32_t _sequence, const std::string& _hash);
 		void reply_webapi_get_observers(SOCKET _sock, uint32_t _sequence, const std::string& _hash);
@@ -229,12 +469,15 @@ namespace app {
 		void reply_webapi_get_config(SOCKET _sock, uint32_t _sequence, const const std::string& _json, uint8_t _slot);
 		void reply_webapi_get_stats_from_code(SOCKET _sock, uint32_t _sequence, const std::string& _stats_code, uint32_t _status_code, const std::string& _json);
 		void reply_webapi_manual_postmatch(SOCKET _sock, uint32_t _sequence);
+		void reply_webapi_subscribe(SOCKET _sock, uint32_t _sequence, uint32_t _topics);
 		void broadcast_object(uint32_t _sequence, const std::string& _json);
 
 		void livedata_get_game(SOCKET _sock, uint32_t _sequence);
 		void livedata_get_teams(SOCKET _sock, uint32_t _sequence);
 		void livedata_get_team_players(SOCKET _sock, uint32_t _sequence, uint8_t _teamid);
 		void livedata_get_observers_camera(SOCKET _sock, uint32_t _sequence);
+		void livedata_get_snapshot(SOCKET _sock, uint32_t _sequence, uint8_t _teamid);
+		void write_livedata_snapshot_team(std::vector<uint8_t>& _buffer, uint8_t _teamid);
 
 		void check_game_start();
 
@@ -245,10 +488,8 @@ namespace app {
 		void push_in(core_message_in&& _msg);
 		void push_out(core_message_out&& _msg);
 
-		std::queue<core_message_in> pull_q_in();
-
 	public:
-		core_thread(const std::string& _lip, uint16_t _lport, const std::string& _wip, uint16_t _wport, uint16_t _wmaxconn);
+		core_thread(const std::string& _lip, uint16_t _lport, const std::string& _wip, uint16_t _wport, uint16_t _wmaxconn, uint16_t _wflush, uint16_t _wtick, uint16_t _wbudget, uint16_t _wlimit, uint16_t _wworkers, const std::vector<std::string>& _lignore);
 		~core_thread();
 
 		// コピー不可
@@ -266,7 +507,6 @@ namespace app {
 		void set_teambanner_state(bool _state);
 		void set_map_state(bool _state);
 		void get_stats();
-		void liveapi_queuecheck();
 		void ping();
 	};
 }
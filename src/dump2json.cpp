@@ -1,5 +1,9 @@
 ﻿#include "events\events.pb.h"
+#include "liveapi_wire.hpp"
 
+#include <google/protobuf/arena.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
 #include <google/protobuf/util/json_util.h>
 
 #include <nlohmann/json.hpp>
@@ -9,7 +13,273 @@
 #include <fstream>
 #include <string>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string_view>
 
+namespace api = rtech::liveapi;
+
+// --allocs: ヒープ確保の回数を数える (このツールの中だけ置き換える)
+uint64_t heap_alloc_count = 0;
+
+void* operator new(size_t _size)
+{
+	++heap_alloc_count;
+	if (void* p = std::malloc(_size == 0 ? 1 : _size)) return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t _size)
+{
+	return operator new(_size);
+}
+
+void operator delete(void* _p) noexcept
+{
+	std::free(_p);
+}
+
+void operator delete[](void* _p) noexcept
+{
+	std::free(_p);
+}
+
+void operator delete(void* _p, size_t) noexcept
+{
+	std::free(_p);
+}
+
+void operator delete[](void* _p, size_t) noexcept
+{
+	std::free(_p);
+}
+
+bool equal(const api::Vector3& _a, const app::liveapi_wire_vector3& _b)
+{
+	return _a.x() == _b.x() && _a.y() == _b.y() && _a.z() == _b.z();
+}
+
+bool equal(const api::Player& _a, const app::liveapi_wire_player& _b)
+{
+	return _a.name() == _b.name() &&
+		_a.teamid() == _b.teamid() &&
+		_a.has_pos() == _b.has_pos() && equal(_a.pos(), _b.pos()) &&
+		_a.has_angles() == _b.has_angles() && equal(_a.angles(), _b.angles()) &&
+		_a.currenthealth() == _b.currenthealth() &&
+		_a.maxhealth() == _b.maxhealth() &&
+		_a.shieldhealth() == _b.shieldhealth() &&
+		_a.shieldmaxhealth() == _b.shieldmaxhealth() &&
+		_a.nucleushash() == _b.nucleushash() &&
+		_a.hardwarename() == _b.hardwarename() &&
+		_a.teamname() == _b.teamname() &&
+		_a.squadindex() == _b.squadindex() &&
+		_a.character() == _b.character() &&
+		_a.skin() == _b.skin();
+}
+
+template <typename T>
+bool equal_player_event(const T& _a, const app::liveapi_wire_player_event& _b)
+{
+	return _a.timestamp() == _b.timestamp() &&
+		_a.category() == _b.category() &&
+		_a.has_player() == _b.has_player() && equal(_a.player(), _b.player());
+}
+
+bool equal(const api::PlayerDamaged& _a, const app::liveapi_wire_player_damaged& _b)
+{
+	return _a.timestamp() == _b.timestamp() &&
+		_a.category() == _b.category() &&
+		_a.has_attacker() == _b.has_attacker() && equal(_a.attacker(), _b.attacker()) &&
+		_a.has_victim() == _b.has_victim() && equal(_a.victim(), _b.victim()) &&
+		_a.weapon() == _b.weapon() &&
+		_a.damageinflicted() == _b.damageinflicted();
+}
+
+template <typename T>
+bool equal_inventory(const T& _a, const app::liveapi_wire_inventory& _b)
+{
+	return equal_player_event(_a, _b) && _a.item() == _b.item() && _a.quantity() == _b.quantity();
+}
+
+bool equal(const api::InventoryPickUp& _a, const app::liveapi_wire_inventory& _b) { return equal_inventory(_a, _b); }
+bool equal(const api::InventoryDrop& _a, const app::liveapi_wire_inventory& _b) { return equal_inventory(_a, _b); }
+bool equal(const api::InventoryUse& _a, const app::liveapi_wire_inventory& _b) { return equal_inventory(_a, _b); }
+
+bool equal(const api::WeaponSwitched& _a, const app::liveapi_wire_weapon_switched& _b)
+{
+	return equal_player_event(_a, _b) && _a.oldweapon() == _b.oldweapon() && _a.newweapon() == _b.newweapon();
+}
+
+bool equal(const api::PlayerStatChanged& _a, const app::liveapi_wire_player_stat_changed& _b)
+{
+	return equal_player_event(_a, _b) && _a.statname() == _b.statname() && _a.newvalue() == _b.newvalue();
+}
+
+enum class verify_result {
+	ok,
+	mismatch,
+	event_rejected, // 生成コードでは読めるのに直接デコードがLiveAPIEventで失敗
+	payload_rejected // 生成コードでは読めるのに直接デコードが対象の6種類のどれかで失敗
+};
+
+// 生成コードと直接デコードの結果を比較
+template <typename T, typename W>
+verify_result verify_payload(const google::protobuf::Any& _any)
+{
+	T generated;
+	W wire;
+	bool generated_result = generated.ParseFromString(_any.value());
+	bool wire_result = app::liveapi_wire_parse(_any.value(), wire);
+	if (!wire_result) return generated_result ? verify_result::payload_rejected : verify_result::ok;
+	if (!generated_result || !equal(generated, wire)) return verify_result::mismatch;
+	return verify_result::ok;
+}
+
+verify_result verify_frame(const uint8_t* _data, uint32_t _size, std::string& _name)
+{
+	api::LiveAPIEvent ev;
+	bool generated_result = ev.ParseFromArray(_data, _size);
+
+	app::liveapi_wire_any any;
+	bool has_gamemessage = false;
+	bool wire_result = app::liveapi_wire_parse_event(std::string_view(reinterpret_cast<const char*>(_data), _size), any, has_gamemessage);
+	if (!wire_result) return generated_result ? verify_result::event_rejected : verify_result::ok;
+	if (!generated_result) return verify_result::mismatch;
+	if (ev.has_gamemessage() != has_gamemessage) return verify_result::mismatch;
+	if (!has_gamemessage) return verify_result::ok;
+
+	const auto& gm = ev.gamemessage();
+	_name = gm.type_url();
+	if (gm.type_url() != any.type_url() || gm.value() != any.value()) return verify_result::mismatch;
+
+	if (gm.Is<api::PlayerDamaged>()) return verify_payload<api::PlayerDamaged, app::liveapi_wire_player_damaged>(gm);
+	if (gm.Is<api::InventoryPickUp>()) return verify_payload<api::InventoryPickUp, app::liveapi_wire_inventory>(gm);
+	if (gm.Is<api::InventoryDrop>()) return verify_payload<api::InventoryDrop, app::liveapi_wire_inventory>(gm);
+	if (gm.Is<api::InventoryUse>()) return verify_payload<api::InventoryUse, app::liveapi_wire_inventory>(gm);
+	if (gm.Is<api::WeaponSwitched>()) return verify_payload<api::WeaponSwitched, app::liveapi_wire_weapon_switched>(gm);
+	if (gm.Is<api::PlayerStatChanged>()) return verify_payload<api::PlayerStatChanged, app::liveapi_wire_player_stat_changed>(gm);
+	return verify_result::ok;
+}
+
+bool verify(const std::wstring& _filepath)
+{
+	std::ifstream instream(_filepath, std::ios::in | std::ios::binary);
+	std::vector<uint8_t> buf((std::istreambuf_iterator<char>(instream)), std::istreambuf_iterator<char>());
+
+	size_t count = 0;
+	size_t mismatch = 0;
+	size_t event_rejected = 0;
+	size_t payload_rejected = 0;
+
+	for (size_t i = sizeof(uint64_t) + sizeof(uint64_t); i + sizeof(uint32_t) + sizeof(uint64_t) <= buf.size(); )
+	{
+		uint32_t size = 0;
+		std::memcpy(&size, buf.data() + i, sizeof(size));
+		i += sizeof(size) + sizeof(uint64_t);
+		if (i + size > buf.size()) break;
+
+		std::string name = "";
+		switch (verify_frame(buf.data() + i, size, name))
+		{
+		case verify_result::ok:
+			break;
+		case verify_result::mismatch:
+			std::cerr << "mismatch: frame " << count << " " << name << "\r\n";
+			++mismatch;
+			break;
+		case verify_result::event_rejected:
+			std::cerr << "wire rejected: frame " << count << " (event)\r\n";
+			++event_rejected;
+			break;
+		case verify_result::payload_rejected:
+			std::cerr << "wire rejected: frame " << count << " " << name << "\r\n";
+			++payload_rejected;
+			break;
+		}
+		++count;
+		i += size;
+	}
+	std::cerr << "frames = " << count << ", mismatch = " << mismatch << ", wire rejected / generated ok = " << payload_rejected << " (event " << event_rejected << ")\r\n";
+
+	// 直接デコードで弾かれたものは比較できていないので失敗にする
+	return mismatch == 0 && payload_rejected == 0 && event_rejected == 0;
+}
+
+// 本体と同じくLiveAPIEventと中身を1フレームずつデコードして、ヒープとArenaでの確保回数を比べる
+bool count_allocs(const std::wstring& _filepath)
+{
+	std::ifstream instream(_filepath, std::ios::in | std::ios::binary);
+	std::vector<uint8_t> buf((std::istreambuf_iterator<char>(instream)), std::istreambuf_iterator<char>());
+
+	// core_threadと同じ設定 (64KBの初期ブロック、それを超えた分はヒープ)
+	std::vector<char> block(64 * 1024);
+	google::protobuf::ArenaOptions options;
+	options.initial_block = block.data();
+	options.initial_block_size = block.size();
+	google::protobuf::Arena arena(options);
+
+	size_t count = 0;
+	uint64_t heap_total = 0;
+	uint64_t arena_total = 0;
+
+	for (size_t i = sizeof(uint64_t) + sizeof(uint64_t); i + sizeof(uint32_t) + sizeof(uint64_t) <= buf.size(); )
+	{
+		uint32_t size = 0;
+		std::memcpy(&size, buf.data() + i, sizeof(size));
+		i += sizeof(size) + sizeof(uint64_t);
+		if (i + size > buf.size()) break;
+		const auto data = buf.data() + i;
+		i += size;
+
+		// 中身の型を先に引いておく (初回の記述子の構築は数えない)
+		const google::protobuf::Message* prototype = nullptr;
+		{
+			api::LiveAPIEvent ev;
+			if (!ev.ParseFromArray(data, size) || !ev.has_gamemessage()) continue;
+			const std::string type_url(ev.gamemessage().type_url());
+			const auto desc = google::protobuf::DescriptorPool::generated_pool()->FindMessageTypeByName(type_url.substr(type_url.rfind('/') + 1));
+			if (desc) prototype = google::protobuf::MessageFactory::generated_factory()->GetPrototype(desc);
+		}
+		++count;
+
+		// ヒープ (以前の本体)
+		auto start = heap_alloc_count;
+		{
+			api::LiveAPIEvent ev;
+			ev.ParseFromArray(data, size);
+			if (prototype)
+			{
+				std::unique_ptr<google::protobuf::Message> payload(prototype->New());
+				const auto& value = ev.gamemessage().value();
+				payload->ParseFromArray(value.data(), static_cast<int>(value.size()));
+			}
+		}
+		heap_total += heap_alloc_count - start;
+
+		// Arena (フレーム毎にReset)
+		start = heap_alloc_count;
+		{
+			auto ev = google::protobuf::Arena::Create<api::LiveAPIEvent>(&arena);
+			ev->ParseFromArray(data, size);
+			if (prototype)
+			{
+				auto payload = prototype->New(&arena);
+				const auto& value = ev->gamemessage().value();
+				payload->ParseFromArray(value.data(), static_cast<int>(value.size()));
+			}
+			arena.Reset();
+		}
+		arena_total += heap_alloc_count - start;
+	}
+
+	const double events = count > 0 ? static_cast<double>(count) : 1.0;
+	std::cerr << "events = " << count << "\r\n";
+	std::cerr << "heap allocations = " << heap_total << " (" << heap_total / events << "/event)\r\n";
+	std::cerr << "arena allocations = " << arena_total << " (" << arena_total / events << "/event)\r\n";
+	return count > 0;
+}
 
 void convert(const std::wstring& _filepath)
 {
@@ -77,10 +347,32 @@ int wmain(int _argc, wchar_t *_argv[])
 {
 	if (_argc < 2)
 	{
-		std::cerr << "usage: dump2json.exe <filename> [<filename> ...]\r\n";
+		std::cerr << "usage: dump2json.exe [--verify | --allocs] <filename> [<filename> ...]\r\n";
 		return 1;
 	}
 
+	// --verify: 直接デコードと生成コードの差分検証のみ行う
+	if (std::wstring(_argv[1]) == L"--verify")
+	{
+		int rc = 0;
+		for (int i = 2; i < _argc; ++i)
+		{
+			if (!verify(_argv[i])) rc = 1;
+		}
+		return rc;
+	}
+
+	// --allocs: ヒープとArenaでのデコード時の確保回数を比べる
+	if (std::wstring(_argv[1]) == L"--allocs")
+	{
+		int rc = 0;
+		for (int i = 2; i < _argc; ++i)
+		{
+			if (!count_allocs(_argv[i])) rc = 1;
+		}
+		return rc;
+	}
+
 	for (int i = 1; i < _argc; ++i)
 	{
 		convert(_argv[i]);
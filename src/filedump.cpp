@@ -46,19 +46,19 @@ namespace app {
 
 	filedump::filedump()
 		: thread_(NULL)
+		, event_close_(NULL)
 		, event_in_(NULL)
-		, mtx_in_()
-		, q_in_()
+		, q_in_(FILEDUMP_RING_IN_SIZE)
 	{
 	}
 
 	filedump::~filedump()
 	{
 		stop();
+		if (event_close_) ::CloseHandle(event_close_);
 		if (event_in_) ::CloseHandle(event_in_);
 	}
 
-
 	DWORD WINAPI filedump::proc_common(LPVOID _p)
 	{
 		auto p = reinterpret_cast<filedump*>(_p);
@@ -72,113 +72,128 @@ namespace app {
 		uint64_t total = 0;
 		HANDLE file = INVALID_HANDLE_VALUE;
 
+		enum : DWORD {
+			WAIT_OBJECT_0_CLOSE = WAIT_OBJECT_0,
+			WAIT_OBJECT_0_IN = WAIT_OBJECT_0 + 1
+		};
+
 		HANDLE events[] = {
+			event_close_,
 			event_in_,
 		};
 
 		if (!create_dump_directory())
 		{
+			q_in_.close();
 			return 0;
 		}
 
+		// ファイルのクローズ処理
+		auto close_file = [&]() {
+			if (file == INVALID_HANDLE_VALUE) return;
+
+			// 先頭にシーク
+			if (::SetFilePointer(file, 0, NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER) return;
+
+			// データを書き込み
+			DWORD wsize = 0;
+			if (!::WriteFile(file, &count, sizeof(count), &wsize, NULL)) return;
+			if (!::WriteFile(file, &total, sizeof(total), &wsize, NULL)) return;
+
+			::CloseHandle(file);
+			file = INVALID_HANDLE_VALUE;
+		};
+
 		while (alive)
 		{
 			auto id = ::WaitForMultipleObjects(ARRAYSIZE(events), events, FALSE, INFINITE);
-			if (id == WAIT_OBJECT_0)
+			if (id == WAIT_OBJECT_0_CLOSE)
 			{
-				auto q = pull_q_in();
-				while (q.size() > 0)
-				{
-					bool fileclose = false;
+				// 残っている分を書いてから終了
+				alive = false;
+			}
+			else if (id != WAIT_OBJECT_0_IN)
+			{
+				continue;
+			}
 
-					std::visit(overloaded{
-						[&](filedump_message_in_close&) {
-							alive = false;
-							fileclose = true;
-						},
-						[&](filedump_message_in_reset&) {
-							fileclose = true;
-						},
-						[&](filedump_message_in_append& _m) {
-							auto& data = _m.data;
-							if (data.size() == 0)
-							{
-								return;
-							}
+			auto remain = q_in_.consume([&](filedump_message_in& _msg) {
+				bool fileclose = false;
+
+				std::visit(overloaded{
+					[&](filedump_message_in_reset&) {
+						fileclose = true;
+					},
+					[&](filedump_message_in_append& _m) {
+						auto& data = _m.data;
+						if (data.size() == 0)
+						{
+							return;
+						}
 
-							// ファイルが開かれていない場合は新規作成
+						// ファイルが開かれていない場合は新規作成
+						if (file == INVALID_HANDLE_VALUE)
+						{
+							file = ::CreateFileW(get_dumpname().c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
 							if (file == INVALID_HANDLE_VALUE)
 							{
-								file = ::CreateFileW(get_dumpname().c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-								if (file == INVALID_HANDLE_VALUE)
-								{
-									return;
-								}
-
-								count = 0;
-								total = sizeof(count) + sizeof(total);
-								DWORD wsize = 0;
-								if (!::WriteFile(file, &count, sizeof(count), &wsize, NULL)) return;
-								if (!::WriteFile(file, &total, sizeof(total), &wsize, NULL)) return;
-							}
-
-							DWORD wsize = 0;
-
-							// データのサイズとタイムスタンプを書き込む
-							DWORD dsize = data.size();
-							if (!::WriteFile(file, &dsize, sizeof(dsize), &wsize, NULL))
-							{
-								fileclose = true;
 								return;
 							}
-							total += sizeof(dsize);
 
-							// タイムスタンプを書き込む
-							uint64_t ms = ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-							if (!::WriteFile(file, &ms, sizeof(ms), &wsize, NULL))
-							{
-								fileclose = true;
-								return;
-							}
-							total += sizeof(ms);
+							count = 0;
+							total = sizeof(count) + sizeof(total);
+							DWORD wsize = 0;
+							if (!::WriteFile(file, &count, sizeof(count), &wsize, NULL)) return;
+							if (!::WriteFile(file, &total, sizeof(total), &wsize, NULL)) return;
+						}
 
-							// データを書き込む
-							if (!::WriteFile(file, data.data(), data.size(), &wsize, NULL))
-							{
-								fileclose = true;
-								return;
-							}
-							total += data.size();
+						DWORD wsize = 0;
 
-							// カウントアップ
-							++count;
+						// データのサイズとタイムスタンプを書き込む
+						DWORD dsize = data.size();
+						if (!::WriteFile(file, &dsize, sizeof(dsize), &wsize, NULL))
+						{
+							fileclose = true;
+							return;
 						}
-					}, q.front());
-					q.pop();
+						total += sizeof(dsize);
 
-					// ファイルのクローズ処理
-					if (fileclose)
-					{
-						// 先頭にシーク
-						if (::SetFilePointer(file, 0, NULL, FILE_BEGIN) == INVALID_SET_FILE_POINTER) break;
+						// タイムスタンプを書き込む
+						uint64_t ms = ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+						if (!::WriteFile(file, &ms, sizeof(ms), &wsize, NULL))
+						{
+							fileclose = true;
+							return;
+						}
+						total += sizeof(ms);
 
-						// データを書き込み
-						DWORD wsize = 0;
-						if (!::WriteFile(file, &count, sizeof(count), &wsize, NULL)) break;
-						if (!::WriteFile(file, &total, sizeof(total), &wsize, NULL)) break;
+						// データを書き込む
+						if (!::WriteFile(file, data.data(), data.size(), &wsize, NULL))
+						{
+							fileclose = true;
+							return;
+						}
+						total += data.size();
 
-						::CloseHandle(file);
-						file = INVALID_HANDLE_VALUE;
+						// カウントアップ
+						++count;
 					}
+				}, _msg);
 
-					if (!alive)
-					{
-						break;
-					}
+				if (fileclose)
+				{
+					close_file();
 				}
+				});
+			if (remain)
+			{
+				::SetEvent(event_in_);
 			}
 		}
 
+		q_in_.close();
+		close_file();
+
 		if (file != INVALID_HANDLE_VALUE)
 			::CloseHandle(file);
 
@@ -188,7 +203,12 @@ namespace app {
 	bool filedump::run()
 	{
 		// イベント作成
-		event_in_ = ::CreateEventW(NULL, FALSE, FALSE, NULL);
+		event_close_ = ::CreateEventW(NULL, FALSE, FALSE, NULL);
+		if (event_close_ == NULL)
+		{
+			return false;
+		}
+		event_in_ = ::CreateEventW(NULL, FALSE, TRUE, NULL); // run()前に積まれた分を拾う
 		if (event_in_ == NULL)
 		{
 			return false;
@@ -201,10 +221,10 @@ namespace app {
 
 	void filedump::stop()
 	{
-		// スレッドの停止
+		// スレッドの停止 (coreとは別スレッドから呼ばれるのでキューは使わない)
 		if (thread_ != NULL)
 		{
-			push_in(filedump_message_in_close{});
+			::SetEvent(event_close_);
 			::WaitForSingleObject(thread_, INFINITE);
 			thread_ = NULL;
 		}
@@ -212,26 +232,13 @@ namespace app {
 
 	void filedump::push_in(filedump_message_in&& _msg)
 	{
-		{
-			std::lock_guard<std::mutex> lock(mtx_in_);
-			q_in_.push(std::move(_msg));
-		}
-		if (event_in_)
+		// 空だったときだけ通知
+		if (q_in_.push(std::move(_msg)) && event_in_)
 		{
 			::SetEvent(event_in_);
 		}
 	}
 
-	std::queue<filedump_message_in> filedump::pull_q_in()
-	{
-		std::queue<filedump_message_in> q;
-		{
-			std::lock_guard<std::mutex> lock(mtx_in_);
-			q.swap(q_in_);
-		}
-		return q;
-	}
-
 	void filedump::append(std::vector<uint8_t>&& _data)
 	{
 		push_in(filedump_message_in_append{ std::move(_data) });
@@ -1,18 +1,16 @@
 ﻿#pragma once
 
 #include "common.hpp"
+#include "spsc_ring.hpp"
 
-#include <mutex>
 #include <vector>
-#include <queue>
 #include <cstdint>
 #include <variant>
 
 namespace app {
 
-	struct filedump_message_in_close
-	{
-	};
+	// coreからの入力キューの長さ
+	constexpr size_t FILEDUMP_RING_IN_SIZE = 8192;
 
 	struct filedump_message_in_reset
 	{
@@ -24,7 +22,6 @@ namespace app {
 	};
 
 	using filedump_message_in = std::variant<
-		filedump_message_in_close,
 		filedump_message_in_reset,
 		filedump_message_in_append
 	>;
@@ -32,17 +29,15 @@ namespace app {
 	class filedump {
 	private:
 		HANDLE thread_;
+		HANDLE event_close_;
 		HANDLE event_in_;
-		std::mutex mtx_in_;
-		std::queue<filedump_message_in> q_in_;
+		spsc_ring<filedump_message_in> q_in_; // core -> filedump
 
 		static DWORD WINAPI proc_common(LPVOID);
 		DWORD proc();
 
 		void push_in(filedump_message_in&& _msg);
 
-		std::queue<filedump_message_in> pull_q_in();
-
 	public:
 		filedump();
 		~filedump();
@@ -0,0 +1,258 @@
+﻿#include "item_names.hpp"
+
+#include "webapi.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <type_traits>
+#include <unordered_map>
+
+namespace app {
+namespace {
+
+	struct item_name {
+		std::u8string_view name;
+		uint8_t id;
+	};
+
+	constexpr item_name item_names[] = {
+		/* english */
+		{u8"Syringe", WEBAPI_ITEM_SYRINGE},
+		{u8"Med Kit (Level 2)", WEBAPI_ITEM_MEDKIT},
+		{u8"Shield Cell", WEBAPI_ITEM_SHIELDCELL},
+		{u8"Shield Battery (Level 2)", WEBAPI_ITEM_SHIELDBATTERY},
+		{u8"Phoenix Kit (Level 3)", WEBAPI_ITEM_PHOENIXKIT},
+		{u8"Ultimate Accelerant (Level 2)", WEBAPI_ITEM_ULTIMATEACCELERANT},
+		{u8"Ultimate Accelerant (Level 3)", WEBAPI_ITEM_ULTIMATEACCELERANT},
+		{u8"Frag Grenade", WEBAPI_ITEM_FRAGGRENADE},
+		{u8"Thermite Grenade", WEBAPI_ITEM_THERMITEGRENADE},
+		{u8"Arc Star", WEBAPI_ITEM_ARCSTAR},
+		{u8"Knockdown Shield", WEBAPI_ITEM_KNOCKDOWNSHIELD_LV1},
+		{u8"Knockdown Shield (Level 2)", WEBAPI_ITEM_KNOCKDOWNSHIELD_LV2},
+		{u8"Knockdown Shield (Level 3)", WEBAPI_ITEM_KNOCKDOWNSHIELD_LV3},
+		{u8"Knockdown Shield (Level 4)", WEBAPI_ITEM_KNOCKDOWNSHIELD_LV4},
+		{u8"Backpack", WEBAPI_ITEM_BACKPACK_LV1},
+		{u8"Backpack (Level 2)", WEBAPI_ITEM_BACKPACK_LV2},
+		{u8"Backpack (Level 3)", WEBAPI_ITEM_BACKPACK_LV3},
+		{u8"Backpack (Level 4)", WEBAPI_ITEM_BACKPACK_LV4},
+		{u8"Mobile Respawn Beacon (Level 2)", WEBAPI_ITEM_MOBILERESPAWNBEACON},
+		{u8"Heat Shield (Level 2)", WEBAPI_ITEM_HEATSHIELD},
+		{u8"Evac Tower (Level 2)", WEBAPI_ITEM_EVACTOWER}, // not confimed yet.
+		{u8"Evo Shield", WEBAPI_ITEM_BODYSHIELD_LV1},
+		{u8"Evo Shield (Level 2)", WEBAPI_ITEM_BODYSHIELD_LV2},
+		{u8"Evo Shield (Level 3)", WEBAPI_ITEM_BODYSHIELD_LV3},
+		{u8"Evo Shield (Level 5)", WEBAPI_ITEM_BODYSHIELD_LV5},
+		{u8"Body Shield", WEBAPI_ITEM_BODYSHIELD_LV1},
+		{u8"Body Shield (Level 2)", WEBAPI_ITEM_BODYSHIELD_LV2},
+		{u8"Body Shield (Level 3)", WEBAPI_ITEM_BODYSHIELD_LV3},
+		{u8"Body Shield (Level 4)", WEBAPI_ITEM_BODYSHIELD_LV4},
+		{u8"Shield Core", WEBAPI_ITEM_SHIELDCORE},
+		{u8"Infinite Ammo Amp (Level 3)", WEBAPI_ITEM_AMP_INFINITE_AMMO},
+		{u8"Bottomless Batteries Amp (Level 3)", WEBAPI_ITEM_AMP_BOTTOMLESS_BATTERIES},
+		{u8"Over Armor Amp (Level 3)", WEBAPI_ITEM_AMP_OVER_ARMOR},
+		{u8"Heal Overflow Amp (Level 3)", WEBAPI_ITEM_AMP_HEAL_OVERFLOW},
+		{u8"Power Booster Amp (Level 3)", WEBAPI_ITEM_AMP_POWER_BOOSTER},
+
+		/* 日本語 */
+		{u8"注射器", WEBAPI_ITEM_SYRINGE},
+		{u8"医療キット (Level 2)", WEBAPI_ITEM_MEDKIT},
+		{u8"シールドセル", WEBAPI_ITEM_SHIELDCELL},
+		{u8"シールドバッテリー (Level 2)", WEBAPI_ITEM_SHIELDBATTERY},
+		{u8"フェニックスキット (Level 3)", WEBAPI_ITEM_PHOENIXKIT},
+		{u8"アルティメット促進剤 (Level 2)", WEBAPI_ITEM_ULTIMATEACCELERANT},
+		{u8"アルティメット促進剤 (Level 3)", WEBAPI_ITEM_ULTIMATEACCELERANT},
+		{u8"フラググレネード", WEBAPI_ITEM_FRAGGRENADE},
+		{u8"テルミットグレネード", WEBAPI_ITEM_THERMITEGRENADE},
+		{u8"アークスター", WEBAPI_ITEM_ARCSTAR},
+		{u8"ノックダウンシールド", WEBAPI_ITEM_KNOCKDOWNSHIELD_LV1},
+		{u8"ノックダウンシールド (Level 2)", WEBAPI_ITEM_KNOCKDOWNSHIELD_LV2},
+		{u8"ノックダウンシールド (Level 3)", WEBAPI_ITEM_KNOCKDOWNSHIELD_LV3},
+		{u8"ノックダウンシールド (Level 4)", WEBAPI_ITEM_KNOCKDOWNSHIELD_LV4},
+		{u8"バックパック", WEBAPI_ITEM_BACKPACK_LV1},
+		{u8"バックパック (Level 2)", WEBAPI_ITEM_BACKPACK_LV2},
+		{u8"バックパック (Level 3)", WEBAPI_ITEM_BACKPACK_LV3},
+		{u8"バックパック (Level 4)", WEBAPI_ITEM_BACKPACK_LV4},
+		{u8"モバイルリスポーンビーコン (Level 2)", WEBAPI_ITEM_MOBILERESPAWNBEACON},
+		{u8"ヒートシールド (Level 2)", WEBAPI_ITEM_HEATSHIELD},
+		{u8"脱出タワー (Level 2)", WEBAPI_ITEM_EVACTOWER},
+		{u8"進化式ボディーシールド", WEBAPI_ITEM_BODYSHIELD_LV1},
+		{u8"進化式ボディーシールド (Level 2)", WEBAPI_ITEM_BODYSHIELD_LV2},
+		{u8"進化式ボディーシールド (Level 3)", WEBAPI_ITEM_BODYSHIELD_LV3},
+		{u8"進化式ボディーシールド (Level 5)", WEBAPI_ITEM_BODYSHIELD_LV5},
+		{u8"ボディーシールド", WEBAPI_ITEM_BODYSHIELD_LV1},
+		{u8"ボディーシールド (Level 2)", WEBAPI_ITEM_BODYSHIELD_LV2},
+		{u8"ボディーシールド (Level 3)", WEBAPI_ITEM_BODYSHIELD_LV3},
+		{u8"ボディーシールド (Level 4)", WEBAPI_ITEM_BODYSHIELD_LV4},
+		{u8"シールドコア", WEBAPI_ITEM_SHIELDCORE},
+		{u8"無限弾薬増幅器 (Level 3)", WEBAPI_ITEM_AMP_INFINITE_AMMO},
+		{u8"バッテリー無限増幅器 (Level 3)", WEBAPI_ITEM_AMP_BOTTOMLESS_BATTERIES},
+		{u8"無限バッテリー増幅器 (Level 3)", WEBAPI_ITEM_AMP_BOTTOMLESS_BATTERIES},
+		{u8"オーバーアーマー増幅器 (Level 3)", WEBAPI_ITEM_AMP_OVER_ARMOR},
+		{u8"オーバーフロー回復増幅器 (Level 3)", WEBAPI_ITEM_AMP_HEAL_OVERFLOW},
+		{u8"パワーブースト増幅器 (Level 3)", WEBAPI_ITEM_AMP_POWER_BOOSTER},
+		{u8"パワーブースター増幅器 (Level 3)", WEBAPI_ITEM_AMP_POWER_BOOSTER},
+	};
+
+	constexpr size_t ITEM_NAME_COUNT = std::size(item_names);
+	constexpr size_t ITEM_TABLE_BITS = 10;
+	constexpr size_t ITEM_TABLE_SLOTS = 1 << ITEM_TABLE_BITS; // 名前数の十数倍あれば衝突なしのseedがすぐ見つかる
+
+	constexpr uint64_t mix(uint64_t _x)
+	{
+		_x ^= _x >> 33;
+		_x *= 0xff51afd7ed558ccdull;
+		_x ^= _x >> 33;
+		_x *= 0xc4ceb9fe1a85ec53ull;
+		_x ^= _x >> 33;
+		return _x;
+	}
+
+	template <typename C>
+	constexpr uint64_t load8(std::basic_string_view<C> _s, size_t _pos)
+	{
+		uint64_t v = 0;
+		size_t n = std::min<size_t>(8, _s.size() - _pos);
+		if (std::is_constant_evaluated())
+		{
+			for (size_t i = 0; i < n; ++i) v |= static_cast<uint64_t>(static_cast<uint8_t>(_s[_pos + i])) << (i * 8);
+		}
+		else if (n == 8)
+		{
+			std::memcpy(&v, _s.data() + _pos, 8);
+		}
+		else
+		{
+			std::memcpy(&v, _s.data() + _pos, n);
+		}
+		return v;
+	}
+
+	// 長さと先頭/末尾8byteだけを見る (既知の名前はこれで区別できる、一致判定は全体比較)
+	template <typename C>
+	constexpr uint64_t get_name_hash(std::basic_string_view<C> _s)
+	{
+		uint64_t first = load8(_s, 0);
+		uint64_t last = _s.size() > 8 ? load8(_s, _s.size() - 8) : 0;
+		return mix(_s.size() ^ first ^ (last * 0x9e3779b97f4a7c15ull));
+	}
+
+	constexpr size_t get_slot(uint64_t _hash, uint32_t _seed)
+	{
+		return static_cast<size_t>((_hash * (0x9e3779b97f4a7c15ull + 2ull * _seed)) >> (64 - ITEM_TABLE_BITS));
+	}
+
+	// 衝突しないseedを探した完全ハッシュ表 (slotsは添字+1、0は空)
+	struct item_table {
+		uint32_t seed = 0;
+		size_t min_length = SIZE_MAX;
+		size_t max_length = 0;
+		std::array<uint8_t, ITEM_TABLE_SLOTS> slots{};
+	};
+
+	constexpr item_table build_item_table()
+	{
+		static_assert(ITEM_NAME_COUNT < 0xff);
+
+		std::array<uint64_t, ITEM_NAME_COUNT> hashes{};
+		item_table table;
+		for (size_t i = 0; i < ITEM_NAME_COUNT; ++i)
+		{
+			hashes[i] = get_name_hash(item_names[i].name);
+			if (item_names[i].name.size() < table.min_length) table.min_length = item_names[i].name.size();
+			if (item_names[i].name.size() > table.max_length) table.max_length = item_names[i].name.size();
+		}
+
+		for (uint32_t seed = 0; seed < 1000; ++seed)
+		{
+			std::array<uint64_t, ITEM_TABLE_SLOTS / 64> used{};
+			bool collision = false;
+			for (size_t i = 0; i < ITEM_NAME_COUNT && !collision; ++i)
+			{
+				auto slot = get_slot(hashes[i], seed);
+				if (used[slot / 64] & (1ull << (slot % 64))) collision = true;
+				used[slot / 64] |= 1ull << (slot % 64);
+			}
+			if (collision) continue;
+
+			table.seed = seed;
+			for (size_t i = 0; i < ITEM_NAME_COUNT; ++i)
+			{
+				table.slots[get_slot(hashes[i], seed)] = static_cast<uint8_t>(i + 1);
+			}
+			return table;
+		}
+		table.seed = UINT32_MAX;
+		return table;
+	}
+
+	constexpr item_table table = build_item_table();
+	static_assert(table.seed != UINT32_MAX, "item name table: no collision-free seed");
+
+	bool equal_name(std::u8string_view _a, std::string_view _b)
+	{
+		return _a.size() == _b.size() && std::memcmp(_a.data(), _b.data(), _a.size()) == 0;
+	}
+
+	uint8_t get_builtin_itemid(std::string_view _str)
+	{
+		if (_str.size() < table.min_length || table.max_length < _str.size()) return 0;
+		auto index = table.slots[get_slot(get_name_hash(_str), table.seed)];
+		if (index == 0) return 0;
+		const auto& entry = item_names[index - 1];
+		return equal_name(entry.name, _str) ? entry.id : 0;
+	}
+
+	struct alias_hash {
+		using is_transparent = void;
+		size_t operator()(std::string_view _s) const
+		{
+			return std::hash<std::string_view>{}(_s);
+		}
+	};
+
+	// 言語パックで追加された名前
+	std::unordered_map<std::string, uint8_t, alias_hash, std::equal_to<>> item_aliases;
+}
+
+	uint8_t string_to_itemid(std::string_view _str)
+	{
+		auto id = get_builtin_itemid(_str);
+		if (id != 0 || item_aliases.empty()) return id;
+
+		auto it = item_aliases.find(_str);
+		if (it != item_aliases.end()) return it->second;
+		return 0;
+	}
+
+	std::vector<std::pair<std::string_view, uint8_t>> get_builtin_itemnames()
+	{
+		std::vector<std::pair<std::string_view, uint8_t>> out;
+		out.reserve(ITEM_NAME_COUNT);
+		for (const auto& entry : item_names)
+		{
+			out.emplace_back(std::string_view(reinterpret_cast<const char*>(entry.name.data()), entry.name.size()), entry.id);
+		}
+		return out;
+	}
+
+	bool add_itemid_alias(std::string_view _name, std::string_view _known)
+	{
+		if (_name.size() == 0) return false;
+		auto id = get_builtin_itemid(_known);
+		if (id == 0) return false;
+		if (get_builtin_itemid(_name) != 0) return true; // 既に既知の名前
+		item_aliases.insert_or_assign(std::string(_name), id);
+		return true;
+	}
+
+	size_t add_itemid_aliases(const std::vector<std::pair<std::string, std::string>>& _aliases)
+	{
+		size_t count = 0;
+		for (const auto& [name, known] : _aliases)
+		{
+			if (add_itemid_alias(name, known)) ++count;
+		}
+		return count;
+	}
+}
@@ -0,0 +1,20 @@
+﻿#pragma once
+
+#include "common.hpp"
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace app {
+	// LiveAPIのアイテム名からWEBAPI_ITEM_*を取得 (該当なしは0)
+	uint8_t string_to_itemid(std::string_view _str);
+
+	// 組み込みのアイテム名とID (selfcheckで照合する)
+	std::vector<std::pair<std::string_view, uint8_t>> get_builtin_itemnames();
+
+	// 言語パック: 追加の名前を既知のアイテム名に対応付ける (起動時、core_thread開始前のみ)
+	bool add_itemid_alias(std::string_view _name, std::string_view _known);
+	size_t add_itemid_aliases(const std::vector<std::pair<std::string, std::string>>& _aliases);
+}
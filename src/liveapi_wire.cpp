@@ -0,0 +1,381 @@
+﻿#include "liveapi_wire.hpp"
+
+#include <cstring>
+
+namespace {
+
+	enum : uint8_t {
+		WIRETYPE_VARINT = 0,
+		WIRETYPE_FIXED64 = 1,
+		WIRETYPE_LENGTH_DELIMITED = 2,
+		WIRETYPE_START_GROUP = 3,
+		WIRETYPE_END_GROUP = 4,
+		WIRETYPE_FIXED32 = 5,
+	};
+
+	// 生成コードはproto3のstringをUTF-8検証するので合わせる
+	bool is_valid_utf8(std::string_view _s)
+	{
+		const auto* p = reinterpret_cast<const uint8_t*>(_s.data());
+		const auto* end = p + _s.size();
+		while (p < end)
+		{
+			uint8_t c = *p;
+			if (c < 0x80)
+			{
+				++p;
+				continue;
+			}
+
+			size_t n = 0;
+			uint32_t cp = 0;
+			if ((c & 0xe0) == 0xc0) { n = 1; cp = c & 0x1f; }
+			else if ((c & 0xf0) == 0xe0) { n = 2; cp = c & 0x0f; }
+			else if ((c & 0xf8) == 0xf0) { n = 3; cp = c & 0x07; }
+			else return false;
+
+			if (static_cast<size_t>(end - p) <= n) return false;
+			for (size_t i = 1; i <= n; ++i)
+			{
+				if ((p[i] & 0xc0) != 0x80) return false;
+				cp = (cp << 6) | (p[i] & 0x3f);
+			}
+
+			// 冗長表現、サロゲート、範囲外
+			if (n == 1 && cp < 0x80) return false;
+			if (n == 2 && (cp < 0x800 || (0xd800 <= cp && cp <= 0xdfff))) return false;
+			if (n == 3 && (cp < 0x10000 || cp > 0x10ffff)) return false;
+			p += n + 1;
+		}
+		return true;
+	}
+
+	class wire_reader {
+	private:
+		const uint8_t* p_;
+		const uint8_t* end_;
+
+	public:
+		wire_reader(std::string_view _data)
+			: p_(reinterpret_cast<const uint8_t*>(_data.data()))
+			, end_(reinterpret_cast<const uint8_t*>(_data.data()) + _data.size())
+		{
+		}
+
+		bool eof() const
+		{
+			return p_ >= end_;
+		}
+
+		bool read_varint(uint64_t& _v)
+		{
+			uint64_t v = 0;
+			for (int shift = 0; shift < 70; shift += 7)
+			{
+				if (p_ >= end_) return false;
+				uint8_t b = *p_++;
+				v |= static_cast<uint64_t>(b & 0x7f) << shift;
+				if ((b & 0x80) == 0)
+				{
+					_v = v;
+					return true;
+				}
+			}
+			return false; // 10byteを超えるvarint
+		}
+
+		bool read_tag(uint32_t& _field, uint8_t& _wiretype)
+		{
+			uint64_t tag = 0;
+			if (!read_varint(tag)) return false;
+			if (tag > 0xffffffffull) return false;
+			_field = static_cast<uint32_t>(tag >> 3);
+			_wiretype = static_cast<uint8_t>(tag & 0x07);
+			return _field != 0;
+		}
+
+		bool read_fixed32(uint32_t& _v)
+		{
+			if (end_ - p_ < 4) return false;
+			_v = static_cast<uint32_t>(p_[0]) | (static_cast<uint32_t>(p_[1]) << 8) | (static_cast<uint32_t>(p_[2]) << 16) | (static_cast<uint32_t>(p_[3]) << 24);
+			p_ += 4;
+			return true;
+		}
+
+		bool read_bytes(std::string_view& _v)
+		{
+			uint64_t size = 0;
+			if (!read_varint(size)) return false;
+			if (size > static_cast<uint64_t>(end_ - p_)) return false;
+			_v = std::string_view(reinterpret_cast<const char*>(p_), static_cast<size_t>(size));
+			p_ += size;
+			return true;
+		}
+
+		bool read_string(std::string_view& _v)
+		{
+			return read_bytes(_v) && is_valid_utf8(_v);
+		}
+
+		bool read_uint32(uint32_t& _v)
+		{
+			uint64_t v = 0;
+			if (!read_varint(v)) return false;
+			_v = static_cast<uint32_t>(v);
+			return true;
+		}
+
+		bool read_float(float& _v)
+		{
+			uint32_t u = 0;
+			if (!read_fixed32(u)) return false;
+			std::memcpy(&_v, &u, sizeof(_v));
+			return true;
+		}
+
+		// 未知のフィールド (groupは生成コードにフォールバック)
+		bool skip(uint8_t _wiretype)
+		{
+			switch (_wiretype)
+			{
+			case WIRETYPE_VARINT:
+			{
+				uint64_t v = 0;
+				return read_varint(v);
+			}
+			case WIRETYPE_FIXED64:
+				if (end_ - p_ < 8) return false;
+				p_ += 8;
+				return true;
+			case WIRETYPE_LENGTH_DELIMITED:
+			{
+				std::string_view v;
+				return read_bytes(v);
+			}
+			case WIRETYPE_FIXED32:
+				if (end_ - p_ < 4) return false;
+				p_ += 4;
+				return true;
+			default:
+				return false;
+			}
+		}
+	};
+
+	bool parse_vector3(std::string_view _data, app::liveapi_wire_vector3& _out)
+	{
+		wire_reader r(_data);
+		while (!r.eof())
+		{
+			uint32_t field = 0;
+			uint8_t wiretype = 0;
+			if (!r.read_tag(field, wiretype)) return false;
+			bool result = false;
+			if (wiretype == WIRETYPE_FIXED32 && field == 1) result = r.read_float(_out.x_);
+			else if (wiretype == WIRETYPE_FIXED32 && field == 2) result = r.read_float(_out.y_);
+			else if (wiretype == WIRETYPE_FIXED32 && field == 3) result = r.read_float(_out.z_);
+			else result = r.skip(wiretype);
+			if (!result) return false;
+		}
+		return true;
+	}
+
+	// timestamp(1)/category(2)/player(3)の共通部分
+	bool parse_player_event_field(wire_reader& _r, uint32_t _field, uint8_t _wiretype, app::liveapi_wire_player_event& _out, bool& _result)
+	{
+		if (_field == 1 && _wiretype == WIRETYPE_VARINT)
+		{
+			_result = _r.read_varint(_out.timestamp_);
+			return true;
+		}
+		if (_field == 2 && _wiretype == WIRETYPE_LENGTH_DELIMITED)
+		{
+			_result = _r.read_string(_out.category_);
+			return true;
+		}
+		if (_field == 3 && _wiretype == WIRETYPE_LENGTH_DELIMITED)
+		{
+			std::string_view v;
+			_result = _r.read_bytes(v) && app::liveapi_wire_parse(v, _out.player_);
+			_out.has_player_ = true;
+			return true;
+		}
+		return false;
+	}
+}
+
+namespace app {
+
+	bool liveapi_wire_parse_event(std::string_view _data, liveapi_wire_any& _out, bool& _has_gamemessage)
+	{
+		_has_gamemessage = false;
+		wire_reader r(_data);
+		while (!r.eof())
+		{
+			uint32_t field = 0;
+			uint8_t wiretype = 0;
+			if (!r.read_tag(field, wiretype)) return false;
+			bool result = false;
+			if (field == 3 && wiretype == WIRETYPE_LENGTH_DELIMITED)
+			{
+				// gameMessage (google.protobuf.Any)
+				std::string_view any;
+				result = r.read_bytes(any);
+				if (result)
+				{
+					wire_reader ar(any);
+					while (result && !ar.eof())
+					{
+						uint32_t afield = 0;
+						uint8_t awiretype = 0;
+						if (!ar.read_tag(afield, awiretype)) return false;
+						if (afield == 1 && awiretype == WIRETYPE_LENGTH_DELIMITED) result = ar.read_string(_out.type_url_);
+						else if (afield == 2 && awiretype == WIRETYPE_LENGTH_DELIMITED) result = ar.read_bytes(_out.value_);
+						else result = ar.skip(awiretype);
+					}
+				}
+				_has_gamemessage = true;
+			}
+			else
+			{
+				result = r.skip(wiretype);
+			}
+			if (!result) return false;
+		}
+		return true;
+	}
+
+	bool liveapi_wire_parse(std::string_view _data, liveapi_wire_player& _out)
+	{
+		wire_reader r(_data);
+		while (!r.eof())
+		{
+			uint32_t field = 0;
+			uint8_t wiretype = 0;
+			if (!r.read_tag(field, wiretype)) return false;
+			bool result = false;
+			if (wiretype == WIRETYPE_LENGTH_DELIMITED)
+			{
+				std::string_view v;
+				switch (field)
+				{
+				case 1: result = r.read_string(_out.name_); break;
+				case 3: result = r.read_bytes(v) && parse_vector3(v, _out.pos_); _out.has_pos_ = true; break;
+				case 4: result = r.read_bytes(v) && parse_vector3(v, _out.angles_); _out.has_angles_ = true; break;
+				case 9: result = r.read_string(_out.nucleushash_); break;
+				case 10: result = r.read_string(_out.hardwarename_); break;
+				case 11: result = r.read_string(_out.teamname_); break;
+				case 13: result = r.read_string(_out.character_); break;
+				case 14: result = r.read_string(_out.skin_); break;
+				default: result = r.skip(wiretype); break;
+				}
+			}
+			else if (wiretype == WIRETYPE_VARINT)
+			{
+				switch (field)
+				{
+				case 2: result = r.read_uint32(_out.teamid_); break;
+				case 5: result = r.read_uint32(_out.currenthealth_); break;
+				case 6: result = r.read_uint32(_out.maxhealth_); break;
+				case 7: result = r.read_uint32(_out.shieldhealth_); break;
+				case 8: result = r.read_uint32(_out.shieldmaxhealth_); break;
+				case 12: result = r.read_uint32(_out.squadindex_); break;
+				default: result = r.skip(wiretype); break;
+				}
+			}
+			else
+			{
+				result = r.skip(wiretype);
+			}
+			if (!result) return false;
+		}
+		return true;
+	}
+
+	bool liveapi_wire_parse(std::string_view _data, liveapi_wire_player_damaged& _out)
+	{
+		wire_reader r(_data);
+		while (!r.eof())
+		{
+			uint32_t field = 0;
+			uint8_t wiretype = 0;
+			if (!r.read_tag(field, wiretype)) return false;
+			bool result = false;
+			std::string_view v;
+			if (field == 1 && wiretype == WIRETYPE_VARINT) result = r.read_varint(_out.timestamp_);
+			else if (field == 2 && wiretype == WIRETYPE_LENGTH_DELIMITED) result = r.read_string(_out.category_);
+			else if (field == 3 && wiretype == WIRETYPE_LENGTH_DELIMITED) { result = r.read_bytes(v) && liveapi_wire_parse(v, _out.attacker_); _out.has_attacker_ = true; }
+			else if (field == 4 && wiretype == WIRETYPE_LENGTH_DELIMITED) { result = r.read_bytes(v) && liveapi_wire_parse(v, _out.victim_); _out.has_victim_ = true; }
+			else if (field == 5 && wiretype == WIRETYPE_LENGTH_DELIMITED) result = r.read_string(_out.weapon_);
+			else if (field == 6 && wiretype == WIRETYPE_VARINT) result = r.read_uint32(_out.damageinflicted_);
+			else result = r.skip(wiretype);
+			if (!result) return false;
+		}
+		return true;
+	}
+
+	bool liveapi_wire_parse(std::string_view _data, liveapi_wire_inventory& _out)
+	{
+		wire_reader r(_data);
+		while (!r.eof())
+		{
+			uint32_t field = 0;
+			uint8_t wiretype = 0;
+			if (!r.read_tag(field, wiretype)) return false;
+			bool result = false;
+			if (parse_player_event_field(r, field, wiretype, _out, result)) {}
+			else if (field == 4 && wiretype == WIRETYPE_LENGTH_DELIMITED) result = r.read_string(_out.item_);
+			else if (field == 5 && wiretype == WIRETYPE_VARINT)
+			{
+				uint32_t u = 0;
+				result = r.read_uint32(u);
+				_out.quantity_ = static_cast<int32_t>(u);
+			}
+			else if (field == 6 && wiretype == WIRETYPE_LENGTH_DELIMITED)
+			{
+				// InventoryDrop.extraData (repeated string)
+				std::string_view v;
+				result = r.read_string(v);
+			}
+			else result = r.skip(wiretype);
+			if (!result) return false;
+		}
+		return true;
+	}
+
+	bool liveapi_wire_parse(std::string_view _data, liveapi_wire_weapon_switched& _out)
+	{
+		wire_reader r(_data);
+		while (!r.eof())
+		{
+			uint32_t field = 0;
+			uint8_t wiretype = 0;
+			if (!r.read_tag(field, wiretype)) return false;
+			bool result = false;
+			if (parse_player_event_field(r, field, wiretype, _out, result)) {}
+			else if (field == 4 && wiretype == WIRETYPE_LENGTH_DELIMITED) result = r.read_string(_out.oldweapon_);
+			else if (field == 5 && wiretype == WIRETYPE_LENGTH_DELIMITED) result = r.read_string(_out.newweapon_);
+			else result = r.skip(wiretype);
+			if (!result) return false;
+		}
+		return true;
+	}
+
+	bool liveapi_wire_parse(std::string_view _data, liveapi_wire_player_stat_changed& _out)
+	{
+		wire_reader r(_data);
+		while (!r.eof())
+		{
+			uint32_t field = 0;
+			uint8_t wiretype = 0;
+			if (!r.read_tag(field, wiretype)) return false;
+			bool result = false;
+			if (parse_player_event_field(r, field, wiretype, _out, result)) {}
+			else if (field == 4 && wiretype == WIRETYPE_LENGTH_DELIMITED) result = r.read_string(_out.statname_);
+			else if (field == 5 && wiretype == WIRETYPE_VARINT) result = r.read_uint32(_out.newvalue_);
+			else result = r.skip(wiretype);
+			if (!result) return false;
+		}
+		return true;
+	}
+}
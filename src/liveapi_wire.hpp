@@ -0,0 +1,132 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace app {
+
+	// protobufのwire formatを直接読むLiveAPIデコーダ
+	// 文字列はフレームのバッファを参照するため、フレームより長く保持しないこと
+
+	struct liveapi_wire_any {
+		std::string_view type_url_;
+		std::string_view value_;
+
+		std::string_view type_url() const { return type_url_; }
+		std::string_view value() const { return value_; }
+	};
+
+	struct liveapi_wire_vector3 {
+		float x_ = 0.0f;
+		float y_ = 0.0f;
+		float z_ = 0.0f;
+
+		float x() const { return x_; }
+		float y() const { return y_; }
+		float z() const { return z_; }
+	};
+
+	struct liveapi_wire_player {
+		std::string_view name_;
+		uint32_t teamid_ = 0;
+		liveapi_wire_vector3 pos_;
+		liveapi_wire_vector3 angles_;
+		uint32_t currenthealth_ = 0;
+		uint32_t maxhealth_ = 0;
+		uint32_t shieldhealth_ = 0;
+		uint32_t shieldmaxhealth_ = 0;
+		std::string_view nucleushash_;
+		std::string_view hardwarename_;
+		std::string_view teamname_;
+		uint32_t squadindex_ = 0;
+		std::string_view character_;
+		std::string_view skin_;
+		bool has_pos_ = false;
+		bool has_angles_ = false;
+
+		std::string_view name() const { return name_; }
+		uint32_t teamid() const { return teamid_; }
+		bool has_pos() const { return has_pos_; }
+		const liveapi_wire_vector3& pos() const { return pos_; }
+		bool has_angles() const { return has_angles_; }
+		const liveapi_wire_vector3& angles() const { return angles_; }
+		uint32_t currenthealth() const { return currenthealth_; }
+		uint32_t maxhealth() const { return maxhealth_; }
+		uint32_t shieldhealth() const { return shieldhealth_; }
+		uint32_t shieldmaxhealth() const { return shieldmaxhealth_; }
+		std::string_view nucleushash() const { return nucleushash_; }
+		std::string_view hardwarename() const { return hardwarename_; }
+		std::string_view teamname() const { return teamname_; }
+		uint32_t squadindex() const { return squadindex_; }
+		std::string_view character() const { return character_; }
+		std::string_view skin() const { return skin_; }
+	};
+
+	struct liveapi_wire_player_event {
+		uint64_t timestamp_ = 0;
+		std::string_view category_;
+		liveapi_wire_player player_;
+		bool has_player_ = false;
+
+		uint64_t timestamp() const { return timestamp_; }
+		std::string_view category() const { return category_; }
+		bool has_player() const { return has_player_; }
+		const liveapi_wire_player& player() const { return player_; }
+	};
+
+	struct liveapi_wire_player_damaged {
+		uint64_t timestamp_ = 0;
+		std::string_view category_;
+		liveapi_wire_player attacker_;
+		liveapi_wire_player victim_;
+		std::string_view weapon_;
+		uint32_t damageinflicted_ = 0;
+		bool has_attacker_ = false;
+		bool has_victim_ = false;
+
+		uint64_t timestamp() const { return timestamp_; }
+		std::string_view category() const { return category_; }
+		bool has_attacker() const { return has_attacker_; }
+		const liveapi_wire_player& attacker() const { return attacker_; }
+		bool has_victim() const { return has_victim_; }
+		const liveapi_wire_player& victim() const { return victim_; }
+		std::string_view weapon() const { return weapon_; }
+		uint32_t damageinflicted() const { return damageinflicted_; }
+	};
+
+	// InventoryPickUp/InventoryDrop/InventoryUse共通
+	// InventoryDropのextraData(6)は読み飛ばす
+	struct liveapi_wire_inventory : liveapi_wire_player_event {
+		std::string_view item_;
+		int32_t quantity_ = 0;
+
+		std::string_view item() const { return item_; }
+		int32_t quantity() const { return quantity_; }
+	};
+
+	struct liveapi_wire_weapon_switched : liveapi_wire_player_event {
+		std::string_view oldweapon_;
+		std::string_view newweapon_;
+
+		std::string_view oldweapon() const { return oldweapon_; }
+		std::string_view newweapon() const { return newweapon_; }
+	};
+
+	struct liveapi_wire_player_stat_changed : liveapi_wire_player_event {
+		std::string_view statname_;
+		uint32_t newvalue_ = 0;
+
+		std::string_view statname() const { return statname_; }
+		uint32_t newvalue() const { return newvalue_; }
+	};
+
+	// LiveAPIEventからgameMessageを取り出す
+	bool liveapi_wire_parse_event(std::string_view _data, liveapi_wire_any& _out, bool& _has_gamemessage);
+
+	// 生成コードと同じく、埋め込みメッセージの重複はマージ、スカラーは後勝ち
+	bool liveapi_wire_parse(std::string_view _data, liveapi_wire_player& _out);
+	bool liveapi_wire_parse(std::string_view _data, liveapi_wire_player_damaged& _out);
+	bool liveapi_wire_parse(std::string_view _data, liveapi_wire_inventory& _out);
+	bool liveapi_wire_parse(std::string_view _data, liveapi_wire_weapon_switched& _out);
+	bool liveapi_wire_parse(std::string_view _data, liveapi_wire_player_stat_changed& _out);
+}
@@ -1,5 +1,89 @@
 ﻿#include "livedata.hpp"
 
+#include <deque>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+	struct symbol_hash {
+		using is_transparent = void;
+		size_t operator()(std::string_view _s) const
+		{
+			return std::hash<std::string_view>{}(_s);
+		}
+	};
+
+	struct symbol_table {
+		std::deque<std::string> strings{ "" };
+		std::unordered_map<std::string_view, livedata::symbol, symbol_hash, std::equal_to<>> ids{ { strings.front(), livedata::SYMBOL_EMPTY } };
+	};
+
+	symbol_table& get_symbol_table()
+	{
+		static symbol_table table;
+		return table;
+	}
+}
+
 namespace livedata {
 
+	symbol intern(std::string_view _s)
+	{
+		auto& table = get_symbol_table();
+		auto it = table.ids.find(_s);
+		if (it != table.ids.end()) return it->second;
+
+		// dequeは末尾追加で参照が無効にならない
+		symbol id = static_cast<symbol>(table.strings.size());
+		const auto& s = table.strings.emplace_back(_s);
+		table.ids.emplace(s, id);
+		return id;
+	}
+
+	const std::string& symbol_string(symbol _id)
+	{
+		const auto& table = get_symbol_table();
+		if (_id >= table.strings.size()) return table.strings.front();
+		return table.strings.at(_id);
+	}
+
+	uint8_t game::slot(uint8_t _teamid, uint8_t _squadindex) const
+	{
+		const auto& t = teams.at(_teamid);
+		if (_squadindex >= t.size) throw std::out_of_range("invalid squadindex");
+		return t.slots[_squadindex];
+	}
+
+	player& game::get_player(uint8_t _teamid, uint8_t _squadindex)
+	{
+		return players[slot(_teamid, _squadindex)];
+	}
+
+	const player& game::get_player(uint8_t _teamid, uint8_t _squadindex) const
+	{
+		return players[slot(_teamid, _squadindex)];
+	}
+
+	uint8_t game::add_player(uint8_t _teamid)
+	{
+		auto& t = teams.at(_teamid);
+		if (t.size >= TEAM_PLAYER_MAX || player_count >= PLAYER_MAX) return SLOT_INVALID;
+
+		// スロットは試合中に再利用しない
+		uint8_t slot = player_count++;
+		t.slots[t.size] = slot;
+		slot_teamid[slot] = _teamid;
+		slot_squadindex[slot] = t.size;
+		return t.size++;
+	}
+
+	void game::clear_players()
+	{
+		for (size_t i = 0; i < team_count; ++i) teams[i] = {};
+		for (size_t i = 0; i < player_count; ++i) players[i] = {};
+		team_count = 0;
+		player_count = 0;
+		stats = {};
+	}
 }
@@ -2,12 +2,28 @@
 
 #include "common.hpp"
 
+#include <array>
 #include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace livedata {
 
+	// 文字列シンボル (IDはプロセス終了まで不変、0は空文字列)
+	// core_threadからのみ使用する
+	using symbol = uint32_t;
+	constexpr symbol SYMBOL_EMPTY = 0;
+
+	symbol intern(std::string_view _s);
+	const std::string& symbol_string(symbol _id);
+
+	// 試合中に確保し直さない固定容量
+	constexpr size_t TEAM_MAX = 256; // teamid(uint8_t) 0:未アサイン 1:オブザーバー 2～:チーム
+	constexpr size_t TEAM_PLAYER_MAX = 32; // 1チームの最大人数 (オブザーバー含む)
+	constexpr size_t PLAYER_MAX = 255; // 全チーム合計
+	constexpr uint8_t SLOT_INVALID = 0xff;
+
 	class user_event {
 		uint64_t timestamp;
 		uint64_t receive_timestamp;
@@ -40,38 +56,44 @@ namespace livedata {
 
 	struct player {
 		std::string id = "";
-		std::string name = "";
-		std::string character = "";
+		symbol name = SYMBOL_EMPTY;
+		symbol character = SYMBOL_EMPTY;
 		uint8_t state = 0;
 		int32_t level = 0; // level 0～
-		uint32_t kills = 0;
 		uint32_t assists = 0;
 		uint32_t knockdowns = 0;
 		uint32_t revives = 0;
 		uint32_t respawns = 0;
-		uint32_t damage_dealt = 0;
-		uint32_t damage_taken = 0;
-		uint32_t hp = 0;
-		uint32_t hp_max = 0;
-		uint32_t shield = 0;
-		uint32_t shield_max = 0;
 		uint32_t killed = 0; // TDM等用
-		float x = 0.0f;
-		float y = 0.0f;
-		float angle = 0.0f;
 		bool disconnected = false;
 		bool canreconnect = false;
 		bool characterselected = false;
 		items items;
 		std::map<int32_t, perkinfo> perks{};
-		std::string weapon;
+		symbol weapon = SYMBOL_EMPTY;
+	};
+
+	// 頻繁に更新・走査する値はスロット順の配列で持つ
+	struct player_stats {
+		std::array<uint32_t, PLAYER_MAX> hp{};
+		std::array<uint32_t, PLAYER_MAX> hp_max{};
+		std::array<uint32_t, PLAYER_MAX> shield{};
+		std::array<uint32_t, PLAYER_MAX> shield_max{};
+		std::array<uint32_t, PLAYER_MAX> kills{};
+		std::array<uint32_t, PLAYER_MAX> damage_dealt{};
+		std::array<uint32_t, PLAYER_MAX> damage_taken{};
+		std::array<float, PLAYER_MAX> x{};
+		std::array<float, PLAYER_MAX> y{};
+		std::array<float, PLAYER_MAX> angle{};
 	};
 
 	struct team {
-		std::vector<player> players{};
-		std::string name = "";
+		std::array<uint8_t, TEAM_PLAYER_MAX> slots{}; // squadindex -> スロット
+		uint8_t size = 0;
+		symbol name = SYMBOL_EMPTY;
 		uint32_t place = 0;
 		bool eliminated = false;
+		bool full_logged = false; // 満員のエラーは試合中1回だけ出す
 	};
 
 	struct ringinfo {
@@ -99,7 +121,13 @@ namespace livedata {
 	};
 
 	struct game {
-		std::vector<team> teams{};
+		std::array<team, TEAM_MAX> teams{};
+		uint16_t team_count = 0; // 使用中の最大teamid+1
+		std::array<player, PLAYER_MAX> players{};
+		std::array<uint8_t, PLAYER_MAX> slot_teamid{}; // スロット -> teamid
+		std::array<uint8_t, PLAYER_MAX> slot_squadindex{}; // スロット -> squadindex
+		uint8_t player_count = 0;
+		player_stats stats{};
 		std::string matchendreason = "";
 		std::string gamestate = "";
 		std::string map = "";
@@ -114,6 +142,15 @@ namespace livedata {
 		std::vector<ringinfo> rings{};
 		loadout_info loadout;
 		std::map<uint32_t, carepackageinfo> carepackages{};
+
+		// squadindexからスロットを引く (範囲外はstd::out_of_range)
+		uint8_t slot(uint8_t _teamid, uint8_t _squadindex) const;
+		player& get_player(uint8_t _teamid, uint8_t _squadindex);
+		const player& get_player(uint8_t _teamid, uint8_t _squadindex) const;
+
+		// 空きスロットを割り当ててsquadindexを返す、空きが無い場合はSLOT_INVALID
+		uint8_t add_player(uint8_t _teamid);
+		void clear_players();
 	};
 
 	/* 保存するリザルト */
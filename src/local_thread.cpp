@@ -610,9 +610,8 @@ namespace app {
 		, event_close_(NULL)
 		, event_in_(NULL)
 		, event_out_(NULL)
-		, mtx_in_()
 		, mtx_out_()
-		, q_in_()
+		, q_in_(LOCAL_RING_IN_SIZE)
 		, q_out_()
 		, path_(get_data_directory())
 		, tournament_(path_)
@@ -663,15 +662,16 @@ namespace app {
 			}
 			else if (id == WAIT_OBJECT_0_IN)
 			{
-				auto q = pull_q_in();
-				while (q.size() > 0)
+				if (q_in_.consume([&](local_message& _msg) {
+					proc_message(std::move(_msg));
+					}))
 				{
-					proc_message(std::move(q.front()));
-					q.pop();
+					::SetEvent(event_in_);
 				}
 			}
 		}
 
+		q_in_.close();
 		log(logid_, L"Info: thread end.");
 
 		return 0;
@@ -944,11 +944,11 @@ namespace app {
 
 	void local_thread::push_in(local_message&& _msg)
 	{
+		// 空だったときだけ通知
+		if (q_in_.push(std::move(_msg)))
 		{
-			std::lock_guard<std::mutex> lock(mtx_in_);
-			q_in_.push(std::move(_msg));
+			::SetEvent(event_in_);
 		}
-		::SetEvent(event_in_);
 	}
 
 	void local_thread::push_out(local_message&& _msg)
@@ -960,16 +960,6 @@ namespace app {
 		::SetEvent(event_out_);
 	}
 
-	std::queue<local_message> local_thread::pull_q_in()
-	{
-		std::queue<local_message> q;
-		{
-			std::lock_guard<std::mutex> lock(mtx_in_);
-			q.swap(q_in_);
-		}
-		return q;
-	}
-
 	std::queue<local_message> local_thread::pull_q_out()
 	{
 		std::queue<local_message> q;
@@ -989,7 +979,7 @@ namespace app {
 			log(logid_, L"Error: CreateEvent() failed.");
 			return false;
 		}
-		event_in_ = ::CreateEventW(NULL, FALSE, FALSE, NULL);
+		event_in_ = ::CreateEventW(NULL, FALSE, TRUE, NULL); // run()前に積まれた分を拾う
 		if (event_in_ == NULL)
 		{
 			log(logid_, L"Error: CreateEvent() failed.");
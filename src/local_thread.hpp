@@ -3,6 +3,7 @@
 #include "common.hpp"
 
 #include "livedata.hpp"
+#include "spsc_ring.hpp"
 
 #include <mutex>
 #include <string>
@@ -238,6 +239,9 @@ namespace app
 		local_message_body data;
 	};
 
+	// coreからの入力キューの長さ
+	constexpr size_t LOCAL_RING_IN_SIZE = 1024;
+
 	class local_thread
 	{
 	private:
@@ -246,9 +250,8 @@ namespace app
 		HANDLE event_close_;
 		HANDLE event_in_;
 		HANDLE event_out_;
-		std::mutex mtx_in_;
 		std::mutex mtx_out_;
-		std::queue<local_message> q_in_;
+		spsc_ring<local_message> q_in_; // core -> local
 		std::queue<local_message> q_out_;
 		std::wstring path_;
 		local_tournament_data tournament_;
@@ -262,7 +265,6 @@ namespace app
 
 		void push_in(local_message&& _msg);
 		void push_out(local_message&& _msg);
-		std::queue<local_message> pull_q_in();
 
 	public:
 		local_thread(DWORD _logid);
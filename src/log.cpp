@@ -11,8 +11,13 @@
 #include <chrono>
 #include <format>
 
+#ifndef _WIN32
+#include <cstdio>
+#endif
+
 namespace {
 
+#ifdef _WIN32
 	std::mutex mtx;
 	std::queue<std::tuple<DWORD, std::chrono::system_clock::time_point, std::wstring>> log_queue;
 	HANDLE event_log = nullptr;
@@ -48,6 +53,7 @@ namespace {
 	{
 		return get_log_directory() + L"\\" + get_file_timestring() + L".log";
 	}
+#endif
 
 	std::wstring get_id_string(DWORD _id)
 	{
@@ -73,6 +79,7 @@ namespace {
 
 namespace app {
 
+#ifdef _WIN32
 	void log(DWORD _id, const std::wstring& _str)
 	{
 		if (logdir_exists)
@@ -205,5 +212,13 @@ namespace app {
 			thread_ = NULL;
 		}
 	}
-
+#else
+	// Windows以外はlog_threadを使わず標準エラーに出す
+	void log(DWORD _id, const std::wstring& _str)
+	{
+		static std::mutex mtx;
+		std::lock_guard<std::mutex> lock(mtx);
+		std::fprintf(stderr, "%s %s\n", ws_to_s(get_id_string(_id)).c_str(), ws_to_s(_str).c_str());
+	}
+#endif
 }
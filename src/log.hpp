@@ -16,6 +16,7 @@ namespace app {
 
 	void log(DWORD _id, const std::wstring& _str);
 
+#ifdef _WIN32
 	class log_thread
 	{
 	private:
@@ -40,4 +41,5 @@ namespace app {
 		bool run();
 		void stop();
 	};
+#endif
 }
@@ -1,6 +1,7 @@
 ﻿#include "main_window.hpp"
 
 #include "log.hpp"
+#include "item_names.hpp"
 
 #include "utils.hpp"
 #include "resource.hpp"
@@ -31,6 +32,12 @@ namespace
 			mi.fState = MFS_UNCHECKED;
 		::InsertMenuItemW(_menu, -1, TRUE, &mi);
 	}
+
+	// 読込バッファ(使用中/プール)と送信待ちのKB表示
+	std::wstring get_buffer_stats_string(uint64_t _rbuf_bytes, uint64_t _pool_bytes, uint64_t _queued_bytes)
+	{
+		return L" (rbuf: " + std::to_wstring(_rbuf_bytes / 1024) + L"KB, pool: " + std::to_wstring(_pool_bytes / 1024) + L"KB, queued: " + std::to_wstring(_queued_bytes / 1024) + L"KB)";
+	}
 }
 
 namespace app
@@ -41,7 +48,6 @@ namespace app
 	constexpr UINT TIMER_ID_PING = 1;
 	constexpr UINT TIMER_ID_CAPTURE = 2;
 	constexpr UINT TIMER_ID_STATS = 3;
-	constexpr UINT TIMER_ID_LIVEAPI_QUEUECHECK = 4;
 
 	const wchar_t* main_window::window_class_ = L"apexliveapi_proxy-mainwindow";
 	const wchar_t* main_window::window_title_ = L"apexliveapi_proxy";
@@ -56,7 +62,7 @@ namespace app
 		, items_({})
 		, font_(nullptr)
 		, ini_()
-		, core_thread_(ini_.get_liveapi_ipaddress(), ini_.get_liveapi_port(), ini_.get_webapi_ipaddress(), ini_.get_webapi_port(), ini_.get_webapi_maxconnection())
+		, core_thread_(ini_.get_liveapi_ipaddress(), ini_.get_liveapi_port(), ini_.get_webapi_ipaddress(), ini_.get_webapi_port(), ini_.get_webapi_maxconnection(), ini_.get_webapi_flush_interval(), ini_.get_webapi_tick_rate(), ini_.get_webapi_send_budget(), ini_.get_webapi_send_limit(), ini_.get_webapi_workers(), ini_.get_liveapi_ignore())
 		, duplication_thread_()
 		, current_tab_(0)
 		, frame_rect_({ 0 })
@@ -258,6 +264,13 @@ namespace app
 				top += 12 + 5;
 			}
 
+			// アイテム名の言語パック
+			{
+				auto aliases = ini_.get_item_aliases();
+				auto count = add_itemid_aliases(aliases);
+				if (aliases.size() > 0) log(LOG_CORE, std::format(L"Info: item name aliases loaded. ({}/{})", count, aliases.size()));
+			}
+
 			// スレッド開始
 			if (!core_thread_.run(window_)) return -1;
 			if (!duplication_thread_.run(window_)) return -1;
@@ -270,7 +283,6 @@ namespace app
 			::SetTimer(window_, TIMER_ID_PING, 20000, nullptr); // 20s
 			::SetTimer(window_, TIMER_ID_CAPTURE, 100, nullptr); // 100ms
 			::SetTimer(window_, TIMER_ID_STATS, 1000, nullptr); // 1s
-			::SetTimer(window_, TIMER_ID_LIVEAPI_QUEUECHECK, 100, nullptr); // 100ms
 
 			return 0;
 		}
@@ -383,9 +395,6 @@ namespace app
 				duplication_thread_.get_stats();
 				core_thread_.get_stats();
 				return 0;
-			case TIMER_ID_LIVEAPI_QUEUECHECK:
-				core_thread_.liveapi_queuecheck();
-				return 0;
 			}
 			break;
 		}
@@ -455,12 +464,12 @@ namespace app
 	{
 		std::visit(overloaded{
 			[&](core_message_out_liveapi_stats&& _m) {
-				::SetWindowTextW(items_.at(2), (L"conn count: " + std::to_wstring(_m.conn_count)).c_str());
+				::SetWindowTextW(items_.at(2), (L"conn count: " + std::to_wstring(_m.conn_count) + get_buffer_stats_string(_m.rbuf_bytes, _m.pool_bytes, _m.queued_bytes)).c_str());
 				::SetWindowTextW(items_.at(3), (L"recv count: " + std::to_wstring(_m.recv_count)).c_str());
-				::SetWindowTextW(items_.at(4), (L"send count: " + std::to_wstring(_m.send_count)).c_str());
+				::SetWindowTextW(items_.at(4), (L"send count: " + std::to_wstring(_m.send_count) + L" (queue: " + std::to_wstring(_m.request_queued) + L", wait: " + std::to_wstring(_m.request_wait_avg) + L"/" + std::to_wstring(_m.request_wait_max) + L"ms, coalesced: " + std::to_wstring(_m.request_coalesced) + L")").c_str());
 			},
 			[&](core_message_out_webapi_stats&& _m) {
-				::SetWindowTextW(items_.at(7), (L"conn count: " + std::to_wstring(_m.conn_count)).c_str());
+				::SetWindowTextW(items_.at(7), (L"conn count: " + std::to_wstring(_m.conn_count) + get_buffer_stats_string(_m.rbuf_bytes, _m.pool_bytes, _m.queued_bytes)).c_str());
 				::SetWindowTextW(items_.at(8), (L"recv count: " + std::to_wstring(_m.recv_count)).c_str());
 				::SetWindowTextW(items_.at(9), (L"send count: " + std::to_wstring(_m.send_count)).c_str());
 			},
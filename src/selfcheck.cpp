@@ -0,0 +1,744 @@
+﻿// 本体の部品単位の検証とベンチマーク
+//   selfcheck [--bench] [<suite> ...] (suite省略時は全部、失敗があれば1を返す)
+//   Linux: g++ -std=c++20 -O2 -I src src/selfcheck.cpp src/websocket_server.cpp src/sha1.cpp src/log.cpp src/utils.cpp src/item_names.cpp -lpthread
+//   ringはThreadSanitizerでも回す (上に -O1 -g -fsanitize=thread を足して selfcheck ring)
+#include "item_names.hpp"
+#include "log.hpp"
+#include "sha1.hpp"
+#include "spsc_ring.hpp"
+#include "webapi.hpp"
+#include "websocket_server.hpp"
+#include "websocket_thread.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace {
+
+	double elapsed(std::chrono::steady_clock::time_point _start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count();
+	}
+
+	void unmask_reference(uint8_t* _p, size_t _n, const std::array<uint8_t, 4>& _key, uint64_t _phase)
+	{
+		for (size_t i = 0; i < _n; ++i) _p[i] ^= _key[(_phase + i) % 4];
+	}
+
+	std::vector<uint8_t> make_frame(const std::vector<uint8_t>& _payload, bool _mask, const std::array<uint8_t, 4>& _key)
+	{
+		std::vector<uint8_t> f;
+		const uint8_t m = _mask ? 0x80 : 0;
+		const uint64_t n = _payload.size();
+		f.push_back(0x82);
+		if (n < 0x7e)
+		{
+			f.push_back(m | static_cast<uint8_t>(n));
+		}
+		else if (n <= 0xffff)
+		{
+			f.push_back(m | 0x7e);
+			f.push_back(static_cast<uint8_t>(n >> 8));
+			f.push_back(static_cast<uint8_t>(n));
+		}
+		else
+		{
+			f.push_back(m | 0x7f);
+			for (int i = 7; i >= 0; --i) f.push_back(static_cast<uint8_t>(n >> (i * 8)));
+		}
+		if (_mask) f.insert(f.end(), _key.begin(), _key.end());
+		const auto head = f.size();
+		f.insert(f.end(), _payload.begin(), _payload.end());
+		if (_mask) unmask_reference(f.data() + head, n, _key, 0);
+		return f;
+	}
+
+	// ws_unmask: 長さ、開始位置のずれ、_phaseを変えて1バイトずつのXORと比較
+	bool check_unmask(std::mt19937& _rng)
+	{
+		for (int it = 0; it < 20000; ++it)
+		{
+			const size_t n = _rng() % 300;
+			const size_t offset = _rng() % 32;
+			const uint64_t phase = _rng() % 8;
+			const std::array<uint8_t, 4> key = { uint8_t(_rng()), uint8_t(_rng()), uint8_t(_rng()), uint8_t(_rng()) };
+			std::vector<uint8_t> a(offset + n);
+			for (auto& b : a) b = static_cast<uint8_t>(_rng());
+			auto b = a;
+			app::ws_unmask(a.data() + offset, n, key, phase);
+			unmask_reference(b.data() + offset, n, key, phase);
+			if (a != b)
+			{
+				std::cerr << "frame: ws_unmask mismatch n=" << n << " offset=" << offset << " phase=" << phase << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// 分割フレーム: 7bit/16bit/64bit長、mask有無のフレームをランダムな大きさに切って順に流し込む
+	bool check_split_frame(std::mt19937& _rng)
+	{
+		constexpr size_t boundary[] = { 0, 1, 125, 126, 127, 0xffff, 0x10000 };
+		for (int it = 0; it < 6000; ++it)
+		{
+			size_t plen = 0;
+			switch (it % 4)
+			{
+			case 0: plen = boundary[_rng() % std::size(boundary)]; break;
+			case 1: plen = _rng() % 0x7e; break;
+			case 2: plen = 0x7e + _rng() % (0x10000 - 0x7e); break;
+			default: plen = 0x10000 + _rng() % 8000; break;
+			}
+			const bool mask = (_rng() & 1) != 0;
+			const std::array<uint8_t, 4> key = { uint8_t(_rng()), uint8_t(_rng()), uint8_t(_rng()), uint8_t(_rng()) };
+			std::vector<uint8_t> payload(plen);
+			for (auto& b : payload) b = static_cast<uint8_t>(_rng());
+
+			auto f = make_frame(payload, mask, key);
+			const size_t extra = _rng() % 5; // 次のフレームの先頭 (remainで返るはず)
+			for (size_t i = 0; i < extra; ++i) f.push_back(0xee);
+
+			// 小さく刻むのは短いフレームだけ (長いフレームは回数が増えすぎる)
+			const size_t maxchunk = (plen < 0x1000 && (_rng() & 1)) ? 7 : 40000;
+			app::wspacket packet;
+			size_t pos = 0;
+			size_t remain = 0;
+			bool done = false;
+			while (!done)
+			{
+				if (pos >= f.size())
+				{
+					std::cerr << "frame: not completed it=" << it << " plen=" << plen << "\n";
+					return false;
+				}
+				const size_t chunk = std::min(f.size() - pos, 1 + _rng() % maxchunk);
+				std::vector<uint8_t> in(f.begin() + pos, f.begin() + pos + chunk);
+				done = packet.parse(in, in.size(), 0, remain);
+				if (!done && remain != 0)
+				{
+					std::cerr << "frame: remain before completion it=" << it << "\n";
+					return false;
+				}
+				pos += chunk - remain;
+			}
+			if (pos != f.size() - extra || !packet.filled() || *packet.data != payload)
+			{
+				std::cerr << "frame: mismatch it=" << it << " plen=" << plen << " mask=" << mask << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool check_frame()
+	{
+		std::mt19937 rng(1);
+		return check_unmask(rng) && check_split_frame(rng);
+	}
+
+	void bench_frame()
+	{
+		constexpr size_t size = 8 * 1024 * 1024;
+		constexpr int loops = 20;
+		const std::array<uint8_t, 4> key = { 0x12, 0x34, 0x56, 0x78 };
+		std::vector<uint8_t> buf(size, 0x5a);
+
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < loops; ++i) unmask_reference(buf.data(), buf.size(), key, i);
+		const double scalar = elapsed(start);
+
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < loops; ++i) app::ws_unmask(buf.data(), buf.size(), key, i);
+		const double simd = elapsed(start);
+
+		// 8MBのmask付きフレームを丸ごと (コピー + unmask)
+		std::vector<uint8_t> payload(size, 0x5a);
+		const auto f = make_frame(payload, true, key);
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < loops; ++i)
+		{
+			app::wspacket packet;
+			size_t remain = 0;
+			packet.parse(f, f.size(), 0, remain);
+		}
+		const double parse = elapsed(start);
+
+		const double mb = static_cast<double>(size) * loops / (1024 * 1024);
+		std::cout << "frame: unmask scalar " << static_cast<uint64_t>(mb / scalar) << " MB/s, ws_unmask " << static_cast<uint64_t>(mb / simd) << " MB/s, parse " << static_cast<uint64_t>(mb / parse) << " MB/s\n";
+	}
+
+	std::string to_hex(const app::sha1_t& _sha1)
+	{
+		constexpr char digits[] = "0123456789abcdef";
+		std::string out;
+		for (const auto b : _sha1)
+		{
+			out.push_back(digits[b >> 4]);
+			out.push_back(digits[b & 0x0f]);
+		}
+		return out;
+	}
+
+	// FIPS 180の例 (一括と、ブロック境界をまたいで分けて渡した場合)
+	bool check_sha1()
+	{
+		struct {
+			std::string in;
+			std::string_view hex;
+		} const vectors[] = {
+			{ "", "da39a3ee5e6b4b0d3255bfef95601890afd80709" },
+			{ "abc", "a9993e364706816aba3e25717850c26c9cd0d89d" },
+			{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "84983e441c3bd26ebaae4aa1f95129e5e54670f1" },
+			{ std::string(1000000, 'a'), "34aa973cd4c4daa4f61eeb2bdbad27316534016f" },
+		};
+		for (const auto& v : vectors)
+		{
+			app::sha1_t sha1;
+			if (!app::get_sha1(v.in, sha1) || to_hex(sha1) != v.hex)
+			{
+				std::cerr << "handshake: sha1 mismatch len=" << v.in.size() << "\n";
+				return false;
+			}
+			for (size_t step : { 1, 3, 63, 64, 65 })
+			{
+				if (v.in.size() > 1000 && step < 63) continue;
+				app::sha1_context ctx;
+				for (size_t i = 0; i < v.in.size(); i += step) ctx.update(std::string_view(v.in).substr(i, step));
+				ctx.finish(sha1);
+				if (to_hex(sha1) != v.hex)
+				{
+					std::cerr << "handshake: sha1 mismatch len=" << v.in.size() << " step=" << step << "\n";
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	bool check_accept_key()
+	{
+		// RFC 6455 1.3
+		app::sha1_base64_t b64;
+		app::ws_accept_key("dGhlIHNhbXBsZSBub25jZQ==", b64);
+		if (std::string_view(b64.data(), b64.size()) != "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=")
+		{
+			std::cerr << "handshake: accept key mismatch " << std::string_view(b64.data(), b64.size()) << "\n";
+			return false;
+		}
+		return true;
+	}
+
+	bool check_request()
+	{
+		struct {
+			std::string_view request;
+			std::string_view key; // 空は失敗するはず
+		} const cases[] = {
+			{ "GET /chat HTTP/1.1\r\nHost: localhost\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\r\n", "dGhlIHNhbXBsZSBub25jZQ==" },
+			{ "GET /chat HTTP/1.1\nHost: localhost\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\n\n", "dGhlIHNhbXBsZSBub25jZQ==" },
+			{ "GET /chat HTTP/1.1\r\nHost: localhost\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n\n", "dGhlIHNhbXBsZSBub25jZQ==" },
+			{ "GET / HTTP/1.1\r\nsec-websocket-key: abc\r\n\r\n", "abc" },
+			{ "GET / HTTP/1.1\r\nSEC-WEBSOCKET-KEY:abc\r\n\r\n", "abc" },
+			{ "GET / HTTP/1.1\r\nSec-WebSocket-Key: \t abc \t\r\n\r\n", "abc" },
+			{ "GET / HTTP/1.1\r\nSec-WebSocket-Key: abc", "abc" }, // 空行なし
+			{ "GET / HTTP/1.1\r\nHost: localhost\r\n\r\nSec-WebSocket-Key: abc\r\n\r\n", "" }, // 空行より後は見ない
+			{ "GET / HTTP/1.1\r\nSec-WebSocket-Key-X: abc\r\n\r\n", "" },
+			{ "GET / HTTP/1.1\r\nSec-WebSocket-Key\r\n\r\n", "" },
+			{ "GET / HTTP/1.1\r\nSec-WebSocket-Key: \r\n\r\n", "" },
+			{ "GET / HTTP/1.1\r\nSec-WebSocket-Key: ab\x01c\r\n\r\n", "" },
+			{ "POST / HTTP/1.1\r\nSec-WebSocket-Key: abc\r\n\r\n", "" },
+			{ "GET / HTTP/1.0\r\nSec-WebSocket-Key: abc\r\n\r\n", "" },
+			{ "GET /\r\nSec-WebSocket-Key: abc\r\n\r\n", "" },
+			{ "GET  / HTTP/1.1\r\nSec-WebSocket-Key: abc\r\n\r\n", "" },
+			{ "GET / HTTP/1.1 x\r\nSec-WebSocket-Key: abc\r\n\r\n", "" },
+			{ "Sec-WebSocket-Key: abc\r\n\r\n", "" },
+			{ "\r\nGET / HTTP/1.1\r\nSec-WebSocket-Key: abc\r\n\r\n", "" },
+			{ "", "" },
+		};
+		bool ok = true;
+		for (size_t i = 0; i < std::size(cases); ++i)
+		{
+			const auto& c = cases[i];
+			std::string_view key;
+			const bool result = app::parse_ws_handshake(c.request, key, app::LOG_WEBAPI);
+			if (result != (c.key.size() > 0) || (result && key != c.key))
+			{
+				std::cerr << "handshake: request case " << i << " result=" << result << " key=" << key << "\n";
+				ok = false;
+			}
+		}
+		return ok;
+	}
+
+	bool check_handshake()
+	{
+		return check_sha1() && check_accept_key() && check_request();
+	}
+
+	// 自動リセットのイベント (本体のSetEvent/eventfdの代わり)
+	class event_t {
+	private:
+		std::mutex mtx_;
+		std::condition_variable cv_;
+		bool signaled_ = false;
+
+	public:
+		void set()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mtx_);
+				signaled_ = true;
+			}
+			cv_.notify_one();
+		}
+
+		void wait()
+		{
+			std::unique_lock<std::mutex> lock(mtx_);
+			cv_.wait(lock, [this] { return signaled_; });
+			signaled_ = false;
+		}
+	};
+
+	// spsc_ring以前の形 (push毎にロックして通知、受け取り側はswapでまとめて取る)
+	template <typename T>
+	class mutex_queue {
+	private:
+		std::mutex mtx_;
+		std::queue<T> q_;
+
+	public:
+		event_t event;
+
+		void push(T&& _value)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mtx_);
+				q_.push(std::move(_value));
+			}
+			event.set();
+		}
+
+		template <typename F>
+		void consume(F&& _func)
+		{
+			std::queue<T> q;
+			{
+				std::lock_guard<std::mutex> lock(mtx_);
+				q.swap(q_);
+			}
+			for (; q.size() > 0; q.pop()) _func(q.front());
+		}
+	};
+
+	// 本体と同じ使い方 (空から最初の1件だけ通知、取り残しがあれば自分で起こし直す)
+	template <typename T>
+	class ring_queue {
+	private:
+		app::spsc_ring<T> ring_;
+
+	public:
+		event_t event;
+
+		explicit ring_queue(size_t _capacity = app::WS_RING_OUT_SIZE) : ring_(_capacity), event() {}
+
+		void push(T&& _value)
+		{
+			if (ring_.push(std::move(_value))) event.set();
+		}
+
+		template <typename F>
+		void consume(F&& _func)
+		{
+			if (ring_.consume(std::forward<F>(_func))) event.set();
+		}
+	};
+
+	app::websocket_message_out make_message(size_t _i)
+	{
+		return app::websocket_message_out_recv_binary{ static_cast<SOCKET>(_i), std::vector<uint8_t>(_i % 64, static_cast<uint8_t>(_i)) };
+	}
+
+	bool check_message(const app::websocket_message_out& _m, size_t _i)
+	{
+		const auto p = std::get_if<app::websocket_message_out_recv_binary>(&_m);
+		return p && p->sock == static_cast<SOCKET>(_i) && p->data == std::vector<uint8_t>(_i % 64, static_cast<uint8_t>(_i));
+	}
+
+	// 小さい容量で満杯待ちと通知漏れを起こしやすくして、順序と中身を確認する
+	//   -fsanitize=threadでビルドしたものでも回すこと
+	bool check_ring_order(size_t _capacity, size_t _count)
+	{
+		ring_queue<app::websocket_message_out> q(_capacity);
+		std::thread producer([&] {
+			for (size_t i = 0; i < _count; ++i) q.push(make_message(i));
+		});
+
+		size_t next = 0;
+		bool ok = true;
+		while (next < _count)
+		{
+			q.event.wait();
+			q.consume([&](app::websocket_message_out& _m) {
+				if (!check_message(_m, next)) ok = false;
+				++next;
+			});
+		}
+		producer.join();
+		if (!ok) std::cerr << "ring: order or content mismatch capacity=" << _capacity << "\n";
+		return ok;
+	}
+
+	bool check_ring_close()
+	{
+		// 満杯で待っている生産側はclose()で抜けて、その1件は捨てる (抜けなければここで止まる)
+		app::spsc_ring<int> ring(2);
+		std::thread producer([&] {
+			for (int i = 0; i < 3; ++i) ring.push(int(i));
+		});
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		ring.close();
+		producer.join();
+		size_t left = 0;
+		ring.consume([&](int&) { ++left; });
+		if (left != ring.capacity())
+		{
+			std::cerr << "ring: " << left << " items left after close()\n";
+			return false;
+		}
+
+		// 取り出されずに残った分はデストラクタで解放する
+		auto p = std::make_shared<int>(0);
+		{
+			app::spsc_ring<std::shared_ptr<int>> r(4);
+			for (int i = 0; i < 3; ++i) r.push(std::shared_ptr<int>(p));
+			r.consume([](std::shared_ptr<int>&) {});
+			for (int i = 0; i < 3; ++i) r.push(std::shared_ptr<int>(p));
+		}
+		if (p.use_count() != 1)
+		{
+			std::cerr << "ring: leftover items were not destroyed\n";
+			return false;
+		}
+		return true;
+	}
+
+	bool check_ring()
+	{
+		return check_ring_order(2, 100000) && check_ring_order(4, 300000) && check_ring_order(app::WS_RING_OUT_SIZE, 300000) && check_ring_close();
+	}
+
+	template <typename Q>
+	void bench_queue(std::string_view _name)
+	{
+		// スループット: 生産側は詰めるだけ
+		constexpr size_t count = 2000000;
+		Q q;
+		size_t wakeups = 0;
+		auto start = std::chrono::steady_clock::now();
+		std::thread producer([&] {
+			for (size_t i = 0; i < count; ++i) q.push(app::websocket_message_out_disconnected{ static_cast<SOCKET>(i) });
+		});
+		for (size_t received = 0; received < count; )
+		{
+			q.event.wait();
+			++wakeups;
+			q.consume([&](app::websocket_message_out&) { ++received; });
+		}
+		producer.join();
+		const double throughput = count / elapsed(start);
+
+		// 1ホップの遅延: 2本のキューで1件ずつ往復させる
+		constexpr size_t rounds = 50000;
+		Q ping;
+		Q pong;
+		start = std::chrono::steady_clock::now();
+		std::thread echo([&] {
+			for (size_t i = 0; i < rounds; ++i)
+			{
+				bool got = false;
+				while (!got)
+				{
+					ping.event.wait();
+					ping.consume([&](app::websocket_message_out&) { got = true; });
+				}
+				pong.push(app::websocket_message_out_disconnected{ static_cast<SOCKET>(i) });
+			}
+		});
+		for (size_t i = 0; i < rounds; ++i)
+		{
+			ping.push(app::websocket_message_out_disconnected{ static_cast<SOCKET>(i) });
+			bool got = false;
+			while (!got)
+			{
+				pong.event.wait();
+				pong.consume([&](app::websocket_message_out&) { got = true; });
+			}
+		}
+		echo.join();
+		const double hop = elapsed(start) / rounds / 2;
+
+		std::cout << "ring: " << _name << " " << static_cast<uint64_t>(throughput / 1000) << "K msg/s (wakeups " << wakeups << "), hop " << static_cast<uint64_t>(hop * 1e9) << " ns\n";
+	}
+
+	void bench_ring()
+	{
+		bench_queue<mutex_queue<app::websocket_message_out>>("mutex+queue");
+		bench_queue<ring_queue<app::websocket_message_out>>("spsc_ring");
+	}
+
+	// 完全ハッシュ表にする前のcore_thread.cppの表 (照合とベンチマークの基準)
+	const std::unordered_map<std::string, uint8_t> itemtype_map = {
+		/* english */
+		{"Syringe", app::WEBAPI_ITEM_SYRINGE},
+		{"Med Kit (Level 2)", app::WEBAPI_ITEM_MEDKIT},
+		{"Shield Cell", app::WEBAPI_ITEM_SHIELDCELL},
+		{"Shield Battery (Level 2)", app::WEBAPI_ITEM_SHIELDBATTERY},
+		{"Phoenix Kit (Level 3)", app::WEBAPI_ITEM_PHOENIXKIT},
+		{"Ultimate Accelerant (Level 2)", app::WEBAPI_ITEM_ULTIMATEACCELERANT},
+		{"Ultimate Accelerant (Level 3)", app::WEBAPI_ITEM_ULTIMATEACCELERANT},
+		{"Frag Grenade", app::WEBAPI_ITEM_FRAGGRENADE},
+		{"Thermite Grenade", app::WEBAPI_ITEM_THERMITEGRENADE},
+		{"Arc Star", app::WEBAPI_ITEM_ARCSTAR},
+		{"Knockdown Shield", app::WEBAPI_ITEM_KNOCKDOWNSHIELD_LV1},
+		{"Knockdown Shield (Level 2)", app::WEBAPI_ITEM_KNOCKDOWNSHIELD_LV2},
+		{"Knockdown Shield (Level 3)", app::WEBAPI_ITEM_KNOCKDOWNSHIELD_LV3},
+		{"Knockdown Shield (Level 4)", app::WEBAPI_ITEM_KNOCKDOWNSHIELD_LV4},
+		{"Backpack", app::WEBAPI_ITEM_BACKPACK_LV1},
+		{"Backpack (Level 2)", app::WEBAPI_ITEM_BACKPACK_LV2},
+		{"Backpack (Level 3)", app::WEBAPI_ITEM_BACKPACK_LV3},
+		{"Backpack (Level 4)", app::WEBAPI_ITEM_BACKPACK_LV4},
+		{"Mobile Respawn Beacon (Level 2)", app::WEBAPI_ITEM_MOBILERESPAWNBEACON},
+		{"Heat Shield (Level 2)", app::WEBAPI_ITEM_HEATSHIELD},
+		{"Evac Tower (Level 2)", app::WEBAPI_ITEM_EVACTOWER}, // not confimed yet.
+		{"Evo Shield", app::WEBAPI_ITEM_BODYSHIELD_LV1},
+		{"Evo Shield (Level 2)", app::WEBAPI_ITEM_BODYSHIELD_LV2},
+		{"Evo Shield (Level 3)", app::WEBAPI_ITEM_BODYSHIELD_LV3},
+		{"Evo Shield (Level 5)", app::WEBAPI_ITEM_BODYSHIELD_LV5},
+		{"Body Shield", app::WEBAPI_ITEM_BODYSHIELD_LV1},
+		{"Body Shield (Level 2)", app::WEBAPI_ITEM_BODYSHIELD_LV2},
+		{"Body Shield (Level 3)", app::WEBAPI_ITEM_BODYSHIELD_LV3},
+		{"Body Shield (Level 4)", app::WEBAPI_ITEM_BODYSHIELD_LV4},
+		{"Shield Core", app::WEBAPI_ITEM_SHIELDCORE},
+		{"Infinite Ammo Amp (Level 3)", app::WEBAPI_ITEM_AMP_INFINITE_AMMO},
+		{"Bottomless Batteries Amp (Level 3)", app::WEBAPI_ITEM_AMP_BOTTOMLESS_BATTERIES},
+		{"Over Armor Amp (Level 3)", app::WEBAPI_ITEM_AMP_OVER_ARMOR},
+		{"Heal Overflow Amp (Level 3)", app::WEBAPI_ITEM_AMP_HEAL_OVERFLOW},
+		{"Power Booster Amp (Level 3)", app::WEBAPI_ITEM_AMP_POWER_BOOSTER},
+
+		/* 日本語 */
+		{(const char*)u8"注射器", app::WEBAPI_ITEM_SYRINGE},
+		{(const char*)u8"医療キット (Level 2)", app::WEBAPI_ITEM_MEDKIT},
+		{(const char*)u8"シールドセル", app::WEBAPI_ITEM_SHIELDCELL},
+		{(const char*)u8"シールドバッテリー (Level 2)", app::WEBAPI_ITEM_SHIELDBATTERY},
+		{(const char*)u8"フェニックスキット (Level 3)", app::WEBAPI_ITEM_PHOENIXKIT},
+		{(const char*)u8"アルティメット促進剤 (Level 2)", app::WEBAPI_ITEM_ULTIMATEACCELERANT},
+		{(const char*)u8"アルティメット促進剤 (Level 3)", app::WEBAPI_ITEM_ULTIMATEACCELERANT},
+		{(const char*)u8"フラググレネード", app::WEBAPI_ITEM_FRAGGRENADE},
+		{(const char*)u8"テルミットグレネード", app::WEBAPI_ITEM_THERMITEGRENADE},
+		{(const char*)u8"アークスター", app::WEBAPI_ITEM_ARCSTAR},
+		{(const char*)u8"ノックダウンシールド", app::WEBAPI_ITEM_KNOCKDOWNSHIELD_LV1},
+		{(const char*)u8"ノックダウンシールド (Level 2)", app::WEBAPI_ITEM_KNOCKDOWNSHIELD_LV2},
+		{(const char*)u8"ノックダウンシールド (Level 3)", app::WEBAPI_ITEM_KNOCKDOWNSHIELD_LV3},
+		{(const char*)u8"ノックダウンシールド (Level 4)", app::WEBAPI_ITEM_KNOCKDOWNSHIELD_LV4},
+		{(const char*)u8"バックパック", app::WEBAPI_ITEM_BACKPACK_LV1},
+		{(const char*)u8"バックパック (Level 2)", app::WEBAPI_ITEM_BACKPACK_LV2},
+		{(const char*)u8"バックパック (Level 3)", app::WEBAPI_ITEM_BACKPACK_LV3},
+		{(const char*)u8"バックパック (Level 4)", app::WEBAPI_ITEM_BACKPACK_LV4},
+		{(const char*)u8"モバイルリスポーンビーコン (Level 2)", app::WEBAPI_ITEM_MOBILERESPAWNBEACON},
+		{(const char*)u8"ヒートシールド (Level 2)", app::WEBAPI_ITEM_HEATSHIELD},
+		{(const char*)u8"脱出タワー (Level 2)", app::WEBAPI_ITEM_EVACTOWER},
+		{(const char*)u8"進化式ボディーシールド", app::WEBAPI_ITEM_BODYSHIELD_LV1},
+		{(const char*)u8"進化式ボディーシールド (Level 2)", app::WEBAPI_ITEM_BODYSHIELD_LV2},
+		{(const char*)u8"進化式ボディーシールド (Level 3)", app::WEBAPI_ITEM_BODYSHIELD_LV3},
+		{(const char*)u8"進化式ボディーシールド (Level 5)", app::WEBAPI_ITEM_BODYSHIELD_LV5},
+		{(const char*)u8"ボディーシールド", app::WEBAPI_ITEM_BODYSHIELD_LV1},
+		{(const char*)u8"ボディーシールド (Level 2)", app::WEBAPI_ITEM_BODYSHIELD_LV2},
+		{(const char*)u8"ボディーシールド (Level 3)", app::WEBAPI_ITEM_BODYSHIELD_LV3},
+		{(const char*)u8"ボディーシールド (Level 4)", app::WEBAPI_ITEM_BODYSHIELD_LV4},
+		{(const char*)u8"シールドコア", app::WEBAPI_ITEM_SHIELDCORE},
+		{(const char*)u8"無限弾薬増幅器 (Level 3)", app::WEBAPI_ITEM_AMP_INFINITE_AMMO},
+		{(const char*)u8"バッテリー無限増幅器 (Level 3)", app::WEBAPI_ITEM_AMP_BOTTOMLESS_BATTERIES},
+		{(const char*)u8"無限バッテリー増幅器 (Level 3)", app::WEBAPI_ITEM_AMP_BOTTOMLESS_BATTERIES},
+		{(const char*)u8"オーバーアーマー増幅器 (Level 3)", app::WEBAPI_ITEM_AMP_OVER_ARMOR},
+		{(const char*)u8"オーバーフロー回復増幅器 (Level 3)", app::WEBAPI_ITEM_AMP_HEAL_OVERFLOW},
+		{(const char*)u8"パワーブースト増幅器 (Level 3)", app::WEBAPI_ITEM_AMP_POWER_BOOSTER},
+		{(const char*)u8"パワーブースター増幅器 (Level 3)", app::WEBAPI_ITEM_AMP_POWER_BOOSTER},
+	};
+
+	// 既知の名前に近いが一致しない名前 (既知の名前と同じになったものはそのIDが正解)
+	std::vector<std::string> make_near_misses(const std::string& _name)
+	{
+		std::vector<std::string> out;
+		out.push_back(_name.substr(0, _name.size() - 1));
+		out.push_back(_name.substr(1));
+		out.push_back(_name + " ");
+		out.push_back(" " + _name);
+		out.push_back(_name + "x");
+		auto s = _name;
+		s.back() ^= 0x01;
+		out.push_back(s);
+		s = _name;
+		s.front() ^= 0x20; // ASCIIなら大文字小文字が変わる
+		out.push_back(s);
+		s = _name;
+		s[s.size() / 2] ^= 0x01;
+		out.push_back(s);
+		for (const auto level : { "(Level 1)", "(Level 2)", "(Level 3)", "(Level 4)", "(Level 5)" })
+		{
+			auto pos = _name.find("(Level ");
+			if (pos == std::string::npos) break;
+			out.push_back(_name.substr(0, pos) + level);
+		}
+		return out;
+	}
+
+	bool check_items()
+	{
+		bool ok = true;
+		for (const auto& [name, id] : itemtype_map)
+		{
+			if (app::string_to_itemid(name) != id)
+			{
+				std::cerr << "items: " << name << " -> " << (int)app::string_to_itemid(name) << " (expected " << (int)id << ")\n";
+				ok = false;
+			}
+		}
+
+		// 組み込みの一覧と基準の表が同じ組であること
+		const auto builtin = app::get_builtin_itemnames();
+		if (builtin.size() != itemtype_map.size())
+		{
+			std::cerr << "items: " << builtin.size() << " builtin names (expected " << itemtype_map.size() << ")\n";
+			ok = false;
+		}
+		for (const auto& [name, id] : builtin)
+		{
+			auto it = itemtype_map.find(std::string(name));
+			if (it == itemtype_map.end() || it->second != id)
+			{
+				std::cerr << "items: unexpected builtin name " << name << "\n";
+				ok = false;
+			}
+		}
+
+		size_t count = 0;
+		for (const auto& [name, id] : itemtype_map)
+		{
+			for (const auto& m : make_near_misses(name))
+			{
+				auto it = itemtype_map.find(m);
+				const uint8_t expected = it != itemtype_map.end() ? it->second : 0;
+				if (app::string_to_itemid(m) != expected)
+				{
+					std::cerr << "items: near miss \"" << m << "\" -> " << (int)app::string_to_itemid(m) << " (expected " << (int)expected << ")\n";
+					ok = false;
+				}
+				++count;
+			}
+		}
+		for (const std::string_view m : { "", "x", "SYRINGE", "syringe", "Evo Shield (Level 4)", "Body Shield (Level 5)", "Med Kit", "Med Kit (Level 2) " })
+		{
+			if (itemtype_map.count(std::string(m)) == 0 && app::string_to_itemid(m) != 0)
+			{
+				std::cerr << "items: near miss \"" << m << "\" was accepted\n";
+				ok = false;
+			}
+		}
+		if (count == 0) ok = false;
+		return ok;
+	}
+
+	void bench_items()
+	{
+		// 半分ずつ既知の名前とそうでない名前 (LiveAPIのアイテムは大半が対象外なので外れも速いこと)
+		std::vector<std::string> names;
+		for (const auto& [name, id] : itemtype_map)
+		{
+			names.push_back(name);
+			names.push_back(make_near_misses(name).at(5));
+		}
+		constexpr size_t loops = 20000;
+		const double lookups = static_cast<double>(names.size()) * loops;
+
+		size_t sum = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < loops; ++i)
+		{
+			for (const auto& name : names)
+			{
+				const std::string_view s = name;
+				auto it = itemtype_map.find(std::string(s));
+				if (it != itemtype_map.end()) sum += it->second;
+			}
+		}
+		const double map = elapsed(start);
+
+		start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < loops; ++i)
+		{
+			for (const auto& name : names) sum += app::string_to_itemid(name);
+		}
+		const double table = elapsed(start);
+
+		std::cout << "items: unordered_map " << map / lookups * 1e9 << " ns, string_to_itemid " << table / lookups * 1e9 << " ns per lookup (" << sum << ")\n";
+	}
+
+	struct suite_t {
+		std::string_view name;
+		bool (*check)();
+		void (*bench)();
+	};
+
+	constexpr suite_t suites[] = {
+		{ "frame", check_frame, bench_frame },
+		{ "handshake", check_handshake, nullptr },
+		{ "ring", check_ring, bench_ring },
+		{ "items", check_items, bench_items },
+	};
+}
+
+int main(int _argc, char* _argv[])
+{
+	bool bench = false;
+	std::vector<std::string_view> names;
+	for (int i = 1; i < _argc; ++i)
+	{
+		const std::string_view arg = _argv[i];
+		if (arg == "--bench") bench = true;
+		else names.push_back(arg);
+	}
+
+	int rc = 0;
+	size_t count = 0;
+	for (const auto& s : suites)
+	{
+		if (names.size() > 0 && std::find(names.begin(), names.end(), s.name) == names.end()) continue;
+		++count;
+		const bool ok = s.check();
+		std::cout << s.name << ": " << (ok ? "ok" : "FAILED") << "\n";
+		if (!ok) rc = 1;
+		if (ok && bench && s.bench) s.bench();
+	}
+	if (count == 0)
+	{
+		std::cerr << "usage: selfcheck [--bench] [<suite> ...]\n";
+		return 1;
+	}
+	return rc;
+}
@@ -1,58 +1,143 @@
 ﻿#include "sha1.hpp"
 
-#include <wincrypt.h>
+#include <algorithm>
+#include <cstring>
 
-#pragma comment(lib, "crypt32.lib")
+namespace {
+	inline uint32_t rol(uint32_t _v, int _n) noexcept
+	{
+		return (_v << _n) | (_v >> (32 - _n));
+	}
+}
 
 namespace app {
 
-	bool get_sha1(const std::string& _in, sha1_t& _out)
+	// FIPS 180-4
+	sha1_context::sha1_context() noexcept
+		: h_({ 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 })
+		, block_()
+		, block_len_(0)
+		, total_(0)
+	{
+	}
+
+	void sha1_context::transform(const uint8_t* _block) noexcept
+	{
+		uint32_t w[80];
+		for (int i = 0; i < 16; ++i)
+		{
+			w[i] = (uint32_t(_block[i * 4]) << 24) | (uint32_t(_block[i * 4 + 1]) << 16) | (uint32_t(_block[i * 4 + 2]) << 8) | uint32_t(_block[i * 4 + 3]);
+		}
+		for (int i = 16; i < 80; ++i) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+		uint32_t a = h_[0], b = h_[1], c = h_[2], d = h_[3], e = h_[4];
+		for (int i = 0; i < 80; ++i)
+		{
+			uint32_t f, k;
+			if (i < 20) { f = (b & c) | (~b & d); k = 0x5a827999; }
+			else if (i < 40) { f = b ^ c ^ d; k = 0x6ed9eba1; }
+			else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc; }
+			else { f = b ^ c ^ d; k = 0xca62c1d6; }
+			const uint32_t t = rol(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = rol(b, 30);
+			b = a;
+			a = t;
+		}
+		h_[0] += a;
+		h_[1] += b;
+		h_[2] += c;
+		h_[3] += d;
+		h_[4] += e;
+	}
+
+	void sha1_context::update(std::string_view _in) noexcept
+	{
+		auto p = reinterpret_cast<const uint8_t*>(_in.data());
+		auto n = _in.size();
+		total_ += n;
+
+		// 前回の残り
+		if (block_len_ > 0)
+		{
+			const auto m = std::min(n, block_.size() - block_len_);
+			std::memcpy(block_.data() + block_len_, p, m);
+			block_len_ += m;
+			p += m;
+			n -= m;
+			if (block_len_ < block_.size()) return;
+			transform(block_.data());
+			block_len_ = 0;
+		}
+
+		for (; n >= block_.size(); p += block_.size(), n -= block_.size()) transform(p);
+
+		std::memcpy(block_.data(), p, n);
+		block_len_ = n;
+	}
+
+	void sha1_context::finish(sha1_t& _out) noexcept
 	{
-		HCRYPTPROV prov = NULL;
-		HCRYPTHASH hash = 0;
+		const uint64_t bits = total_ * 8;
 
-		if (!::CryptAcquireContextW(&prov, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT))
+		// パディング
+		block_.at(block_len_++) = 0x80;
+		if (block_len_ > 56)
 		{
-			return false;
+			std::memset(block_.data() + block_len_, 0, block_.size() - block_len_);
+			transform(block_.data());
+			block_len_ = 0;
 		}
+		std::memset(block_.data() + block_len_, 0, 56 - block_len_);
+		for (int i = 0; i < 8; ++i) block_.at(56 + i) = static_cast<uint8_t>(bits >> (56 - i * 8));
+		transform(block_.data());
+		block_len_ = 0;
 
-		bool r = false;
-		if (::CryptCreateHash(prov, CALG_SHA1, 0, 0, &hash))
+		for (int i = 0; i < 5; ++i)
 		{
-			if (::CryptHashData(hash, reinterpret_cast<const BYTE*>(_in.c_str()), _in.size(), 0))
-			{
-				DWORD datalen = _out.size();
-				if (::CryptGetHashParam(hash, HP_HASHVAL, _out.data(), &datalen, 0))
-				{
-					r = true;
-				}
-			}
-			::CryptDestroyHash(hash);
+			_out.at(i * 4) = static_cast<unsigned char>(h_[i] >> 24);
+			_out.at(i * 4 + 1) = static_cast<unsigned char>(h_[i] >> 16);
+			_out.at(i * 4 + 2) = static_cast<unsigned char>(h_[i] >> 8);
+			_out.at(i * 4 + 3) = static_cast<unsigned char>(h_[i]);
 		}
-		::CryptReleaseContext(prov, 0);
+	}
 
-		return r;
+	bool get_sha1(std::string_view _in, sha1_t& _out)
+	{
+		sha1_context ctx;
+		ctx.update(_in);
+		ctx.finish(_out);
+		return true;
 	}
 
 	/* SHA1 -> base64 */
-	std::string base64encode_from_sha1(const sha1_t& _sha1)
+	void base64encode_from_sha1(const sha1_t& _sha1, sha1_base64_t& _out) noexcept
 	{
 		constexpr auto table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-		std::string o;
-		uint16_t a = 0;
-		int16_t b = -6;
-		for (auto c : _sha1)
+
+		// 20バイト = 3バイト x 6 + 2バイト
+		size_t o = 0;
+		size_t i = 0;
+		for (; i + 3 <= _sha1.size(); i += 3)
 		{
-			a = (a << 8) + c;
-			b += 8;
-			while (b >= 0)
-			{
-				o.push_back(table[(a >> b) & 0x3f]);
-				b -= 6;
-			}
+			const uint32_t v = (uint32_t(_sha1[i]) << 16) | (uint32_t(_sha1[i + 1]) << 8) | _sha1[i + 2];
+			_out[o++] = table[(v >> 18) & 0x3f];
+			_out[o++] = table[(v >> 12) & 0x3f];
+			_out[o++] = table[(v >> 6) & 0x3f];
+			_out[o++] = table[v & 0x3f];
 		}
-		if (b > -6) o.push_back(table[((a << 8) >> (b + 8)) & 0x3f]);
-		while (o.size() % 4) o.push_back('=');
-		return o;
+		const uint32_t v = (uint32_t(_sha1[i]) << 16) | (uint32_t(_sha1[i + 1]) << 8);
+		_out[o++] = table[(v >> 18) & 0x3f];
+		_out[o++] = table[(v >> 12) & 0x3f];
+		_out[o++] = table[(v >> 6) & 0x3f];
+		_out[o++] = '=';
+	}
+
+	std::string base64encode_from_sha1(const sha1_t& _sha1)
+	{
+		sha1_base64_t b64;
+		base64encode_from_sha1(_sha1, b64);
+		return std::string(b64.data(), b64.size());
 	}
 }
@@ -3,10 +3,32 @@
 #include "common.hpp"
 
 #include <array>
+#include <cstdint>
 #include <string>
+#include <string_view>
 
 namespace app {
 	using sha1_t = std::array<unsigned char, 20>;
-	bool get_sha1(const std::string& _in, sha1_t& _out);
+	using sha1_base64_t = std::array<char, 28>;
+
+	// 分けて渡せるSHA-1 (ヒープを使わない)
+	class sha1_context {
+	private:
+		std::array<uint32_t, 5> h_;
+		std::array<uint8_t, 64> block_;
+		size_t block_len_;
+		uint64_t total_;
+
+		void transform(const uint8_t* _block) noexcept;
+
+	public:
+		sha1_context() noexcept;
+
+		void update(std::string_view _in) noexcept;
+		void finish(sha1_t& _out) noexcept;
+	};
+
+	bool get_sha1(std::string_view _in, sha1_t& _out);
+	void base64encode_from_sha1(const sha1_t& _sha1, sha1_base64_t& _out) noexcept;
 	std::string base64encode_from_sha1(const sha1_t& _sha1);
 }
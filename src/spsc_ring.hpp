@@ -0,0 +1,125 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <thread>
+#include <utility>
+
+namespace app {
+
+	// 1対1のスレッド間キュー (固定長リングバッファ)
+	//   push()は生産側の1スレッド、consume()は消費側の1スレッドだけが呼ぶこと
+	//   満杯のときpush()は空きができるまで待つ (close()後は待たずに捨てる)
+	//   push()は消費側が取り切った後の最初の1件だけtrueを返すので、そのときだけ通知すればよい
+	//   consume()がtrueを返したときは生産側から通知が来ないので、消費側が自分で起こし直す
+	template <typename T>
+	class spsc_ring {
+	private:
+		static constexpr size_t CACHE_LINE = 64;
+
+		struct slot_t {
+			alignas(T) unsigned char data[sizeof(T)];
+		};
+
+		// 生産側
+		alignas(CACHE_LINE) std::atomic<size_t> tail_;
+		size_t head_cache_;
+
+		// 消費側
+		alignas(CACHE_LINE) std::atomic<size_t> head_;
+
+		alignas(CACHE_LINE) const size_t mask_;
+		std::unique_ptr<slot_t[]> slots_;
+		std::atomic<bool> closed_;
+
+		T* at(size_t _index) noexcept
+		{
+			return std::launder(reinterpret_cast<T*>(slots_[_index & mask_].data));
+		}
+
+		static size_t round_up(size_t _n) noexcept
+		{
+			size_t n = 2;
+			while (n < _n) n <<= 1;
+			return n;
+		}
+
+	public:
+		explicit spsc_ring(size_t _capacity)
+			: tail_(0)
+			, head_cache_(0)
+			, head_(0)
+			, mask_(round_up(_capacity) - 1)
+			, slots_(new slot_t[mask_ + 1])
+			, closed_(false)
+		{
+		}
+
+		~spsc_ring()
+		{
+			const auto tail = tail_.load(std::memory_order_relaxed);
+			for (auto head = head_.load(std::memory_order_relaxed); head != tail; ++head)
+			{
+				at(head)->~T();
+			}
+		}
+
+		// コピー不可
+		spsc_ring(const spsc_ring&) = delete;
+		spsc_ring& operator = (const spsc_ring&) = delete;
+		// ムーブ不可
+		spsc_ring(spsc_ring&&) = delete;
+		spsc_ring& operator = (spsc_ring&&) = delete;
+
+		size_t capacity() const noexcept { return mask_ + 1; }
+
+		// trueなら消費側を起こすこと
+		bool push(T&& _value)
+		{
+			const auto tail = tail_.load(std::memory_order_relaxed);
+			while (tail - head_cache_ > mask_)
+			{
+				head_cache_ = head_.load(std::memory_order_acquire);
+				if (tail - head_cache_ <= mask_) break;
+				if (closed_.load(std::memory_order_relaxed)) return false;
+				std::this_thread::yield();
+			}
+
+			new (at(tail)) T(std::move(_value));
+			tail_.store(tail + 1, std::memory_order_release);
+
+			// consume()の再確認と対になるフェンス (どちらかが必ず相手の更新を見る)
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			head_cache_ = head_.load(std::memory_order_acquire);
+			return head_cache_ == tail;
+		}
+
+		// 消費側が受け取りをやめるときに呼ぶ (満杯で待っている生産側を解放する)
+		void close() noexcept
+		{
+			closed_.store(true, std::memory_order_relaxed);
+		}
+
+		// 呼び出し時点で溜まっている分を取り出してfuncに渡す
+		// trueなら取り出している間に追加された分が残っている
+		template <typename F>
+		bool consume(F&& _func)
+		{
+			auto head = head_.load(std::memory_order_relaxed);
+			const auto tail = tail_.load(std::memory_order_acquire);
+			while (head != tail)
+			{
+				auto p = at(head);
+				_func(*p);
+				p->~T();
+				head_.store(++head, std::memory_order_release);
+			}
+
+			// 取り切ったのを見せてから再確認
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			return tail_.load(std::memory_order_acquire) != head;
+		}
+	};
+}
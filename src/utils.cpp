@@ -3,13 +3,16 @@
 #include <vector>
 #include <chrono>
 
+#ifdef _WIN32
 #include <Knownfolders.h>
 #include <shlobj_core.h>
 
 #pragma comment(lib, "OneCore.lib")
+#endif
 
 
 namespace app {
+#ifdef _WIN32
 	std::wstring get_exe_directory()
 	{
 		std::vector<WCHAR> buf(32767, L'\0');
@@ -92,6 +95,69 @@ namespace app {
 			::WideCharToMultiByte(CP_UTF8, 0, _ws.c_str(), ilen, r.data(), olen, NULL, FALSE);
 		return r.data();
 	}
+#else
+	// wchar_tはUTF-32
+	std::wstring s_to_ws(const std::string& _s)
+	{
+		std::wstring r;
+		r.reserve(_s.length());
+		for (size_t i = 0; i < _s.length();)
+		{
+			const auto c = static_cast<uint8_t>(_s.at(i));
+			size_t n = 0;
+			uint32_t cp = 0;
+			if (c < 0x80) { cp = c; n = 0; }
+			else if ((c & 0xe0) == 0xc0) { cp = c & 0x1f; n = 1; }
+			else if ((c & 0xf0) == 0xe0) { cp = c & 0x0f; n = 2; }
+			else if ((c & 0xf8) == 0xf0) { cp = c & 0x07; n = 3; }
+			else { r.push_back(L'\xfffd'); ++i; continue; }
+
+			// 途中で切れている
+			if (i + n >= _s.length())
+			{
+				r.push_back(L'\xfffd');
+				break;
+			}
+			for (size_t j = 1; j <= n; ++j) cp = (cp << 6) | (static_cast<uint8_t>(_s.at(i + j)) & 0x3f);
+			r.push_back(static_cast<wchar_t>(cp));
+			i += n + 1;
+		}
+		return r;
+	}
+
+	std::string ws_to_s(const std::wstring& _ws)
+	{
+		std::string r;
+		r.reserve(_ws.length());
+		for (const auto wc : _ws)
+		{
+			const auto cp = static_cast<uint32_t>(wc);
+			if (cp < 0x80)
+			{
+				r.push_back(static_cast<char>(cp));
+			}
+			else if (cp < 0x800)
+			{
+				r.push_back(static_cast<char>(0xc0 | (cp >> 6)));
+				r.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+			}
+			else if (cp < 0x10000)
+			{
+				r.push_back(static_cast<char>(0xe0 | (cp >> 12)));
+				r.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+				r.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+			}
+			else
+			{
+				r.push_back(static_cast<char>(0xf0 | (cp >> 18)));
+				r.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+				r.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+				r.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+			}
+		}
+		return r;
+	}
+#endif
 
 	uint64_t get_millis()
 	{
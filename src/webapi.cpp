@@ -6,6 +6,48 @@ namespace {
 }
 
 namespace app {
+	uint32_t get_webapi_topic(uint8_t _type)
+	{
+		switch (_type)
+		{
+		case WEBAPI_EVENT_PLAYER_POS:
+			return WEBAPI_TOPIC_POSITION;
+		case WEBAPI_EVENT_PLAYER_HP:
+		case WEBAPI_EVENT_PLAYER_SHIELD:
+		case WEBAPI_EVENT_PLAYER_DAMAGE:
+			return WEBAPI_TOPIC_HEALTH;
+		case WEBAPI_EVENT_PLAYER_ITEMS:
+			return WEBAPI_TOPIC_ITEMS;
+		case WEBAPI_EVENT_EXTENDED:
+			return WEBAPI_TOPIC_EXTENDED;
+		case WEBAPI_EVENT_SAVE_RESULT:
+			return WEBAPI_TOPIC_RESULT;
+		}
+		if (WEBAPI_EVENT_LOBBYPLAYER <= _type && _type <= WEBAPI_EVENT_LOBBYSETUP_DONE) return WEBAPI_TOPIC_LOBBY;
+		return WEBAPI_TOPIC_GAME;
+	}
+
+	uint64_t get_webapi_coalesce_key(const std::vector<uint8_t>& _data)
+	{
+		if (_data.size() < 2) return 0;
+		uint64_t type = _data.at(0);
+		switch (type)
+		{
+		case WEBAPI_EVENT_PLAYER_HP:
+		case WEBAPI_EVENT_PLAYER_SHIELD:
+		case WEBAPI_EVENT_PLAYER_POS:
+		case WEBAPI_EVENT_PLAYER_DAMAGE:
+		case WEBAPI_EVENT_PLAYER_STATS:
+			// [type][count][UINT8][teamid][UINT8][squadindex]...
+			if (_data.size() < 6) return 0;
+			if (_data.at(2) != WEBAPI_DATA_UINT8 || _data.at(4) != WEBAPI_DATA_UINT8) return 0;
+			return (type << 16) | (uint64_t(_data.at(3)) << 8) | _data.at(5);
+		case WEBAPI_EVENT_LIVEAPI_SOCKET_STATS:
+			return type << 16;
+		}
+		return 0;
+	}
+
 	//
 
 	received_webapi_data::received_webapi_data()
@@ -78,6 +120,7 @@ namespace app {
 				break;
 			}
 			case WEBAPI_DATA_JSON:
+			case WEBAPI_DATA_BINARY:
 			{
 				if (buffer_.size() <= offset + 3) return false;
 				uint32_t len = 0;
@@ -270,7 +313,7 @@ namespace app {
 	{
 	}
 
-	bool send_webapi_data::append(const std::string& _v)
+	bool send_webapi_data::append(std::string_view _v)
 	{
 		if (_v.size() > 0xffu) return false;
 		buffer_.at(1)++;
@@ -297,6 +340,21 @@ namespace app {
 		return true;
 	}
 
+	bool send_webapi_data::append_binary(const std::vector<uint8_t>& _v)
+	{
+		if (_v.size() > 0x00ffffffu) return false; // 2^24 = 16777216(16MB)
+		buffer_.at(1)++;
+		buffer_.push_back(WEBAPI_DATA_BINARY);
+		uint32_t u = _v.size() & 0xffffffffu;
+		for (auto i = 0u; i < 4; ++i)
+		{
+			buffer_.push_back(u & 0xff);
+			u >>= 8;
+		}
+		buffer_.insert(buffer_.end(), _v.begin(), _v.end());
+		return true;
+	}
+
 	bool send_webapi_data::append(bool _v)
 	{
 		buffer_.at(1)++;
@@ -429,4 +487,32 @@ namespace app {
 		return true;
 	}
 
+	send_webapi_batch::send_webapi_batch()
+		: buffer_({WEBAPI_EVENT_BATCH, 0})
+	{
+	}
+
+	send_webapi_batch::~send_webapi_batch()
+	{
+	}
+
+	uint8_t send_webapi_batch::count() const
+	{
+		return buffer_.at(1);
+	}
+
+	bool send_webapi_batch::append(const std::vector<uint8_t>& _event)
+	{
+		if (count() == 0xffu) return false;
+		buffer_.at(1)++;
+		uint32_t u = _event.size() & 0xffffffffu;
+		for (auto i = 0u; i < 4; ++i)
+		{
+			buffer_.push_back(u & 0xff);
+			u >>= 8;
+		}
+		buffer_.insert(buffer_.end(), _event.begin(), _event.end());
+		return true;
+	}
+
 }
@@ -6,6 +6,7 @@
 #include <memory>
 #include <vector>
 #include <string>
+#include <string_view>
 
 namespace app {
 
@@ -26,7 +27,9 @@ namespace app {
 
 		WEBAPI_DATA_STRING = 0x20,
 
-		WEBAPI_DATA_JSON = 0x30
+		WEBAPI_DATA_JSON = 0x30,
+
+		WEBAPI_DATA_BINARY = 0x40
 	};
 
 
@@ -99,6 +102,10 @@ namespace app {
 		WEBAPI_EVENT_LEGENDBANENUM_START,
 		WEBAPI_EVENT_LEGENDBANENUM_END,
 		WEBAPI_EVENT_LEGENDBANSTATUS,
+
+		// ロビー一括設定
+		WEBAPI_EVENT_LOBBYSETUP_PROGRESS,
+		WEBAPI_EVENT_LOBBYSETUP_DONE,
 	};
 
 	// from WEBAPI
@@ -117,12 +124,14 @@ namespace app {
 		WEBAPI_SEND_CUSTOMMATCH_GETLEGENDBANSTATUS,
 		WEBAPI_SEND_CUSTOMMATCH_SETLEGENDBAN,
 		WEBAPI_SEND_JOINPARTYSERVER,
+		WEBAPI_SEND_CUSTOMMATCH_SETUPLOBBY,
 
 		// 途中取得系
 		WEBAPI_LIVEDATA_GET_GAME = 0x60u,
 		WEBAPI_LIVEDATA_GET_TEAMS,
 		WEBAPI_LIVEDATA_GET_TEAM_PLAYERS,
 		WEBAPI_LIVEDATA_GET_OBSERVERS_CAMERA,
+		WEBAPI_LIVEDATA_GET_SNAPSHOT,
 
 		// ローカルパラメータ取得
 		WEBAPI_LOCALDATA_SET_OBSERVER = 0x70u,
@@ -155,6 +164,10 @@ namespace app {
 		WEBAPI_EVENT_LIVEAPI_SOCKET_STATS = 0xd0,
 		WEBAPI_HTTP_GET_STATS_FROM_CODE,
 		WEBAPI_MANUAL_POSTMATCH,
+		WEBAPI_SUBSCRIBE,
+
+		// 複数イベントのまとめ送信
+		WEBAPI_EVENT_BATCH = 0xE0,
 
 		// ブロードキャスト
 		WEBAPI_BROADCAST_OBJECT = 0xF0,
@@ -163,6 +176,26 @@ namespace app {
 		WEBAPI_GET_VERSION = 0xFF,
 	};
 
+	// 購読トピック (WEBAPI_SUBSCRIBEで接続毎に指定、初期値は全て)
+	// ブロードキャストのみ対象で、リクエストへの返信は常に送る
+	enum : uint32_t {
+		WEBAPI_TOPIC_GAME = 0x00000001u, // 下記以外 (試合・チーム・プレイヤーの状態、キル等)
+		WEBAPI_TOPIC_POSITION = 0x00000002u, // WEBAPI_EVENT_PLAYER_POS
+		WEBAPI_TOPIC_HEALTH = 0x00000004u, // WEBAPI_EVENT_PLAYER_HP/SHIELD/DAMAGE
+		WEBAPI_TOPIC_ITEMS = 0x00000008u, // WEBAPI_EVENT_PLAYER_ITEMS
+		WEBAPI_TOPIC_EXTENDED = 0x00000010u, // WEBAPI_EVENT_EXTENDED
+		WEBAPI_TOPIC_LOBBY = 0x00000020u, // WEBAPI_EVENT_LOBBY*, LEGENDBAN*, CUSTOMMATCH_SETTINGS, LOBBYSETUP*
+		WEBAPI_TOPIC_RESULT = 0x00000040u, // WEBAPI_EVENT_SAVE_RESULT
+		WEBAPI_TOPIC_ALL = 0xffffffffu
+	};
+
+	// イベント種別から購読トピックを求める
+	uint32_t get_webapi_topic(uint8_t _type);
+
+	// 最新値だけ送れば良いイベント(位置・HP等)のキーを求める、それ以外は0
+	// 送信が詰まっているクライアントには同じキーの古いフレームを送らない
+	uint64_t get_webapi_coalesce_key(const std::vector<uint8_t>& _data);
+
 	// プレーヤーのステータス
 	enum : uint8_t {
 		WEBAPI_PLAYER_STATE_ALIVE = 0x00u,
@@ -282,7 +315,20 @@ namespace app {
 		bool append(int64_t _v);
 		bool append(float _v);
 		bool append(double _v);
-		bool append(const std::string& _v);
+		bool append(std::string_view _v);
 		bool append_json(const std::string& _v);
+		bool append_binary(const std::vector<uint8_t>& _v);
+	};
+
+	// [WEBAPI_EVENT_BATCH][イベント数] + ([uint32 長さ][イベント]) * イベント数
+	class send_webapi_batch {
+	public:
+		std::vector<uint8_t> buffer_;
+
+		send_webapi_batch();
+		~send_webapi_batch();
+
+		uint8_t count() const;
+		bool append(const std::vector<uint8_t>& _event);
 	};
 }
@@ -0,0 +1,74 @@
+﻿#pragma once
+
+#include "common.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace app {
+
+	// websocket_serverが使うソケットI/O (WindowsはIOCP、Linuxはepoll)
+	//   read()/write()は完了通知型で、結果はwait()からWS_BACKEND_RECV/WS_BACKEND_SENDとして返る
+	//   write()は一部だけ送って完了することがある (transferredが送れたバイト数)
+	//   close()前に発行した読み書きは、close()後に失敗として完了通知される
+	//   ACCEPTで返したソケットはまだ登録されていないので、扱うbackendでadopt()する (close()はadopt前でも閉じる)
+	//   adopt()で渡したtagはそのソケットのRECV/SENDの完了通知にそのまま載る
+	//   wakeup()/stop()以外は全てwait()を呼ぶスレッドから呼ぶこと
+	enum : UINT {
+		WS_BACKEND_ACCEPT = 1,
+		WS_BACKEND_RECV,
+		WS_BACKEND_SEND,
+		WS_BACKEND_WAKEUP,
+		WS_BACKEND_STOP
+	};
+
+	struct ws_backend_event {
+		UINT type;
+		SOCKET sock;
+		uint64_t tag;
+		size_t transferred;
+		bool failed;
+		int error;
+		std::wstring ipport;
+	};
+
+	struct ws_iovec {
+		const uint8_t* data;
+		size_t len;
+	};
+
+	class websocket_backend {
+	public:
+		virtual ~websocket_backend() {}
+
+		virtual bool listen(const std::string& _address, uint16_t _port) = 0;
+		virtual bool adopt(SOCKET _sock, uint64_t _tag) = 0;
+		virtual bool read(SOCKET _sock, uint8_t* _buf, size_t _len) = 0;
+		virtual bool write(SOCKET _sock, const ws_iovec* _bufs, size_t _count) = 0;
+		virtual bool shutdown(SOCKET _sock) = 0;
+		virtual void close(SOCKET _sock) = 0;
+
+		// falseは継続不可
+		virtual bool wait(ws_backend_event& _event) = 0;
+
+		// 他スレッドから呼べる
+		virtual void wakeup() = 0;
+		virtual void stop() = 0;
+	};
+
+	std::unique_ptr<websocket_backend> make_websocket_backend(DWORD _logid);
+
+	// websocket_threadから他スレッドへの通知 (WindowsはEvent、Linuxはeventfd)
+#ifdef _WIN32
+	using ws_notify_t = HANDLE;
+	constexpr ws_notify_t WS_NOTIFY_INVALID = NULL;
+#else
+	using ws_notify_t = int;
+	constexpr ws_notify_t WS_NOTIFY_INVALID = -1;
+#endif
+
+	ws_notify_t create_ws_notify();
+	void signal_ws_notify(ws_notify_t _notify);
+	void close_ws_notify(ws_notify_t _notify);
+}
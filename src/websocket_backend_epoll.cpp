@@ -0,0 +1,409 @@
+﻿#include "websocket_backend.hpp"
+
+#ifdef __linux__
+
+#include "log.hpp"
+#include "utils.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+	constexpr auto BACKLOG = 16;
+	constexpr auto EPOLL_EVENTS_MAX = 64;
+
+	std::wstring get_remote_ipport(const sockaddr_in& _addr)
+	{
+		char s[INET_ADDRSTRLEN] = { '\0' };
+		::inet_ntop(AF_INET, &_addr.sin_addr, s, sizeof(s));
+		return app::s_to_ws(s) + std::format(L":{}", ntohs(_addr.sin_port));
+	}
+}
+
+namespace app {
+
+	// epollはreadiness通知なので、発行済みの読み書きを覚えておいて準備ができたら実行し完了通知にする
+	//   接続はエッジトリガで一度だけ登録する (read()/write()は先に一度試してからEAGAINなら待つ)
+	class websocket_backend_epoll : public websocket_backend {
+	private:
+		struct conn_t {
+			uint64_t tag;
+			uint8_t* rbuf;
+			size_t rlen;
+			bool rpending;
+			std::vector<ws_iovec> wbufs;
+			bool wpending;
+		};
+
+		DWORD logid_;
+		int epfd_;
+		int listen_fd_;
+		int wake_fd_;
+		std::atomic<bool> stop_;
+		std::unordered_map<SOCKET, conn_t> conns_;
+		std::deque<ws_backend_event> ready_; // 完了済みでwait()に返していないもの
+
+		void accept();
+		bool try_read(SOCKET _sock, conn_t& _conn);
+		bool try_write(SOCKET _sock, conn_t& _conn);
+
+	public:
+		websocket_backend_epoll(DWORD _logid);
+		~websocket_backend_epoll();
+
+		bool init();
+
+		bool listen(const std::string& _address, uint16_t _port) override;
+		bool adopt(SOCKET _sock, uint64_t _tag) override;
+		bool read(SOCKET _sock, uint8_t* _buf, size_t _len) override;
+		bool write(SOCKET _sock, const ws_iovec* _bufs, size_t _count) override;
+		bool shutdown(SOCKET _sock) override;
+		void close(SOCKET _sock) override;
+		bool wait(ws_backend_event& _event) override;
+		void wakeup() override;
+		void stop() override;
+	};
+
+	websocket_backend_epoll::websocket_backend_epoll(DWORD _logid)
+		: logid_(_logid)
+		, epfd_(-1)
+		, listen_fd_(-1)
+		, wake_fd_(-1)
+		, stop_(false)
+		, conns_()
+		, ready_()
+	{
+	}
+
+	websocket_backend_epoll::~websocket_backend_epoll()
+	{
+		for (auto& [sock, conn] : conns_) ::close(sock);
+		if (listen_fd_ >= 0) ::close(listen_fd_);
+		if (wake_fd_ >= 0) ::close(wake_fd_);
+		if (epfd_ >= 0) ::close(epfd_);
+	}
+
+	bool websocket_backend_epoll::init()
+	{
+		epfd_ = ::epoll_create1(EPOLL_CLOEXEC);
+		if (epfd_ < 0)
+		{
+			log(logid_, std::format(L"Error: epoll_create1() failed. errno={}", errno));
+			return false;
+		}
+
+		wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (wake_fd_ < 0)
+		{
+			log(logid_, std::format(L"Error: eventfd() failed. errno={}", errno));
+			return false;
+		}
+
+		epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.fd = wake_fd_;
+		if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, wake_fd_, &ev) != 0)
+		{
+			log(logid_, std::format(L"Error: epoll_ctl() failed. errno={}", errno));
+			return false;
+		}
+		return true;
+	}
+
+	bool websocket_backend_epoll::listen(const std::string& _address, uint16_t _port)
+	{
+		listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+		if (listen_fd_ < 0)
+		{
+			log(logid_, std::format(L"Error: socket() failed. errno={}", errno));
+			return false;
+		}
+
+		int on = 1;
+		::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+		struct sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(_port);
+		::inet_pton(AF_INET, _address.c_str(), &addr.sin_addr.s_addr);
+		if (::bind(listen_fd_, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+		{
+			log(logid_, std::format(L"Error: bind() failed. errno={}", errno));
+			return false;
+		}
+
+		if (::listen(listen_fd_, BACKLOG) != 0)
+		{
+			log(logid_, std::format(L"Error: listen() failed. errno={}", errno));
+			return false;
+		}
+
+		epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.fd = listen_fd_;
+		if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, listen_fd_, &ev) != 0)
+		{
+			log(logid_, std::format(L"Error: epoll_ctl() failed. errno={}", errno));
+			return false;
+		}
+		return true;
+	}
+
+	void websocket_backend_epoll::accept()
+	{
+		while (true)
+		{
+			struct sockaddr_in addr = {};
+			socklen_t addrlen = sizeof(addr);
+			int sock = ::accept4(listen_fd_, (struct sockaddr*)&addr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+			if (sock < 0)
+			{
+				if (errno == EINTR || errno == ECONNABORTED) continue;
+				if (errno != EAGAIN && errno != EWOULDBLOCK)
+				{
+					log(logid_, std::format(L"Error: accept4() failed. errno={}", errno));
+				}
+				return;
+			}
+
+			ready_.push_back({ WS_BACKEND_ACCEPT, sock, 0, 0, false, 0, get_remote_ipport(addr) });
+		}
+	}
+
+	bool websocket_backend_epoll::adopt(SOCKET _sock, uint64_t _tag)
+	{
+		if (conns_.contains(_sock)) return false;
+
+		epoll_event ev = {};
+		ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		ev.data.fd = _sock;
+		if (::epoll_ctl(epfd_, EPOLL_CTL_ADD, _sock, &ev) != 0)
+		{
+			log(logid_, std::format(L"Error: epoll_ctl() failed. errno={}", errno));
+			return false;
+		}
+
+		conns_[_sock] = conn_t{ _tag, nullptr, 0, false, {}, false };
+		return true;
+	}
+
+	bool websocket_backend_epoll::try_read(SOCKET _sock, conn_t& _conn)
+	{
+		while (true)
+		{
+			auto n = ::recv(_sock, _conn.rbuf, _conn.rlen, 0);
+			if (n >= 0)
+			{
+				_conn.rpending = false;
+				ready_.push_back({ WS_BACKEND_RECV, _sock, _conn.tag, static_cast<size_t>(n), false, 0, L"" });
+				return true;
+			}
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) return false;
+
+			_conn.rpending = false;
+			ready_.push_back({ WS_BACKEND_RECV, _sock, _conn.tag, 0, true, errno, L"" });
+			return true;
+		}
+	}
+
+	bool websocket_backend_epoll::try_write(SOCKET _sock, conn_t& _conn)
+	{
+		std::vector<iovec> iov(_conn.wbufs.size());
+		for (size_t i = 0; i < iov.size(); ++i)
+		{
+			iov.at(i).iov_base = const_cast<uint8_t*>(_conn.wbufs.at(i).data);
+			iov.at(i).iov_len = _conn.wbufs.at(i).len;
+		}
+
+		msghdr msg = {};
+		msg.msg_iov = iov.data();
+		msg.msg_iovlen = iov.size();
+
+		while (true)
+		{
+			// 切断済みの相手に書いてもSIGPIPEにしない
+			auto n = ::sendmsg(_sock, &msg, MSG_NOSIGNAL);
+			if (n >= 0)
+			{
+				_conn.wpending = false;
+				_conn.wbufs.clear();
+				ready_.push_back({ WS_BACKEND_SEND, _sock, _conn.tag, static_cast<size_t>(n), false, 0, L"" });
+				return true;
+			}
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) return false;
+
+			_conn.wpending = false;
+			_conn.wbufs.clear();
+			ready_.push_back({ WS_BACKEND_SEND, _sock, _conn.tag, 0, true, errno, L"" });
+			return true;
+		}
+	}
+
+	bool websocket_backend_epoll::read(SOCKET _sock, uint8_t* _buf, size_t _len)
+	{
+		auto it = conns_.find(_sock);
+		if (it == conns_.end()) return false;
+		auto& conn = it->second;
+
+		conn.rbuf = _buf;
+		conn.rlen = _len;
+		conn.rpending = true;
+		try_read(_sock, conn);
+		return true;
+	}
+
+	bool websocket_backend_epoll::write(SOCKET _sock, const ws_iovec* _bufs, size_t _count)
+	{
+		auto it = conns_.find(_sock);
+		if (it == conns_.end()) return false;
+		auto& conn = it->second;
+
+		// 指す先のデータは完了通知まで呼び出し側が保持している
+		conn.wbufs.assign(_bufs, _bufs + _count);
+		conn.wpending = true;
+		try_write(_sock, conn);
+		return true;
+	}
+
+	bool websocket_backend_epoll::shutdown(SOCKET _sock)
+	{
+		if (::shutdown(_sock, SHUT_WR) != 0)
+		{
+			log(logid_, std::format(L"Error: shutdown() failed. errno={}", errno));
+			return false;
+		}
+		return true;
+	}
+
+	void websocket_backend_epoll::close(SOCKET _sock)
+	{
+		auto it = conns_.find(_sock);
+		if (it == conns_.end())
+		{
+			// adopt前
+			::close(_sock);
+			return;
+		}
+
+		// IOCPと同じく発行済みの読み書きは失敗として完了させる
+		if (it->second.rpending) ready_.push_back({ WS_BACKEND_RECV, _sock, it->second.tag, 0, true, ECANCELED, L"" });
+		if (it->second.wpending) ready_.push_back({ WS_BACKEND_SEND, _sock, it->second.tag, 0, true, ECANCELED, L"" });
+		conns_.erase(it);
+
+		::epoll_ctl(epfd_, EPOLL_CTL_DEL, _sock, nullptr);
+		::close(_sock);
+	}
+
+	bool websocket_backend_epoll::wait(ws_backend_event& _event)
+	{
+		while (true)
+		{
+			// 完了済みのものを先に返す (closeしたfdの番号がacceptで再利用される前に流し切る)
+			if (ready_.size() > 0)
+			{
+				_event = std::move(ready_.front());
+				ready_.pop_front();
+				return true;
+			}
+
+			epoll_event events[EPOLL_EVENTS_MAX];
+			auto n = ::epoll_wait(epfd_, events, EPOLL_EVENTS_MAX, -1);
+			if (n < 0)
+			{
+				if (errno == EINTR) continue;
+				log(logid_, std::format(L"Error: epoll_wait() failed. errno={}", errno));
+				return false;
+			}
+
+			bool woken = false;
+			for (int i = 0; i < n; ++i)
+			{
+				const auto fd = events[i].data.fd;
+				const auto flags = events[i].events;
+
+				if (fd == wake_fd_)
+				{
+					uint64_t v = 0;
+					while (::read(wake_fd_, &v, sizeof(v)) > 0) {}
+					woken = true;
+					continue;
+				}
+
+				if (fd == listen_fd_)
+				{
+					accept();
+					continue;
+				}
+
+				auto it = conns_.find(fd);
+				if (it == conns_.end()) continue;
+				auto& conn = it->second;
+
+				if (conn.rpending && (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0)
+				{
+					try_read(fd, conn);
+				}
+				if (conn.wpending && (flags & (EPOLLOUT | EPOLLHUP | EPOLLERR)) != 0)
+				{
+					try_write(fd, conn);
+				}
+			}
+
+			if (woken)
+			{
+				ready_.push_back({ stop_.load() ? WS_BACKEND_STOP : WS_BACKEND_WAKEUP, INVALID_SOCKET, 0, 0, false, 0, L"" });
+			}
+		}
+	}
+
+	void websocket_backend_epoll::wakeup()
+	{
+		uint64_t v = 1;
+		if (wake_fd_ >= 0) (void)::write(wake_fd_, &v, sizeof(v));
+	}
+
+	void websocket_backend_epoll::stop()
+	{
+		stop_.store(true);
+		wakeup();
+	}
+
+	std::unique_ptr<websocket_backend> make_websocket_backend(DWORD _logid)
+	{
+		auto backend = std::make_unique<websocket_backend_epoll>(_logid);
+		if (!backend->init()) return nullptr;
+		return backend;
+	}
+
+	ws_notify_t create_ws_notify()
+	{
+		return ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	}
+
+	void signal_ws_notify(ws_notify_t _notify)
+	{
+		uint64_t v = 1;
+		(void)::write(_notify, &v, sizeof(v));
+	}
+
+	void close_ws_notify(ws_notify_t _notify)
+	{
+		::close(_notify);
+	}
+}
+
+#endif
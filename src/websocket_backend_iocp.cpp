@@ -0,0 +1,402 @@
+﻿#include "websocket_backend.hpp"
+
+#ifdef _WIN32
+
+#include "log.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <Ws2tcpip.h>
+#include <mswsock.h>
+
+#pragma comment(lib, "Ws2_32.lib")
+#pragma comment(lib, "Mswsock.lib")
+
+namespace {
+	constexpr auto BACKLOG = 16;
+
+	// 完了キー
+	constexpr ULONG_PTR COMPKEY_LISTEN = 0; // ACCEPTとPostQueuedCompletionStatus
+	constexpr ULONG_PTR COMPKEY_CONN = 1;
+
+	std::wstring get_remote_ipport(LPVOID _buffer, DWORD _len)
+	{
+		wchar_t s[INET_ADDRSTRLEN] = {L'\0'};
+		DWORD slen = INET_ADDRSTRLEN;
+
+
+		SOCKADDR_IN* l = nullptr;
+		SOCKADDR_IN* r = nullptr;
+		INT llen = sizeof(SOCKADDR_IN);
+		INT rlen = sizeof(SOCKADDR_IN);
+		::GetAcceptExSockaddrs(_buffer, _len, llen + 16, rlen + 16, reinterpret_cast<sockaddr **>(&l), &llen, reinterpret_cast<sockaddr**>(&r), &rlen);
+		::WSAAddressToStringW((SOCKADDR *)r, rlen, NULL, s, &slen);
+		return s;
+	}
+}
+
+namespace app {
+
+	class websocket_backend_iocp : public websocket_backend {
+	private:
+		struct conn_t;
+
+		// OVERLAPPEDは先頭に置く (完了時にop_tへ戻す)
+		struct op_t {
+			WSAOVERLAPPED ov;
+			conn_t* conn;
+			UINT type;
+			bool pending;
+		};
+
+		struct conn_t {
+			SOCKET sock;
+			uint64_t tag;
+			bool closed;
+			op_t rop;
+			op_t wop;
+			std::vector<WSABUF> wsabufs;
+		};
+
+		DWORD logid_;
+		HANDLE compport_;
+		SOCKET listen_sock_;
+		SOCKET accept_sock_;
+		WSAOVERLAPPED accept_ov_;
+		char addr_buffer_[1024];
+		std::unordered_map<SOCKET, std::unique_ptr<conn_t>> conns_;
+		std::vector<std::unique_ptr<conn_t>> closing_; // close後に完了通知を待っているもの
+
+		bool acceptex();
+		void release(conn_t* _conn);
+
+	public:
+		websocket_backend_iocp(DWORD _logid);
+		~websocket_backend_iocp();
+
+		bool init();
+
+		bool listen(const std::string& _address, uint16_t _port) override;
+		bool adopt(SOCKET _sock, uint64_t _tag) override;
+		bool read(SOCKET _sock, uint8_t* _buf, size_t _len) override;
+		bool write(SOCKET _sock, const ws_iovec* _bufs, size_t _count) override;
+		bool shutdown(SOCKET _sock) override;
+		void close(SOCKET _sock) override;
+		bool wait(ws_backend_event& _event) override;
+		void wakeup() override;
+		void stop() override;
+	};
+
+	websocket_backend_iocp::websocket_backend_iocp(DWORD _logid)
+		: logid_(_logid)
+		, compport_(NULL)
+		, listen_sock_(INVALID_SOCKET)
+		, accept_sock_(INVALID_SOCKET)
+		, accept_ov_()
+		, addr_buffer_()
+		, conns_()
+		, closing_()
+	{
+	}
+
+	websocket_backend_iocp::~websocket_backend_iocp()
+	{
+		for (auto& [sock, conn] : conns_) ::closesocket(sock);
+		if (accept_sock_ != INVALID_SOCKET) ::closesocket(accept_sock_);
+		if (listen_sock_ != INVALID_SOCKET) ::closesocket(listen_sock_);
+		if (compport_ != NULL) ::CloseHandle(compport_);
+	}
+
+	bool websocket_backend_iocp::init()
+	{
+		// CompPort作成
+		compport_ = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+		if (compport_ == NULL)
+		{
+			log(logid_, L"Error: CreateIoCompletionPort() failed.");
+			return false;
+		}
+		return true;
+	}
+
+	bool websocket_backend_iocp::listen(const std::string& _address, uint16_t _port)
+	{
+		listen_sock_ = ::WSASocketW(AF_INET, SOCK_STREAM, IPPROTO_IP, NULL, 0, WSA_FLAG_OVERLAPPED);
+		if (listen_sock_ == INVALID_SOCKET)
+		{
+			log(logid_, std::format(L"Error: WSASocket() failed. ErrorCode={}", ::WSAGetLastError()));
+			return false;
+		}
+
+		struct sockaddr_in addr;
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(_port);
+		::inet_pton(AF_INET, _address.c_str(), &addr.sin_addr.s_addr);
+		if (::bind(listen_sock_, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+		{
+			log(logid_, std::format(L"Error: bind() failed. ErrorCode={}", ::WSAGetLastError()));
+			return false;
+		}
+
+		if (::listen(listen_sock_, BACKLOG) != 0)
+		{
+			log(logid_, std::format(L"Error: listen() failed. ErrorCode={}", ::WSAGetLastError()));
+			return false;
+		}
+
+		::CreateIoCompletionPort((HANDLE)listen_sock_, compport_, COMPKEY_LISTEN, 0);
+
+		// 接続待ち
+		return acceptex();
+	}
+
+	bool websocket_backend_iocp::adopt(SOCKET _sock, uint64_t _tag)
+	{
+		if (conns_.contains(_sock)) return false;
+
+		// ソケットを関連付けられるCompPortは1つだけ
+		if (::CreateIoCompletionPort((HANDLE)_sock, compport_, COMPKEY_CONN, 0) == NULL)
+		{
+			log(logid_, std::format(L"Error: CreateIoCompletionPort() failed. ErrorCode={}", ::GetLastError()));
+			return false;
+		}
+
+		auto conn = std::make_unique<conn_t>();
+		conn->sock = _sock;
+		conn->tag = _tag;
+		conn->closed = false;
+		conn->rop = { {}, conn.get(), WS_BACKEND_RECV, false };
+		conn->wop = { {}, conn.get(), WS_BACKEND_SEND, false };
+		conns_[_sock] = std::move(conn);
+		return true;
+	}
+
+	bool websocket_backend_iocp::acceptex()
+	{
+		accept_sock_ = ::WSASocketW(AF_INET, SOCK_STREAM, IPPROTO_IP, NULL, 0, WSA_FLAG_OVERLAPPED);
+		std::memset(&accept_ov_, 0, sizeof(WSAOVERLAPPED));
+		DWORD received = 0;
+
+		auto rc = ::AcceptEx(listen_sock_, accept_sock_, addr_buffer_, 0,
+			sizeof(SOCKADDR_IN) + 16, sizeof(SOCKADDR_IN) + 16, &received, &accept_ov_);
+
+		if (rc == TRUE)
+		{
+			return true;
+		}
+
+		auto error = ::WSAGetLastError();
+		if (error != ERROR_IO_PENDING)
+		{
+			log(logid_, std::format(L"Error: AcceptEx() failed. ErrorCode={}", error));
+			return false;
+		}
+
+		return true;
+	}
+
+	bool websocket_backend_iocp::read(SOCKET _sock, uint8_t* _buf, size_t _len)
+	{
+		auto it = conns_.find(_sock);
+		if (it == conns_.end()) return false;
+		auto& op = it->second->rop;
+
+		std::memset(&op.ov, 0, sizeof(WSAOVERLAPPED));
+		op.pending = true;
+
+		WSABUF buf;
+		buf.buf = reinterpret_cast<CHAR*>(_buf);
+		buf.len = static_cast<ULONG>(_len);
+		DWORD flags = 0;
+		auto rc = ::WSARecv(_sock, &buf, 1, NULL, &flags, &op.ov, NULL);
+		if (rc == 0)
+		{
+			return true;
+		}
+
+		auto error = ::WSAGetLastError();
+		if (error != WSA_IO_PENDING)
+		{
+			log(logid_, std::format(L"Error: WSARecv() failed. ErrorCode={}", error));
+			op.pending = false;
+			return false;
+		}
+
+		return true;
+	}
+
+	bool websocket_backend_iocp::write(SOCKET _sock, const ws_iovec* _bufs, size_t _count)
+	{
+		auto it = conns_.find(_sock);
+		if (it == conns_.end()) return false;
+		auto& conn = *it->second;
+		auto& op = conn.wop;
+
+		// WSABUFは呼び出し時に取り込まれるので使い回す
+		conn.wsabufs.resize(_count);
+		for (size_t i = 0; i < _count; ++i)
+		{
+			conn.wsabufs.at(i).buf = reinterpret_cast<CHAR*>(const_cast<uint8_t*>(_bufs[i].data));
+			conn.wsabufs.at(i).len = static_cast<ULONG>(_bufs[i].len);
+		}
+
+		std::memset(&op.ov, 0, sizeof(WSAOVERLAPPED));
+		op.pending = true;
+
+		auto rc = ::WSASend(_sock, conn.wsabufs.data(), static_cast<DWORD>(conn.wsabufs.size()), nullptr, 0, &op.ov, nullptr);
+		if (rc == 0)
+		{
+			return true;
+		}
+
+		auto error = ::WSAGetLastError();
+		if (error != ERROR_IO_PENDING)
+		{
+			// その他エラー
+			log(logid_, std::format(L"Error: WSASend() failed. ErrorCode={}", error));
+			op.pending = false;
+			return false;
+		}
+
+		return true;
+	}
+
+	bool websocket_backend_iocp::shutdown(SOCKET _sock)
+	{
+		const auto rc = ::shutdown(_sock, SD_SEND);
+		if (rc != 0)
+		{
+			const auto error = ::WSAGetLastError();
+			log(logid_, std::format(L"Error: shutdown() failed. ErrorCode={}", error));
+			return false;
+		}
+		return true;
+	}
+
+	void websocket_backend_iocp::close(SOCKET _sock)
+	{
+		auto it = conns_.find(_sock);
+		if (it == conns_.end())
+		{
+			// adopt前
+			::closesocket(_sock);
+			return;
+		}
+
+		::closesocket(_sock);
+		auto conn = std::move(it->second);
+		conns_.erase(it);
+
+		// 発行済みの読み書きは失敗として完了するまでOVERLAPPEDを残す
+		conn->closed = true;
+		if (conn->rop.pending || conn->wop.pending)
+		{
+			closing_.push_back(std::move(conn));
+		}
+	}
+
+	void websocket_backend_iocp::release(conn_t* _conn)
+	{
+		if (_conn->rop.pending || _conn->wop.pending) return;
+		std::erase_if(closing_, [&](const std::unique_ptr<conn_t>& _c) { return _c.get() == _conn; });
+	}
+
+	bool websocket_backend_iocp::wait(ws_backend_event& _event)
+	{
+		while (true)
+		{
+			DWORD transferred = 0;
+			ULONG_PTR compkey = 0;
+			LPOVERLAPPED ov = NULL;
+			auto rc = ::GetQueuedCompletionStatus(compport_, &transferred, &compkey, &ov, INFINITE);
+			auto gqcs_error = rc == FALSE ? ::GetLastError() : ERROR_SUCCESS;
+
+			if (rc == FALSE && ov == NULL)
+			{
+				log(logid_, std::format(L"Error: GetQueuedCompletionStatus() failed. ErrorCode={}", gqcs_error));
+				continue;
+			}
+
+			if (compkey == COMPKEY_LISTEN && ov == NULL)
+			{
+				// 0: 終了通知 1: wakeup
+				_event = { transferred == 0 ? WS_BACKEND_STOP : WS_BACKEND_WAKEUP, INVALID_SOCKET, 0, 0, false, 0, L"" };
+				return true;
+			}
+
+			if (compkey == COMPKEY_LISTEN)
+			{
+				// ACCEPT
+				SOCKET sock = accept_sock_;
+				accept_sock_ = INVALID_SOCKET;
+
+				if (rc == FALSE)
+				{
+					log(logid_, std::format(L"Error: ACCEPT completion failed. ErrorCode={}", gqcs_error));
+					if (sock != INVALID_SOCKET)
+					{
+						::closesocket(sock);
+					}
+					if (!acceptex()) return false;
+					continue;
+				}
+
+				auto ipport = get_remote_ipport(addr_buffer_, transferred);
+
+				if (!acceptex())
+				{
+					::closesocket(sock);
+					return false;
+				}
+
+				_event = { WS_BACKEND_ACCEPT, sock, 0, 0, false, 0, ipport };
+				return true;
+			}
+
+			// 読み書きの完了
+			auto op = reinterpret_cast<op_t*>(ov);
+			auto conn = op->conn;
+			op->pending = false;
+			_event = { op->type, conn->sock, conn->tag, transferred, rc == FALSE, static_cast<int>(gqcs_error), L"" };
+			if (conn->closed) release(conn);
+			return true;
+		}
+	}
+
+	void websocket_backend_iocp::wakeup()
+	{
+		if (compport_ != NULL) ::PostQueuedCompletionStatus(compport_, 1, COMPKEY_LISTEN, NULL);
+	}
+
+	void websocket_backend_iocp::stop()
+	{
+		if (compport_ != NULL) ::PostQueuedCompletionStatus(compport_, 0, COMPKEY_LISTEN, NULL);
+	}
+
+	std::unique_ptr<websocket_backend> make_websocket_backend(DWORD _logid)
+	{
+		auto backend = std::make_unique<websocket_backend_iocp>(_logid);
+		if (!backend->init()) return nullptr;
+		return backend;
+	}
+
+	ws_notify_t create_ws_notify()
+	{
+		return ::CreateEvent(NULL, FALSE, FALSE, NULL);
+	}
+
+	void signal_ws_notify(ws_notify_t _notify)
+	{
+		::SetEvent(_notify);
+	}
+
+	void close_ws_notify(ws_notify_t _notify)
+	{
+		::CloseHandle(_notify);
+	}
+}
+
+#endif
@@ -5,21 +5,18 @@
 #include "sha1.hpp"
 #include "utils.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cstring>
-#include <sstream>
-#include <regex>
+#include <string_view>
 
-#include <Ws2tcpip.h>
-#include <mswsock.h>
-
-#pragma comment(lib, "Ws2_32.lib")
-#pragma comment(lib, "Mswsock.lib")
+#if defined(_M_X64) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 namespace {
-	constexpr auto BACKLOG = 16;
-	constexpr auto WS_BUFFER_READ_SIZE = 512 * 1024; // 512KB
 	constexpr auto WS_MAX_PAYLOAD_SIZE = 16 * 1024 * 1024; // 16MB
+	constexpr auto WS_MAX_REQUEST_SIZE = 64 * 1024; // 64KB (handshakeのリクエストヘッダ)
 
 	const std::array<bool, 0x80> http_available_ascii_codes = {
 		0, 0, 0, 0, 0, 0, 0, 0,
@@ -40,93 +37,160 @@ namespace {
 		1, 1, 1, 1, 1, 1, 1, 0
 	};
 
-	inline std::string trim(const std::string& s)
+	inline std::string_view trim(std::string_view _s) noexcept
+	{
+		auto a = _s.find_first_not_of(" \t\r\n");
+		if (a == std::string_view::npos) return {};
+		auto b = _s.find_last_not_of(" \t\r\n");
+		return _s.substr(a, b - a + 1);
+	}
+
+	// HTTPのヘッダ名は大文字小文字を区別しない
+	inline bool iequals(std::string_view _a, std::string_view _b) noexcept
 	{
-		auto a = s.find_first_not_of(" \t\r\n");
-		if (a == std::string::npos) return "";
-		auto b = s.find_last_not_of(" \t\r\n");
-		return s.substr(a, b - a + 1);
+		if (_a.size() != _b.size()) return false;
+		for (size_t i = 0; i < _a.size(); ++i)
+		{
+			auto a = _a[i];
+			auto b = _b[i];
+			if ('A' <= a && a <= 'Z') a += 'a' - 'A';
+			if ('A' <= b && b <= 'Z') b += 'a' - 'A';
+			if (a != b) return false;
+		}
+		return true;
 	}
 
-	bool check_ascii(const std::string& _s, DWORD _logid)
+	bool check_ascii(std::string_view _s, DWORD _logid)
 	{
 		for (const auto c : _s)
 		{
-			if (c > 0x7f || !http_available_ascii_codes.at(c))
+			const auto u = static_cast<uint8_t>(c);
+			if (u > 0x7f || !http_available_ascii_codes.at(u))
 			{
-				app::log(_logid, std::format(L"Error: Invalid char is {}.", (DWORD)c));
+				app::log(_logid, std::format(L"Error: Invalid char is {}.", (DWORD)u));
 				return false;
 			}
 		}
 		return true;
 	}
 
-	auto parse_request_line(std::string _s)
+	struct http_request_line {
+		std::string_view method;
+		std::string_view requesttarget;
+		std::string_view httpversion;
+	};
+
+	// "METHOD TARGET VERSION" (区切りは空白1つ)
+	bool parse_request_line(std::string_view _s, http_request_line& _out) noexcept
 	{
-		struct return_value {
-			std::string method;
-			std::string requesttarget;
-			std::string httpversion;
-		} rv = {
-			"",
-			"",
-			""
-		};
 		_s = trim(_s);
-
-		std::smatch m;
-		if (std::regex_match(_s, m, std::regex(R"(^([^ ]+) ([^ ]+) ([^ ]+)$)")))
-		{
-			rv.method = m[1].str();
-			rv.requesttarget = m[2].str();
-			rv.httpversion = m[3].str();
-		}
-		return rv;
+		auto a = _s.find(' ');
+		if (a == std::string_view::npos || a == 0) return false;
+		auto b = _s.find(' ', a + 1);
+		if (b == std::string_view::npos || b == a + 1 || b + 1 == _s.size()) return false;
+		if (_s.find(' ', b + 1) != std::string_view::npos) return false;
+		_out.method = _s.substr(0, a);
+		_out.requesttarget = _s.substr(a + 1, b - a - 1);
+		_out.httpversion = _s.substr(b + 1);
+		return true;
 	}
 
-	auto parse_header(std::string line)
+	bool parse_header(std::string_view _line, std::string_view& _key, std::string_view& _value) noexcept
 	{
-		struct return_value {
-			std::string key;
-			std::string value;
-		} rv = {
-			"",
-			""
-		};
+		auto index = _line.find(':');
+		if (index == std::string_view::npos) return false;
+		_key = trim(_line.substr(0, index));
+		_value = trim(_line.substr(index + 1));
+		return true;
+	}
+}
+
+namespace app {
 
-		line = trim(line);
-		auto index = line.find(':', 0);
-		if (index != std::string::npos)
+	// maskの鍵はペイロード先頭からの位置で決まるので、_phaseだけ鍵を回してから語単位でXORする
+	void ws_unmask(uint8_t* _p, size_t _n, const std::array<uint8_t, 4>& _key, uint64_t _phase) noexcept
+	{
+		std::array<uint8_t, 8> k;
+		for (size_t i = 0; i < k.size(); ++i) k[i] = _key[(_phase + i) % 4];
+
+		size_t i = 0;
+#if defined(_M_X64) || defined(__SSE2__)
+		uint32_t k32;
+		std::memcpy(&k32, k.data(), 4);
+#if defined(__AVX2__)
+		const __m256i k256 = _mm256_set1_epi32(static_cast<int>(k32));
+		for (; i + 32 <= _n; i += 32)
 		{
-			rv.key = trim(line.substr(0, index));
-			rv.value = trim(line.substr(index + 1));
+			auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_p + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(_p + i), _mm256_xor_si256(v, k256));
 		}
-
-		return rv;
+#endif
+		const __m128i k128 = _mm_set1_epi32(static_cast<int>(k32));
+		for (; i + 16 <= _n; i += 16)
+		{
+			auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(_p + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(_p + i), _mm_xor_si128(v, k128));
+		}
+#endif
+		uint64_t k64;
+		std::memcpy(&k64, k.data(), 8);
+		for (; i + 8 <= _n; i += 8)
+		{
+			uint64_t v;
+			std::memcpy(&v, _p + i, 8);
+			v ^= k64;
+			std::memcpy(_p + i, &v, 8);
+		}
+		for (; i < _n; ++i) _p[i] ^= k[i % 4];
 	}
-}
 
-namespace app {
+	wsbuffer_pool::wsbuffer_pool()
+		: free_(index(WS_BUFFER_READ_MAX) + 1)
+		, used_bytes_(0)
+		, pooled_bytes_(0)
+	{
+	}
 
-	std::wstring get_remote_ipport(LPVOID _buffer, DWORD _len)
+	size_t wsbuffer_pool::index(size_t _size) noexcept
 	{
-		wchar_t s[INET_ADDRSTRLEN] = {L'\0'};
-		DWORD slen = INET_ADDRSTRLEN;
+		size_t i = 0;
+		while ((WS_BUFFER_READ_MIN << i) < _size && (WS_BUFFER_READ_MIN << i) < WS_BUFFER_READ_MAX) ++i;
+		return i;
+	}
 
+	std::unique_ptr<std::vector<uint8_t>> wsbuffer_pool::acquire(size_t _size)
+	{
+		const auto i = index(_size);
+		const auto size = WS_BUFFER_READ_MIN << i;
+		std::unique_ptr<std::vector<uint8_t>> buf;
+		if (free_.at(i).size() > 0)
+		{
+			buf = std::move(free_.at(i).back());
+			free_.at(i).pop_back();
+			pooled_bytes_ -= size;
+		}
+		else
+		{
+			buf = std::make_unique<std::vector<uint8_t>>(size);
+		}
+		used_bytes_ += size;
+		return buf;
+	}
 
-		SOCKADDR_IN* l = nullptr;
-		SOCKADDR_IN* r = nullptr;
-		INT llen = sizeof(SOCKADDR_IN);
-		INT rlen = sizeof(SOCKADDR_IN);
-		::GetAcceptExSockaddrs(_buffer, _len, llen + 16, rlen + 16, reinterpret_cast<sockaddr **>(&l), &llen, reinterpret_cast<sockaddr**>(&r), &rlen);
-		::WSAAddressToStringW((SOCKADDR *)r, rlen, NULL, s, &slen);
-		return s;
+	void wsbuffer_pool::release(std::unique_ptr<std::vector<uint8_t>>&& _buf)
+	{
+		if (!_buf) return;
+		const auto size = _buf->size();
+		used_bytes_ -= size;
+		if (pooled_bytes_ + size > WS_BUFFER_POOL_MAX) return; // 溢れた分は解放
+		free_.at(index(size)).push_back(std::move(_buf));
+		pooled_bytes_ += size;
 	}
 
 	wspacket::wspacket()
-		: header_readed(0)
+		: header({ 0 })
+		, header_readed(0)
 		, payload_readed(0)
-		, mask_index(0)
 		, len(0)
 		, exlen(0)
 		, mask(false)
@@ -146,87 +210,78 @@ namespace app {
 
 	bool wspacket::parse(const std::vector<uint8_t>& in, size_t inlen, size_t offset, size_t& remain) noexcept
 	{
-		bool filled = false;
-		size_t readed = 0;
-		for (auto i = offset; i < inlen; ++i)
+		const uint8_t* p = in.data() + offset;
+		size_t avail = inlen > offset ? inlen - offset : 0;
+
+		// ヘッダ (2バイト読むと全体の長さが決まる)
+		if (header_readed < header_length())
 		{
-			const auto& d = in.at(i);
-			if (header_readed < 2)
+			while (header_readed < header_length())
 			{
-				if (header_readed == 0)
+				if (avail == 0)
 				{
-					fin = (d & 0x80) > 0;
-					rsv1 = (d & 0x40) > 0;
-					rsv2 = (d & 0x20) > 0;
-					rsv3 = (d & 0x10) > 0;
-					opcode = d & 0x0f;
+					remain = 0;
+					return false;
 				}
-				else if (header_readed == 1)
+				const auto n = std::min<size_t>(header_length() - header_readed, avail);
+				std::memcpy(header.data() + header_readed, p, n);
+				const bool first = header_readed < 2;
+				header_readed += n;
+				p += n;
+				avail -= n;
+
+				if (first && header_readed >= 2)
 				{
-					mask = (d & 0x80) > 0;
-					len = d & 0x7f;
-					if (len < 0x7e)
-					{
-						data->reserve(len);
-					}
+					fin = (header[0] & 0x80) > 0;
+					rsv1 = (header[0] & 0x40) > 0;
+					rsv2 = (header[0] & 0x20) > 0;
+					rsv3 = (header[0] & 0x10) > 0;
+					opcode = header[0] & 0x0f;
+					mask = (header[1] & 0x80) > 0;
+					len = header[1] & 0x7f;
 				}
-				header_readed++;
 			}
-			else if (len == 0x7e && header_readed < 4)
+
+			size_t pos = 2;
+			if (len == 0x7e)
 			{
-				exlen <<= 8;
-				exlen |= d;
-				if (header_readed == 3)
-				{
-					data->reserve(exlen);
-				}
-				header_readed++;
+				exlen = (uint64_t(header[2]) << 8) | header[3];
+				pos = 4;
 			}
-			else if (len == 0x7f && header_readed < 10)
+			else if (len == 0x7f)
 			{
-				exlen <<= 8;
-				exlen |= d;
-				if (header_readed == 9)
-				{
-					if (exlen < WS_MAX_PAYLOAD_SIZE)
-					{
-						data->reserve(exlen);
-					}
-				}
-				header_readed++;
+				exlen = 0;
+				for (size_t i = 2; i < 10; ++i) exlen = (exlen << 8) | header[i];
+				pos = 10;
 			}
-			else if (mask && mask_index < 4)
+			if (mask)
 			{
-				masking_key.at(mask_index) = d;
-				mask_index++;
-				header_readed++;
+				std::memcpy(masking_key.data(), header.data() + pos, masking_key.size());
 			}
-			else if (payload_readed < payload_length())
+
+			// ペイロードは一度に確保
+			if (payload_length() < WS_MAX_PAYLOAD_SIZE)
 			{
-				if (payload_length() < WS_MAX_PAYLOAD_SIZE)
-				{
-					if (mask)
-					{
-						data->push_back(d ^ masking_key.at(data->size() % masking_key.size()));
-					}
-					else
-					{
-						data->push_back(d);
-					}
-				}
-				++payload_readed;
+				data->resize(payload_length());
 			}
-			++readed;
+		}
 
-			if (header_length() == header_readed && payload_length() == payload_readed)
+		// ペイロード
+		const auto plen = payload_length();
+		const auto n = static_cast<size_t>(std::min<uint64_t>(plen - payload_readed, avail));
+		if (n > 0 && plen < WS_MAX_PAYLOAD_SIZE)
+		{
+			std::memcpy(data->data() + payload_readed, p, n);
+			if (mask)
 			{
-				filled = true;
-				break;
+				ws_unmask(data->data() + payload_readed, n, masking_key, payload_readed);
 			}
 		}
-		remain = inlen - (offset + readed);
-		if (filled) return true;
-		return false;
+		payload_readed += n;
+		avail -= n;
+
+		remain = avail;
+		return payload_readed == plen;
 	}
 
 	uint64_t wspacket::header_length() const noexcept
@@ -251,169 +306,204 @@ namespace app {
 	{
 		if (opcode == 0xff) return false;
 		if (!data) return false;
+		if (header_readed < header_length() || payload_readed < payload_length()) return false;
 		return data->size() == payload_length();
 	}
 
-	websocket_server::websocket_server(const std::string address, uint16_t port, uint16_t maxconn, DWORD _logid)
-		: listen_address_(address)
+	websocket_server::websocket_server(websocket_backend& _backend, const std::string address, uint16_t port, uint16_t maxconn, size_t _send_budget, size_t _send_limit, DWORD _logid)
+		: backend_(_backend)
+		, listen_address_(address)
 		, listen_port_(port)
-		, addr_buffer_()
-		, accept_ctx_()
-		, sock_(-1)
+		, logid_(_logid)
 		, maxconn_(maxconn)
+		, send_budget_(_send_budget)
+		, send_limit_(_send_limit)
+		, rpool_()
+		, on_close_(nullptr)
 		, on_disconnect_(nullptr)
-		, wsconns_()
-		, logid_(_logid)
+		, slots_(maxconn)
+		, free_slots_()
+		, slot_of_()
+		, live_()
 	{
+		// 後ろから使う
+		for (uint32_t i = 0; i < maxconn; ++i)
+		{
+			slots_.at(i).slot = i;
+			free_slots_.push_back(maxconn - 1 - i);
+		}
+		live_.reserve(maxconn);
 	}
 
 	websocket_server::~websocket_server()
 	{
-		for (auto& [sock, x] : wsconns_) if (sock != INVALID_SOCKET) ::closesocket(sock);
-		if (sock_ != INVALID_SOCKET) ::closesocket(sock_);
+		// ソケットはbackendが閉じる
 	}
 
-	bool websocket_server::socket()
+	wsconn_t* websocket_server::find(SOCKET _sock) noexcept
 	{
-		sock_ = ::WSASocketW(AF_INET, SOCK_STREAM, IPPROTO_IP, NULL, 0, WSA_FLAG_OVERLAPPED);
-		if (sock_ == INVALID_SOCKET)
-		{
-			log(logid_, std::format(L"Error: WSASocket() failed. ErrorCode={}", ::WSAGetLastError()));
-			return false;
-		}
-		return true;
+		auto it = slot_of_.find(_sock);
+		if (it == slot_of_.end()) return nullptr;
+		return &slots_.at(it->second);
 	}
 
-	bool websocket_server::bind()
+	wsconn_t* websocket_server::find(wshandle_t _handle) noexcept
 	{
-		struct sockaddr_in addr;
-		addr.sin_family = AF_INET;
-		addr.sin_port = htons(listen_port_);
-		::inet_pton(AF_INET, listen_address_.c_str(), &addr.sin_addr.s_addr);
-		if (::bind(sock_, (struct sockaddr*)&addr, sizeof(addr)) != 0)
-		{
-			log(logid_, std::format(L"Error: bind() failed. ErrorCode={}", ::WSAGetLastError()));
-			return false;
-		}
-		return true;
+		const auto slot = static_cast<uint32_t>(_handle & 0xffffffffu);
+		const auto generation = static_cast<uint32_t>(_handle >> 32);
+		if (slot >= slots_.size()) return nullptr;
+		auto& x = slots_.at(slot);
+		if (!x.used || x.generation != generation) return nullptr; // 解放済みのスロットへの古い通知
+		return &x;
 	}
 
-	bool websocket_server::listen()
+	wshandle_t websocket_server::handle(const wsconn_t& _x) noexcept
 	{
-		if (::listen(sock_, 16) != 0)
-		{
-			log(logid_, std::format(L"Error: listen() failed. ErrorCode={}", ::WSAGetLastError()));
-			return false;
-		}
-		return true;
+		return (wshandle_t(_x.generation) << 32) | _x.slot;
 	}
 
-	bool websocket_server::insert(SOCKET _sock)
+	wshandle_t websocket_server::insert(SOCKET _sock)
 	{
-		if (_sock == INVALID_SOCKET) return false;
-		if (wsconns_.size() == maxconn_) return false;
-		if (wsconns_.contains(_sock)) return false;
-
-		wsconns_.emplace(_sock, wsconn_t());
-		auto& x = wsconns_.at(_sock);
-
-		// 読込バッファ確保
-		x.ior_ctx.rbuf.resize(WS_BUFFER_READ_SIZE);
-		x.ior_ctx.buf.buf = reinterpret_cast<CHAR*>(x.ior_ctx.rbuf.data());
-		x.ior_ctx.buf.len = x.ior_ctx.rbuf.size();
+		if (_sock == INVALID_SOCKET) return WS_HANDLE_INVALID;
+		if (free_slots_.size() == 0) return WS_HANDLE_INVALID;
+		if (slot_of_.contains(_sock)) return WS_HANDLE_INVALID;
+
+		const auto slot = free_slots_.back();
+		free_slots_.pop_back();
+		slot_of_.emplace(_sock, slot);
+		auto& x = slots_.at(slot);
+		x.used = true;
+		x.sock = _sock;
+
+		// 読込バッファ確保 (小さく始めて必要なら大きくする)
+		x.ior_ctx.rbuf = rpool_.acquire(WS_BUFFER_READ_MIN);
+		x.ior_ctx.rlast = 0;
+		x.ior_ctx.sock = _sock;
 		x.ior_ctx.type = WS_TCP_RECV;
 		x.ior_ctx.pending = 0;
 
+		x.iow_ctx.sock = _sock;
+		x.iow_ctx.type = WS_TCP_SEND;
 		x.iow_ctx.pending = 0;
+		x.iow_ctx.wbufs.reserve(WS_SEND_WSABUF_MAX);
+		x.iow_ctx.iovecs.reserve(WS_SEND_WSABUF_MAX);
+		x.iow_ctx.woffset = 0;
 
-		return true;
+		return handle(x);
+	}
+
+	void websocket_server::unlive(wsconn_t& _x) noexcept
+	{
+		if (_x.live_index == WS_LIVE_NONE) return;
+
+		// 末尾と入れ替えて詰める
+		const auto last = live_.back();
+		live_.at(_x.live_index) = last;
+		slots_.at(last).live_index = _x.live_index;
+		live_.pop_back();
+		_x.live_index = WS_LIVE_NONE;
 	}
 
-	void websocket_server::broadcast(std::shared_ptr<std::vector<uint8_t>> &_data)
+	void websocket_server::broadcast(uint32_t _topics, const std::function<bool(wsconn_t&)>& _send)
 	{
-		std::vector<SOCKET> closed_socks;
-		for (const auto& [sock, x] : wsconns_)
+		std::vector<uint32_t> closed_slots;
+		for (const auto slot : live_)
 		{
-			if (x.handshake == true)
+			auto& x = slots_.at(slot);
+			if ((x.topics & _topics) != 0)
 			{
-				if (!send(sock, _data))
+				if (!_send(x))
 				{
-					closed_socks.push_back(sock);
+					closed_slots.push_back(slot);
 				}
 			}
 		}
 
-		for (const auto& sock : closed_socks)
+		for (const auto slot : closed_slots)
 		{
-			close(sock);
+			close(slots_.at(slot));
 		}
 	}
 
-	bool websocket_server::response(SOCKET _sock, const std::vector<uint8_t>& _data, int _len)
+	bool parse_ws_handshake(std::string_view _request, std::string_view& _key, DWORD _logid)
 	{
-		std::istringstream req(reinterpret_cast<const char*>(_data.data()));
 		bool firstline = true;
-		std::string line;
-		std::string key = "";
-		std::string magic = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+		_key = {};
 
-		while (std::getline(req, line) && line != "\r")
+		// 行ごとに切り出す (空行で終わり)
+		while (_request.size() > 0)
 		{
-			if (!check_ascii(line, logid_))
+			auto eol = _request.find('\n');
+			auto line = _request.substr(0, eol);
+			_request = eol == std::string_view::npos ? std::string_view() : _request.substr(eol + 1);
+			if (line.size() > 0 && line.back() == '\r') line.remove_suffix(1);
+			if (line.size() == 0) break;
+
+			if (!check_ascii(line, _logid))
 			{
-				log(logid_, L"Error: http header contains invalid ascii.");
+				log(_logid, L"Error: http header contains invalid ascii.");
 				return false;
 			}
 			if (firstline)
 			{
-				auto [method, requesttarget, httpversion] = parse_request_line(line);
-				log(logid_, std::format(L"Info: << {}", s_to_ws(line)));
-				if (method != "GET" || httpversion != "HTTP/1.1")
+				http_request_line rl;
+				log(_logid, std::format(L"Info: << {}", s_to_ws(std::string(line))));
+				if (!parse_request_line(line, rl) || rl.method != "GET" || rl.httpversion != "HTTP/1.1")
 				{
-					log(logid_, std::format(L"Error: Method or HTTP-Version mismatch. method={},httpversion={}", s_to_ws(method), s_to_ws(httpversion)));
+					log(_logid, std::format(L"Error: Method or HTTP-Version mismatch. method={},httpversion={}", s_to_ws(std::string(rl.method)), s_to_ws(std::string(rl.httpversion))));
 					return false;
 				}
 				firstline = false;
 			}
 			else
 			{
-				auto [k, v] = parse_header(line);
-				if (k == "Sec-WebSocket-Key")
-					key = v;
-				if (k != "" && v != "")
+				std::string_view k, v;
+				if (parse_header(line, k, v) && iequals(k, "Sec-WebSocket-Key"))
 				{
-					log(logid_, std::format(L"Info: << {}: {}", s_to_ws(k), s_to_ws(v)));
-				}
-				else
-				{
-					log(logid_, std::format(L"Info: << {}", s_to_ws(line)));
+					_key = v;
 				}
 			}
 		}
 
-		if (key == "") return false;
+		return _key.size() > 0;
+	}
+
+	void ws_accept_key(std::string_view _key, sha1_base64_t& _out)
+	{
+		constexpr std::string_view magic = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 
 		// SHA1計算
 		sha1_t sha1;
-		if (!get_sha1(key + magic, sha1))
-		{
-			log(logid_, L"Error: response get_sha1() failed.");
-			return false;
-		}
+		sha1_context ctx;
+		ctx.update(_key);
+		ctx.update(magic);
+		ctx.finish(sha1);
 
 		// base64エンコード
-		auto b64 = base64encode_from_sha1(sha1);
-		log(logid_, std::format(L"Info: >> Sec-WebSocket-Accept: {}", s_to_ws(b64)));
+		base64encode_from_sha1(sha1, _out);
+	}
+
+	bool websocket_server::response(wsconn_t& _x, std::string_view _request)
+	{
+		std::string_view key;
+		if (!parse_ws_handshake(_request, key, logid_)) return false;
+
+		sha1_base64_t b64;
+		ws_accept_key(key, b64);
 
-		std::string res = "HTTP/1.1 101 Switching Protocols\r\n"
+		constexpr std::string_view res_head = "HTTP/1.1 101 Switching Protocols\r\n"
 			"Upgrade: websocket\r\n"
 			"Connection: Upgrade\r\n"
-			"Sec-WebSocket-Accept: " + b64 + "\r\n\r\n";
+			"Sec-WebSocket-Accept: ";
+		constexpr std::string_view res_tail = "\r\n\r\n";
 
-		auto buf = std::make_shared<std::vector<uint8_t>>(
-			reinterpret_cast<const uint8_t*>(res.c_str()), reinterpret_cast<const uint8_t*>(res.c_str()) + res.length());
+		auto buf = std::make_shared<std::vector<uint8_t>>(res_head.size() + b64.size() + res_tail.size());
+		auto p = buf->data();
+		std::memcpy(p, res_head.data(), res_head.size());
+		std::memcpy(p + res_head.size(), b64.data(), b64.size());
+		std::memcpy(p + res_head.size() + b64.size(), res_tail.data(), res_tail.size());
 
-		if (!send(_sock, buf))
+		if (!send(_x, buf))
 		{
 			log(logid_, L"Error: send() failed.");
 			return false;
@@ -422,102 +512,184 @@ namespace app {
 		return true;
 	}
 
-	void websocket_server::pong(SOCKET _sock, const uint8_t* _data, int _len)
+	bool websocket_server::pong(wsconn_t& _x, const uint8_t* _data, int _len)
 	{
 		// FINがない
-		if ((_data[0] & 0x80) == 0) return;
+		if ((_data[0] & 0x80) == 0) return true;
 
 		// PINGじゃない
 		char opcode = _data[0] & 0xf;
-		if (opcode != 0x9) return;
+		if (opcode != 0x9) return true;
 
 		// opcodeだけ変えて返送
 		auto buf = std::make_shared<std::vector<uint8_t>>(_data, _data + _len);
 		buf->at(0) = ((buf->at(0) & 0xf0) | 0xa);
-		if (!send(_sock, buf))
+		if (!send(_x, buf))
 		{
-			close(_sock);
+			close(_x);
+			return false;
 		}
+		return true;
 	}
 
 	bool websocket_server::prepare()
 	{
-		if (!socket()) return false;
-		if (!bind()) return false;
-		if (!listen()) return false;
+		if (!backend_.listen(listen_address_, listen_port_)) return false;
 		log(logid_, std::format(L"Info: listen websocket server at {}:{}", s_to_ws(listen_address_), listen_port_));
 		return true;
 	}
 
 	size_t websocket_server::count() const noexcept
 	{
-		return wsconns_.size();
+		return slot_of_.size();
 	}
 
-	bool websocket_server::acceptex()
+	size_t websocket_server::queued_bytes() const noexcept
 	{
-		accept_ctx_.sock = ::WSASocketW(AF_INET, SOCK_STREAM, IPPROTO_IP, NULL, 0, WSA_FLAG_OVERLAPPED);
-		accept_ctx_.data = addr_buffer_;
-		DWORD received = 0;
+		size_t n = 0;
+		for (const auto& x : slots_) n += x.wq_bytes;
+		return n;
+	}
 
-		auto rc = ::AcceptEx(sock_, accept_ctx_.sock, addr_buffer_, 0,
-			sizeof(SOCKADDR_IN) + 16, sizeof(SOCKADDR_IN) + 16, &received, &accept_ctx_.ov);
+	bool websocket_server::over_budget(const wsconn_t& x, size_t _size) const noexcept
+	{
+		return send_budget_ > 0 && x.wq_bytes + _size > send_budget_;
+	}
+
+	bool websocket_server::send(wsconn_t& x, std::shared_ptr<std::vector<uint8_t>>& _data, uint64_t _key)
+	{
+		if (!x.used || x.closed) return false;
 
-		if (rc == TRUE)
+		// キューに追加
+		if (_data)
 		{
-			return true;
+			// 送信待ちが予算を超えている場合は同じkeyの古いフレームを捨てる (順序を保つため新しい方は末尾)
+			//   古い方はその場で空にするだけなので、wqの途中を消すことはない
+			if (_key != 0 && over_budget(x, _data->size()))
+			{
+				auto it = x.wq_index.find(_key);
+				if (it != x.wq_index.end())
+				{
+					auto& old = x.wq.at(it->second - x.wq_head);
+					x.wq_bytes -= old.data->size();
+					old.data.reset();
+					x.wq_dead++;
+					x.coalesced++;
+				}
+			}
+			if (_key != 0) x.wq_index[_key] = x.wq_head + x.wq.size();
+			x.wq.push_back({ _data, _key });
+			x.wq_bytes += _data->size();
+
+			// 読まれていないので切断する
+			if (send_limit_ > 0 && x.wq_bytes > send_limit_)
+			{
+				const auto frames = x.wq.size() - x.wq_dead;
+				log(logid_, std::format(L"Error: send queue exceeded limit. sock={}, bytes={}, frames={}", x.sock, x.wq_bytes, frames));
+				x.dropped += frames;
+				x.wq_head += x.wq.size();
+				x.wq.clear();
+				x.wq_index.clear();
+				x.wq_dead = 0;
+				x.wq_bytes = 0;
+				return false;
+			}
+
+			// 空のフレームが半分を超えたら詰める
+			if (x.wq_dead > WS_SEND_WSABUF_MAX && x.wq_dead * 2 > x.wq.size()) compact(x);
 		}
 
-		auto error = ::WSAGetLastError();
-		if (error != ERROR_IO_PENDING)
+		if (x.iow_ctx.wbufs.size() > 0) return true; // 既に送信中
+
+		// キューの先頭からまとめて取り出し
+		while (x.wq.size() > 0 && x.iow_ctx.wbufs.size() < WS_SEND_WSABUF_MAX)
 		{
-			log(logid_, std::format(L"Error: AcceptEx() failed. ErrorCode={}", error));
-			return false;
+			auto& front = x.wq.front();
+			if (front.key != 0)
+			{
+				auto it = x.wq_index.find(front.key);
+				if (it != x.wq_index.end() && it->second == x.wq_head) x.wq_index.erase(it);
+			}
+			auto data = std::move(front.data);
+			x.wq.pop_front();
+			x.wq_head++;
+			if (!data)
+			{
+				// 置き換えられたフレーム
+				x.wq_dead--;
+				continue;
+			}
+			x.wq_bytes -= data->size();
+			if (data->size() > 0) x.iow_ctx.wbufs.push_back(std::move(data));
 		}
 
-		return true;
-	}
+		if (x.iow_ctx.wbufs.size() == 0) return true; // キューが空になった
 
+		x.iow_ctx.woffset = 0;
+		return post_send(x);
+	}
 
-	bool websocket_server::send(SOCKET _sock, std::shared_ptr<std::vector<uint8_t>>& _data)
+	void websocket_server::compact(wsconn_t& x)
 	{
-		if (!wsconns_.contains(_sock)) return false;
-		auto& x = wsconns_.at(_sock);
-
-		if (x.closed) return false;
+		std::erase_if(x.wq, [](const wsqueued_t& _q) { return !_q.data; });
+		x.wq_dead = 0;
 
-		// キューに追加
-		if (_data) x.wq.push(_data);
+		// 通し番号は詰めた後の位置で振り直す
+		x.wq_index.clear();
+		for (size_t i = 0; i < x.wq.size(); ++i)
+		{
+			const auto key = x.wq.at(i).key;
+			if (key != 0) x.wq_index[key] = x.wq_head + i;
+		}
+	}
 
-		if (x.iow_ctx.wbuf) return true; // 既に送信中
+	bool websocket_server::sent(wshandle_t _handle, DWORD _transferred)
+	{
+		auto p = find(_handle);
+		if (p == nullptr) return false;
+		auto& x = *p;
+
+		// 送信し終わったフレームを解放
+		size_t n = _transferred;
+		size_t done = 0;
+		while (n > 0 && done < x.iow_ctx.wbufs.size())
+		{
+			size_t remain = x.iow_ctx.wbufs.at(done)->size() - x.iow_ctx.woffset;
+			if (n < remain)
+			{
+				x.iow_ctx.woffset += n;
+				break;
+			}
+			n -= remain;
+			x.iow_ctx.woffset = 0;
+			++done;
+		}
+		x.iow_ctx.wbufs.erase(x.iow_ctx.wbufs.begin(), x.iow_ctx.wbufs.begin() + done);
 
-		if (x.wq.size() == 0) return true; // キューが空になった
+		if (x.closed) return false;
 
-		// キューの先頭から取り出し
-		x.iow_ctx.wbuf = x.wq.front();
-		x.wq.pop();
+		// 一部しか送れなかった場合は残りを送信
+		if (x.iow_ctx.wbufs.size() > 0) return post_send(x);
 
-		if (!x.iow_ctx.wbuf) return true; // 送信要求データが空
+		// キューに残っている分を送信
+		std::shared_ptr<std::vector<uint8_t>> empty = nullptr;
+		return send(x, empty);
+	}
 
+	bool websocket_server::post_send(wsconn_t& x)
+	{
 		// バッファに情報を格納
-		std::memset(&x.iow_ctx.ov, 0, sizeof(WSAOVERLAPPED));
-		x.iow_ctx.sock = _sock;
-		x.iow_ctx.buf.buf = reinterpret_cast<CHAR*>(x.iow_ctx.wbuf->data());
-		x.iow_ctx.buf.len = x.iow_ctx.wbuf->size();
-		x.iow_ctx.type = WS_TCP_SEND;
-		x.iow_ctx.pending = 1;
-
-		auto rc = ::WSASend(_sock, &x.iow_ctx.buf, 1, nullptr, 0, &x.iow_ctx.ov, nullptr);
-		if (rc == 0)
+		x.iow_ctx.iovecs.clear();
+		for (size_t i = 0; i < x.iow_ctx.wbufs.size(); ++i)
 		{
-			return true;
+			auto& data = x.iow_ctx.wbufs.at(i);
+			size_t offset = i == 0 ? x.iow_ctx.woffset : 0;
+			x.iow_ctx.iovecs.push_back({ data->data() + offset, data->size() - offset });
 		}
+		x.iow_ctx.pending = 1;
 
-		auto error = ::WSAGetLastError();
-		if (error != ERROR_IO_PENDING)
+		if (!backend_.write(x.sock, x.iow_ctx.iovecs.data(), x.iow_ctx.iovecs.size()))
 		{
-			// その他エラー
-			log(logid_, std::format(L"Error: WSASend() failed. ErrorCode={}", error));
 			x.iow_ctx.pending = 0;
 			return false;
 		}
@@ -525,38 +697,58 @@ namespace app {
 		return true;
 	}
 
-	bool websocket_server::read(SOCKET _sock)
+	bool websocket_server::read(wshandle_t _handle)
 	{
-		if (!wsconns_.contains(_sock)) return false;
-		auto& x = wsconns_.at(_sock);
+		auto p = find(_handle);
+		if (p == nullptr) return false;
+		auto& x = *p;
 
 		if (x.closed) return false;
 
-		// バッファに情報を格納
-		std::memset(&x.ior_ctx.ov, 0, sizeof(WSAOVERLAPPED));
-		x.ior_ctx.sock = _sock;
-		x.ior_ctx.pending = 1;
-
-		DWORD flags = 0;
-		auto rc = ::WSARecv(_sock, &x.ior_ctx.buf, 1, NULL, &flags, &x.ior_ctx.ov, NULL);
-		if (rc == 0)
+		// 前回バッファが埋まったら2倍にし、小さいフレームに戻ったら最小に戻す
+		const auto size = x.ior_ctx.rbuf->size();
+		if (x.ior_ctx.rlast == size && size < WS_BUFFER_READ_MAX)
 		{
-			return true;
+			rpool_.release(std::move(x.ior_ctx.rbuf));
+			x.ior_ctx.rbuf = rpool_.acquire(size * 2);
 		}
+		else if (size > WS_BUFFER_READ_MIN && x.ior_ctx.rlast <= WS_BUFFER_READ_MIN)
+		{
+			rpool_.release(std::move(x.ior_ctx.rbuf));
+			x.ior_ctx.rbuf = rpool_.acquire(WS_BUFFER_READ_MIN);
+		}
+
+		x.ior_ctx.pending = 1;
 
-		auto error = ::WSAGetLastError();
-		if (error != WSA_IO_PENDING)
+		if (!backend_.read(x.sock, x.ior_ctx.rbuf->data(), x.ior_ctx.rbuf->size()))
 		{
-			log(logid_, std::format(L"Error: WSARecv() failed. ErrorCode={}", error));
 			x.ior_ctx.pending = 0;
-			close(_sock);
+			close(x);
 			return false;
 		}
 
 		return true;
 	}
 
-	void websocket_server::send_binary(SOCKET _sock, const std::vector<uint8_t>& _data, size_t _len)
+	bool websocket_server::completed(wshandle_t _handle, UINT _type)
+	{
+		auto p = find(_handle);
+		if (p == nullptr) return false;
+		if (_type == WS_TCP_RECV) p->ior_ctx.pending = 0;
+		if (_type == WS_TCP_SEND) p->iow_ctx.pending = 0;
+		return true;
+	}
+
+	std::queue<std::unique_ptr<std::vector<uint8_t>>> websocket_server::received(wshandle_t _handle, size_t _transferred)
+	{
+		auto p = find(_handle);
+		if (p == nullptr || p->closed) return {};
+		auto& x = *p;
+		x.ior_ctx.rlast = _transferred;
+		return receive_data(x, *x.ior_ctx.rbuf, static_cast<int>(_transferred));
+	}
+
+	std::shared_ptr<std::vector<uint8_t>> websocket_server::make_frame(const uint8_t* _data, size_t _len)
 	{
 		/* ヘッダサイズを決める */
 		size_t header_size = 2;
@@ -572,14 +764,13 @@ namespace app {
 		if (_len > 0xffff)
 		{
 			sbuf->at(1) = 0x7f;
-			uint64_t be64len = _byteswap_uint64(_len);
-			std::memcpy(&sbuf->at(2), &be64len, 8);
+			for (size_t i = 0; i < 8; ++i) sbuf->at(2 + i) = static_cast<uint8_t>(uint64_t(_len) >> (56 - i * 8));
 		}
 		else if (_len > 0x7d)
 		{
 			sbuf->at(1) = 0x7e;
-			uint16_t be16len = _byteswap_ushort(_len);
-			std::memcpy(&sbuf->at(2), &be16len, 2);
+			sbuf->at(2) = static_cast<uint8_t>(_len >> 8);
+			sbuf->at(3) = static_cast<uint8_t>(_len);
 		}
 		else
 		{
@@ -587,25 +778,47 @@ namespace app {
 		}
 
 		/* ペイロードコピー */
-		std::copy(_data.begin(), _data.begin() + _len, sbuf->begin() + header_size);
+		std::copy(_data, _data + _len, sbuf->begin() + header_size);
+		return sbuf;
+	}
+
+	void websocket_server::send_binary(SOCKET _sock, const std::vector<uint8_t>& _data, size_t _len, uint32_t _topics, uint64_t _key, const std::vector<wspart_t>* _parts)
+	{
+		auto sbuf = make_frame(_data.data(), _len);
+
+		// 部分ごとのフレームは予算を超えた接続が出た時に1回だけ作って共有する
+		std::vector<std::shared_ptr<std::vector<uint8_t>>> pbufs;
+		auto send_frames = [&](wsconn_t& x) -> bool {
+			if (_parts == nullptr || _parts->empty() || !over_budget(x, sbuf->size())) return send(x, sbuf, _key);
+			if (pbufs.empty())
+			{
+				for (const auto& part : *_parts) pbufs.push_back(make_frame(_data.data() + part.offset, part.len));
+			}
+			for (size_t i = 0; i < pbufs.size(); ++i)
+			{
+				if (!send(x, pbufs.at(i), _parts->at(i).key)) return false;
+			}
+			return true;
+		};
 
 		/* 送信 */
 		if (_sock == INVALID_SOCKET)
 		{
-			broadcast(sbuf);
+			broadcast(_topics, send_frames);
 		}
 		else
 		{
-			if (!send(_sock, sbuf))
+			auto x = find(_sock);
+			if (x != nullptr && !send_frames(*x))
 			{
-				close(_sock);
+				close(*x);
 			}
 		}
 	}
 
-	void websocket_server::broadcast_binary(const std::vector<uint8_t>& _data, size_t _len)
+	void websocket_server::broadcast_binary(const std::vector<uint8_t>& _data, size_t _len, uint32_t _topics, uint64_t _key, const std::vector<wspart_t>* _parts)
 	{
-		send_binary(INVALID_SOCKET, _data, _len);
+		send_binary(INVALID_SOCKET, _data, _len, _topics, _key, _parts);
 	}
 
 	void websocket_server::broadcast_ping()
@@ -613,63 +826,107 @@ namespace app {
 		auto data = std::make_shared<std::vector<uint8_t>>();
 		data->push_back(0x89);
 		data->push_back(0x00);
-		broadcast(data);
+		broadcast(0xffffffffu, [&](wsconn_t& x) { return send(x, data); });
+	}
+
+	void websocket_server::subscribe(SOCKET _sock, uint32_t _topics)
+	{
+		auto x = find(_sock);
+		if (x == nullptr) return;
+		x->topics = _topics;
 	}
 
 	bool websocket_server::contains(SOCKET _sock) const noexcept
 	{
-		return wsconns_.contains(_sock);
+		return slot_of_.contains(_sock);
 	}
 
-	void websocket_server::close(SOCKET _sock)
+	void websocket_server::close(wshandle_t _handle)
 	{
-		bool pending = false;
-		if (!wsconns_.contains(_sock)) return;
+		auto x = find(_handle);
+		if (x == nullptr) return;
+		close(*x);
+	}
+
+	void websocket_server::close(wsconn_t& x)
+	{
+		if (!x.used) return;
+		const auto sock = x.sock;
+		if (!x.closed)
 		{
-			auto& x = wsconns_.at(_sock);
-			if (!x.closed)
-			{
-				::closesocket(_sock);
-				x.closed = true;
-			}
-			if (x.ior_ctx.pending || x.iow_ctx.pending)
-			{
-				pending = true;
-			}
+			// 閉じた番号はすぐacceptで再利用されるので、SOCKETからの引きは先に外す
+			slot_of_.erase(sock);
+			if (on_close_) on_close_(sock);
+			backend_.close(sock);
+			x.closed = true;
+			unlive(x);
 		}
-		if (pending)
+		if (x.ior_ctx.pending || x.iow_ctx.pending)
 		{
-			log(logid_, std::format(L"Info: close socket = {}, but I/O pending.", _sock));
+			log(logid_, std::format(L"Info: close socket = {}, but I/O pending.", sock));
+			return;
 		}
-		else
+
+		if (x.coalesced > 0 || x.dropped > 0)
 		{
-			wsconns_.erase(_sock);
-			log(logid_, std::format(L"Info: close socket = {}", _sock));
-			if (on_disconnect_) on_disconnect_(_sock);
+			log(logid_, std::format(L"Info: socket = {} coalesced {} frames, dropped {} frames.", sock, x.coalesced, x.dropped));
 		}
+		rpool_.release(std::move(x.ior_ctx.rbuf));
+
+		// スロットを空けて世代を進める (古いハンドルは無効になる)
+		const auto slot = x.slot;
+		const auto generation = x.generation + 1;
+		x = wsconn_t();
+		x.slot = slot;
+		x.generation = generation == 0 ? 1 : generation;
+		free_slots_.push_back(slot);
+
+		log(logid_, std::format(L"Info: close socket = {}", sock));
+		if (on_disconnect_) on_disconnect_(sock);
 	}
 
-	std::queue<std::unique_ptr<std::vector<uint8_t>>> websocket_server::receive_data(SOCKET _sock, const std::vector<uint8_t>& _data, int _len)
+	std::queue<std::unique_ptr<std::vector<uint8_t>>> websocket_server::receive_data(wsconn_t& x, const std::vector<uint8_t>& _data, int _len)
 	{
 		// 入力データの出力
 		std::queue<std::unique_ptr<std::vector<uint8_t>>> r;
-
-		if (!wsconns_.contains(_sock)) return r;
-
-		auto& x = wsconns_.at(_sock);
+		const auto _sock = x.sock;
 
 		/* handshake未実施の場合は実施 */
-		if (x.handshake == 0)
+		if (!x.handshake)
 		{
+			// 1回で届いていればそのまま使い、分割されていれば空行まで溜める
+			std::string_view request(reinterpret_cast<const char*>(_data.data()), _len);
+			if (x.buffer != nullptr || request.find("\r\n\r\n") == std::string_view::npos)
+			{
+				if (x.buffer == nullptr)
+				{
+					x.buffer.reset(new std::vector<uint8_t>());
+				}
+				x.buffer->insert(x.buffer->end(), _data.begin(), _data.begin() + _len);
+				request = std::string_view(reinterpret_cast<const char*>(x.buffer->data()), x.buffer->size());
+				if (request.find("\r\n\r\n") == std::string_view::npos)
+				{
+					if (x.buffer->size() > WS_MAX_REQUEST_SIZE)
+					{
+						log(logid_, L"Error: http request size over.");
+						close(x);
+					}
+					return r;
+				}
+			}
+			auto req = std::move(x.buffer);
+
 			// handshake実施
-			if (!response(_sock, _data, _len))
+			if (!response(x, request))
 			{
 				log(logid_, L"Error: response() failed.");
-				close(_sock);
+				close(x);
 			}
 			else
 			{
 				x.handshake = true;
+				x.live_index = live_.size();
+				live_.push_back(x.slot);
 			}
 			return r;
 		}
@@ -759,7 +1016,7 @@ namespace app {
 						// 何もしない
 						break;
 					case 0x9: // ping
-						pong(_sock, _data.data() + offset, _len - offset - remain);
+						if (!pong(x, _data.data() + offset, _len - offset - remain)) return r;
 						break;
 					case 0x8: // close
 					{
@@ -768,21 +1025,24 @@ namespace app {
 							uint16_t close_code = (packet->data->at(0) << 8) | packet->data->at(1);
 							log(logid_, std::format(L"Info: close_code={}", close_code));
 						}
-						const auto rc = ::shutdown(_sock, SD_SEND);
-						if (rc != 0)
+						if (!backend_.shutdown(_sock))
 						{
-							const auto error = ::WSAGetLastError();
-							log(logid_, std::format(L"Error: shutdown() failed. ErrorCode={}", error));
-							close(_sock);
+							close(x);
 						}
 						return r;
 					}
 					default:
 						log(logid_, L"Error: invalid opcode.");
-						close(_sock);
+						close(x);
 						return r;
 					}
 				}
+				else
+				{
+					// 上限を超えたペイロードは保持せずに読み捨てる
+					log(logid_, L"Error: ws packet size over.");
+					x.packet.reset(nullptr);
+				}
 			}
 			else
 			{
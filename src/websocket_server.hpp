@@ -1,11 +1,15 @@
 ﻿#pragma once
 
 #include "common.hpp"
+#include "websocket_backend.hpp"
+#include "sha1.hpp"
 
 #include <array>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <cstdint>
+#include <deque>
 #include <memory>
 #include <queue>
 #include <unordered_map>
@@ -16,29 +20,57 @@ namespace app {
 	constexpr UINT WS_TCP_RECV = 1001;
 	constexpr UINT WS_TCP_SEND = 1002;
 
-	struct WS_ACCEPT_CONTEXT {
-		WSAOVERLAPPED ov;
-		SOCKET sock;
-		char* data;
-	};
+	constexpr size_t WS_SEND_WSABUF_MAX = 64; // 1回の書き込みでまとめて送るフレーム数
+
+	constexpr size_t WS_BUFFER_READ_MIN = 4 * 1024; // 4KB
+	constexpr size_t WS_BUFFER_READ_MAX = 512 * 1024; // 512KB
+	constexpr size_t WS_BUFFER_POOL_MAX = 1024 * 1024; // 1MB (これを超えた分は解放する)
 
 	struct WS_IO_CONTEXT {
-		WSAOVERLAPPED ov;
 		SOCKET sock;
-		WSABUF buf;
 		UINT type;
 		UINT pending;
-		std::vector<uint8_t> rbuf;
-		std::shared_ptr<std::vector<uint8_t>> wbuf;
+		std::unique_ptr<std::vector<uint8_t>> rbuf;
+		size_t rlast; // 前回の受信バイト数 (次の読込バッファの大きさを決める)
+		std::vector<std::shared_ptr<std::vector<uint8_t>>> wbufs; // 送信中のフレーム
+		std::vector<ws_iovec> iovecs;
+		size_t woffset; // wbufs先頭の送信済みバイト数
+	};
+
+	// 読込バッファのプール
+	//   大きさはWS_BUFFER_READ_MINからWS_BUFFER_READ_MAXまでの2倍刻み
+	class wsbuffer_pool {
+	private:
+		std::vector<std::vector<std::unique_ptr<std::vector<uint8_t>>>> free_;
+		size_t used_bytes_;
+		size_t pooled_bytes_;
+
+		static size_t index(size_t _size) noexcept;
+
+	public:
+		wsbuffer_pool();
+
+		std::unique_ptr<std::vector<uint8_t>> acquire(size_t _size);
+		void release(std::unique_ptr<std::vector<uint8_t>>&& _buf);
+
+		size_t used_bytes() const noexcept { return used_bytes_; }
+		size_t pooled_bytes() const noexcept { return pooled_bytes_; }
 	};
 
-	std::wstring get_remote_ipport(LPVOID _buffer, DWORD _len);
+	// handshakeのリクエストからSec-WebSocket-Keyを取り出す (GET, HTTP/1.1以外は失敗)
+	//   行末はCRLFとLFのどちらも受け付ける、ヘッダ名は大文字小文字を区別しない
+	bool parse_ws_handshake(std::string_view _request, std::string_view& _key, DWORD _logid);
+	// Sec-WebSocket-Acceptの値 (RFC 6455 4.2.2)
+	void ws_accept_key(std::string_view _key, sha1_base64_t& _out);
+
+	// _phase: ペイロード先頭からの位置 (分割されたフレームの続きを解く時)
+	void ws_unmask(uint8_t* _p, size_t _n, const std::array<uint8_t, 4>& _key, uint64_t _phase) noexcept;
 
 	class wspacket {
 	private:
+		std::array<uint8_t, 14> header; // 分割されて届いたヘッダを溜める
 		size_t header_readed;
-		size_t payload_readed;
-		size_t mask_index;
+		uint64_t payload_readed;
 		uint64_t len;
 		uint64_t exlen;
 		bool mask;
@@ -62,65 +94,125 @@ namespace app {
 	};
 
 
+	// 送信待ちのフレーム
+	//   key: 0以外は同じkeyの新しいフレームで置き換えて良い (意味は上位層で決める)
+	struct wsqueued_t {
+		std::shared_ptr<std::vector<uint8_t>> data;
+		uint64_t key;
+	};
+
+	// まとめたフレームの中で単体でも送れる部分 (_dataの中の位置と長さ)
+	//   送信待ちが予算を超えている接続には、まとめたフレームの代わりに部分ごとのフレームを送ってkeyで置き換える
+	struct wspart_t {
+		size_t offset;
+		size_t len;
+		uint64_t key;
+	};
+
+	// スロット番号と世代を組み合わせた接続ハンドル
+	// 上位32bitが世代、下位32bitがスロット番号 (世代は1から始まるので0は無効値)
+	using wshandle_t = uint64_t;
+	constexpr wshandle_t WS_HANDLE_INVALID = 0;
+	constexpr size_t WS_LIVE_NONE = SIZE_MAX;
+
+	// slot / generation
+	//   slots_内の位置 / 解放されるたびに進む世代 (ハンドルに含める)
+	// live_index
+	//   live_内の位置 (ハンドシェイク前と切断後はWS_LIVE_NONE)
 	// handshake
-	//   0: none
-	//   1: handshaked
+	//   false: none
+	//   true: handshaked
+	// topics
+	//   ブロードキャストを受け取るビットマスク (意味は上位層で決める)
+	// wq_head / wq_index / wq_dead
+	//   wq先頭の通し番号 / keyから最後に積んだフレームの通し番号 / 置き換えて空になったwq内のフレーム数
+	// coalesced / dropped
+	//   送信待ちが溢れて置き換えたフレーム数 / 切断時に捨てたフレーム数
 	struct wsconn_t {
+		SOCKET sock;
+		uint32_t slot;
+		uint32_t generation;
+		size_t live_index;
+		bool used;
 		bool handshake;
 		bool invalid;
 		bool closed;
+		uint32_t topics;
 		std::unique_ptr<wspacket> packet;
 		std::unique_ptr<std::vector<uint8_t>> buffer;
 		WS_IO_CONTEXT ior_ctx;
 		WS_IO_CONTEXT iow_ctx;
-		std::queue<std::shared_ptr<std::vector<uint8_t>>> wq;
-		wsconn_t() : handshake(false), invalid(false), closed(false), packet(nullptr), buffer(nullptr) {};
+		std::deque<wsqueued_t> wq;
+		size_t wq_bytes;
+		uint64_t wq_head;
+		std::unordered_map<uint64_t, uint64_t> wq_index;
+		size_t wq_dead;
+		uint64_t coalesced;
+		uint64_t dropped;
+		wsconn_t() : sock(INVALID_SOCKET), slot(0), generation(1), live_index(WS_LIVE_NONE), used(false), handshake(false), invalid(false), closed(false), topics(0xffffffffu), packet(nullptr), buffer(nullptr), wq_bytes(0), wq_head(0), wq_index(), wq_dead(0), coalesced(0), dropped(0) {};
 	};
 
+	// ソケットI/Oはwebsocket_backendに任せる
 	class websocket_server {
 	private:
+		websocket_backend& backend_;
 		std::string listen_address_;
 		uint16_t listen_port_;
-		char addr_buffer_[1024];
-		WS_ACCEPT_CONTEXT accept_ctx_;
 		DWORD logid_;
 		uint16_t maxconn_;
-		std::function<void(SOCKET)> on_disconnect_;
-
-
-		bool socket();
-		bool bind();
-
-		bool listen();
-
-		void broadcast(std::shared_ptr<std::vector<uint8_t>>&_data);
-		bool response(SOCKET _sock, const std::vector<uint8_t>& _data, int _len);
-		void pong(SOCKET _sock, const uint8_t* _data, int _len);
+		size_t send_budget_; // 送信待ちがこれを超えたらkey付きフレームを置き換える (0は無制限)
+		size_t send_limit_; // 送信待ちがこれを超えたら切断する (0は無制限)
+		wsbuffer_pool rpool_;
+		std::function<void(SOCKET)> on_close_; // fdを閉じる直前 (番号が再利用される前)
+		std::function<void(SOCKET)> on_disconnect_; // スロットを解放した後
+
+		std::vector<wsconn_t> slots_; // maxconn_固定
+		std::vector<uint32_t> free_slots_;
+		std::unordered_map<SOCKET, uint32_t> slot_of_; // SOCKET指定のAPI用
+		std::vector<uint32_t> live_; // ハンドシェイク済みで未切断のスロット
+
+		wsconn_t* find(SOCKET _sock) noexcept;
+		wsconn_t* find(wshandle_t _handle) noexcept;
+		static wshandle_t handle(const wsconn_t& _x) noexcept;
+		void unlive(wsconn_t& _x) noexcept;
+
+		bool over_budget(const wsconn_t& _x, size_t _size) const noexcept;
+		bool send(wsconn_t& _x, std::shared_ptr<std::vector<uint8_t>>& _data, uint64_t _key = 0);
+		void compact(wsconn_t& _x);
+		bool post_send(wsconn_t& _x);
+		void close(wsconn_t& _x);
+
+		void broadcast(uint32_t _topics, const std::function<bool(wsconn_t&)>& _send);
+		static std::shared_ptr<std::vector<uint8_t>> make_frame(const uint8_t* _data, size_t _len);
+		bool response(wsconn_t& _x, std::string_view _request);
+		bool pong(wsconn_t& _x, const uint8_t* _data, int _len);
+		std::queue<std::unique_ptr<std::vector<uint8_t>>> receive_data(wsconn_t& _x, const std::vector<uint8_t>& data, int len);
 
 	public:
-		SOCKET sock_;
-		std::unordered_map<SOCKET, wsconn_t> wsconns_;
-
-		websocket_server(const std::string _address, uint16_t _port, uint16_t _maxconn, DWORD _logid);
+		websocket_server(websocket_backend& _backend, const std::string _address, uint16_t _port, uint16_t _maxconn, size_t _send_budget, size_t _send_limit, DWORD _logid);
 		~websocket_server();
 
 		size_t count() const noexcept;
+		size_t rbuf_bytes() const noexcept { return rpool_.used_bytes(); }
+		size_t pool_bytes() const noexcept { return rpool_.pooled_bytes(); }
+		size_t queued_bytes() const noexcept;
 		bool contains(SOCKET _sock) const noexcept;
 
-		bool acceptex();
-		bool send(SOCKET _sock, std::shared_ptr<std::vector<uint8_t>>& _data);
-		bool read(SOCKET _sock);
+		bool sent(wshandle_t _handle, DWORD _transferred);
+		bool read(wshandle_t _handle);
+		bool completed(wshandle_t _handle, UINT _type); // falseは解放済みスロットへの古い通知
+		std::queue<std::unique_ptr<std::vector<uint8_t>>> received(wshandle_t _handle, size_t _transferred);
 
 		bool prepare();
-		bool insert(SOCKET _sock);
-		void close(SOCKET _sock);
+		wshandle_t insert(SOCKET _sock);
+		void close(wshandle_t _handle);
 
-		void send_binary(SOCKET _sock, const std::vector<uint8_t>& _data, size_t _len);
-		void broadcast_binary(const std::vector<uint8_t>& _data, size_t _len);
+		void send_binary(SOCKET _sock, const std::vector<uint8_t>& _data, size_t _len, uint32_t _topics = 0xffffffffu, uint64_t _key = 0, const std::vector<wspart_t>* _parts = nullptr);
+		void broadcast_binary(const std::vector<uint8_t>& _data, size_t _len, uint32_t _topics = 0xffffffffu, uint64_t _key = 0, const std::vector<wspart_t>* _parts = nullptr);
 		void broadcast_ping();
+		void subscribe(SOCKET _sock, uint32_t _topics);
 
+		void set_on_close(std::function<void(SOCKET)> _func) { on_close_ = _func; }
 		void set_on_disconnect(std::function<void(SOCKET)> _func) { on_disconnect_ = _func; }
-
-		std::queue<std::unique_ptr<std::vector<uint8_t>>> receive_data(SOCKET _sock, const std::vector<uint8_t>& data, int len);
 	};
 }
@@ -5,15 +5,26 @@
 #include "websocket_server.hpp"
 
 namespace app {
-	websocket_thread::websocket_thread(DWORD _logid,  const std::string& _ip, uint16_t _port, uint16_t _maxconn)
+	websocket_thread::websocket_thread(DWORD _logid,  const std::string& _ip, uint16_t _port, uint16_t _maxconn, size_t _send_budget, size_t _send_limit, size_t _workers)
 		: logid_(_logid)
 		, ip_(_ip)
 		, port_(_port)
 		, maxconn_(_maxconn)
-		, thread_(NULL)
-		, compport_(NULL)
-		, event_out_(NULL)
+		, send_budget_(_send_budget)
+		, send_limit_(_send_limit)
+		, worker_count_(_workers > 0 ? _workers : 1)
+		, workers_()
+		, event_out_(WS_NOTIFY_INVALID)
+		, mtx_owner_()
+		, owner_()
+		, conn_total_(0)
 	{
+		for (size_t i = 0; i < worker_count_; ++i)
+		{
+			auto w = std::make_unique<worker_t>();
+			w->conn_count = 0;
+			workers_.push_back(std::move(w));
+		}
 	}
 
 	websocket_thread::~websocket_thread()
@@ -21,305 +32,357 @@ namespace app {
 		stop();
 	}
 
-	DWORD WINAPI websocket_thread::proc_common(LPVOID _p)
-	{
-		auto p = reinterpret_cast<websocket_thread*>(_p);
-		return p->proc();
-	}
-
-	DWORD websocket_thread::proc()
+	void websocket_thread::proc(size_t _index)
 	{
-		log(logid_ , L"Info: thread start.");
+		log(logid_, std::format(L"Info: thread start. worker={}", _index));
 
-		websocket_server ws(ip_.c_str(), port_, maxconn_, logid_);
+		auto& w = *workers_.at(_index);
+		websocket_server ws(*w.backend, ip_.c_str(), port_, maxconn_, send_budget_, send_limit_, logid_);
 
-		ws.set_on_disconnect([this](SOCKET _sock) {
-			push_out(websocket_message_out_disconnected{ _sock });
+		// 担当の登録はfdを閉じる前に外す (閉じた後だと再利用された番号の新しい接続の登録を消してしまう)
+		ws.set_on_close([this, _index](SOCKET _sock) {
+			disown(_index, _sock);
+			});
+		ws.set_on_disconnect([this, _index](SOCKET _sock) {
+			release(_index);
+			push_out(_index, websocket_message_out_disconnected{ _sock });
 			});
 
-		if (ws.prepare())
+		// listenはworker 0だけ
+		if (_index != 0 || ws.prepare())
 		{
-			log(logid_, L"Info: websocket_server::prepare() success.");
+			if (_index == 0) log(logid_, L"Info: websocket_server::prepare() success.");
 
-			auto port = ::CreateIoCompletionPort((HANDLE)ws.sock_, compport_, 0, 0);
 			uint64_t recv_count = 0;
 			uint64_t send_count = 0;
 
-			// 接続待ち
-			if (!ws.acceptex())
+			ws_backend_event ev;
+			while (w.backend->wait(ev))
 			{
-				log(logid_, L"Error: websocket_server::acceptex() failed.");
-				return 0;
-			}
-
-			while (true)
-			{
-				DWORD transferred = 0;
-				ULONG_PTR compkey = 0;
-				LPOVERLAPPED ov = NULL;
-				auto rc = ::GetQueuedCompletionStatus(compport_, &transferred, &compkey, &ov, INFINITE);
-				auto gqcs_error = rc == FALSE ? ::GetLastError() : ERROR_SUCCESS;
-
-				if (rc == FALSE && ov == NULL)
+				if (ev.type == WS_BACKEND_STOP)
 				{
-					log(logid_, std::format(L"Error: GetQueuedCompletionStatus() failed. ErrorCode={}", gqcs_error));
-					continue;
+					// 終了通知
+					break;
 				}
 
-				if (compkey == 0 && ov == NULL)
+				if (ev.type == WS_BACKEND_WAKEUP)
 				{
+					// 受信したメッセージの処理
+					auto q = pull_q_in(_index);
 
-					if (transferred == 0)
-					{
-						// 終了通知
-						break;
-					}
-					else if (transferred == 1)
+					while (q.size() > 0)
 					{
-						// 受信したメッセージの処理
-						auto q = pull_q_in();
-
-						while (q.size() > 0)
-						{
-							std::visit(overloaded{
-								[&](websocket_message_in_send_binary& _m) {
-									ws.send_binary(_m.sock, _m.data, _m.data.size());
-								},
-								[&](websocket_message_in_ping&) {
-									ws.broadcast_ping();
-								},
-								[&](websocket_message_in_get_stats&) {
-									uint64_t conn_count = ws.count();
-									push_out_get_stats(conn_count, recv_count, send_count);
+						std::visit(overloaded{
+							[&](websocket_message_in_send_binary& _m) {
+								ws.send_binary(_m.sock, *_m.data, _m.data->size(), _m.topics, _m.key, _m.parts.get());
+							},
+							[&](websocket_message_in_subscribe& _m) {
+								ws.subscribe(_m.sock, _m.topics);
+							},
+							[&](websocket_message_in_ping&) {
+								ws.broadcast_ping();
+							},
+							[&](websocket_message_in_get_stats& _m) {
+								auto& r = *_m.round;
+								r.conn_count += ws.count();
+								r.recv_count += recv_count;
+								r.send_count += send_count;
+								r.rbuf_bytes += ws.rbuf_bytes();
+								r.pool_bytes += ws.pool_bytes();
+								r.queued_bytes += ws.queued_bytes();
+								if (r.remaining.fetch_sub(1) == 1)
+								{
+									push_out_get_stats(_index, r.conn_count, r.recv_count, r.send_count, r.rbuf_bytes, r.pool_bytes, r.queued_bytes);
 								}
-								}, q.front());
-							q.pop();
-						}
+							},
+							[&](websocket_message_in_accepted& _m) {
+								accept(_index, ws, _m.sock, _m.ipport);
+							}
+							}, q.front());
+						q.pop();
 					}
 				}
-				if (compkey == 0 && ov != NULL)
+				else if (ev.type == WS_BACKEND_ACCEPT)
 				{
 					// ACCEPT
-					WS_ACCEPT_CONTEXT *ctx = (WS_ACCEPT_CONTEXT*)ov;
-					SOCKET sock = ctx->sock;
-
-					if (rc == FALSE)
-					{
-						log(logid_, std::format(L"Error: ACCEPT completion failed. ErrorCode={}", gqcs_error));
-						if (sock != INVALID_SOCKET)
-						{
-							::closesocket(sock);
-						}
-						if (!ws.acceptex())
-						{
-							log(logid_, L"Error: websocket_server::acceptex() failed.");
-							break;
-						}
-						continue;
-					}
-
-
-					auto ipport = get_remote_ipport(ctx->data, transferred);
-					log(logid_, std::format(L"Info: connected from {}", ipport));
-
-					if (!ws.acceptex())
-					{
-						log(logid_, L"Error: websocket_server::acceptex() failed.");
-						break;
-					}
-					if (!ws.insert(sock))
-					{
-						log(logid_, L"Error: reached max connection.");
-						::closesocket(sock);
-						continue;
-					}
-
-					// 接続元の表示
-					log(logid_, std::format(L"Info: ACCEPT called. sock={}", sock));
-
-					::CreateIoCompletionPort((HANDLE)sock, compport_, (ULONG_PTR)ctx, 0);
-
-					// 読込待ち
-					if (!ws.read(sock))
-					{
-						log(logid_, L"Error: websocket_server::read() failed.");
-					}
-
-					push_out(websocket_message_out_connected{ sock, ipport });
+					log(logid_, std::format(L"Info: connected from {}", ev.ipport));
+					dispatch(ev.sock, std::move(ev.ipport));
 				}
-				if (compkey != 0 && ov != NULL)
+				else if (ev.type == WS_BACKEND_RECV || ev.type == WS_BACKEND_SEND)
 				{
-					WS_ACCEPT_CONTEXT* ctx = (WS_ACCEPT_CONTEXT*)compkey;
-					WS_IO_CONTEXT* ioctx = (WS_IO_CONTEXT*)ov;
+					auto sock = ev.sock;
+					auto handle = ev.tag;
+					auto type = ev.type == WS_BACKEND_RECV ? WS_TCP_RECV : WS_TCP_SEND;
 
-					auto sock = ioctx->sock;
-					ioctx->pending = 0;
+					// 解放済みのスロット宛て (同じ番号のソケットが再利用されていても別の接続として扱わない)
+					if (!ws.completed(handle, type)) continue;
 
-					if (rc == FALSE)
+					if (ev.failed)
 					{
-						log(logid_, std::format(L"Error: socket I/O completion failed. sock={},type={},ErrorCode={}", sock, ioctx->type, gqcs_error));
-						ws.close(sock);
+						log(logid_, std::format(L"Error: socket I/O completion failed. sock={},type={},ErrorCode={}", sock, type, ev.error));
+						ws.close(handle);
 						continue;
 					}
 
-					if (transferred == 0 && (ioctx->type == WS_TCP_RECV || ioctx->type == WS_TCP_SEND))
+					if (ev.transferred == 0)
 					{
-						ws.close(sock);
+						ws.close(handle);
 					}
-					else if (ioctx->type == WS_TCP_RECV)
+					else if (type == WS_TCP_RECV)
 					{
-						auto queue = ws.receive_data(sock, ioctx->rbuf, transferred);
+						auto queue = ws.received(handle, ev.transferred);
 						while (queue.size() > 0)
 						{
 							if (queue.front() != nullptr)
 							{
-								push_out_recv_binary(sock, std::move(*queue.front()));
+								push_out_recv_binary(_index, sock, std::move(*queue.front()));
 								recv_count++;
 							}
 							queue.pop();
 						}
 
 						// 読込待ち
-						if (!ws.read(sock))
+						if (!ws.read(handle))
 						{
 							log(logid_, L"Error: websocket_server::read() failed.");
 						}
 					}
-					else if (ioctx->type == WS_TCP_SEND)
+					else
 					{
-						// 書き込み用に確保していたものをクリア
-						ioctx->wbuf = nullptr;
-
-						// 残りのバッファを送信
-						std::shared_ptr<std::vector<uint8_t>> empty = nullptr;
-						if (!ws.send(sock, empty))
+						// 送信済みのフレームを解放して残りを送信
+						if (!ws.sent(handle, static_cast<DWORD>(ev.transferred)))
 						{
-							log(logid_, L"Error: websocket_server::send() failed.");
-							ws.close(sock);
+							log(logid_, L"Error: websocket_server::sent() failed.");
+							ws.close(handle);
 						}
 						send_count++;
 					}
 				}
 			}
 		}
-		log(logid_, L"Info: thread end.");
+		log(logid_, std::format(L"Info: thread end. worker={}", _index));
+	}
+
+	void websocket_thread::dispatch(SOCKET _sock, std::wstring&& _ipport)
+	{
+		auto& w0 = *workers_.at(0);
+		if (conn_total_ >= maxconn_)
+		{
+			log(logid_, L"Error: reached max connection.");
+			w0.backend->close(_sock);
+			return;
+		}
+
+		// 接続数の少ないworkerに渡す
+		size_t index = 0;
+		for (size_t i = 1; i < workers_.size(); ++i)
+		{
+			if (workers_.at(i)->conn_count < workers_.at(index)->conn_count) index = i;
+		}
+		conn_total_++;
+		workers_.at(index)->conn_count++;
+		{
+			std::lock_guard<std::mutex> lock(mtx_owner_);
+			owner_[_sock] = index;
+		}
 
-		return 0;
+		push_in(index, websocket_message_in_accepted{ _sock, std::move(_ipport) });
+	}
+
+	void websocket_thread::accept(size_t _index, websocket_server& _ws, SOCKET _sock, const std::wstring& _ipport)
+	{
+		auto& w = *workers_.at(_index);
+		auto handle = _ws.insert(_sock);
+		if (handle == WS_HANDLE_INVALID)
+		{
+			log(logid_, L"Error: reached max connection.");
+			disown(_index, _sock);
+			w.backend->close(_sock);
+			release(_index);
+			return;
+		}
+
+		// 接続元の表示
+		log(logid_, std::format(L"Info: ACCEPT called. sock={},worker={}", _sock, _index));
+		push_out(_index, websocket_message_out_connected{ _sock, _ipport });
+
+		// 完了通知にはハンドルを載せてもらう
+		if (!w.backend->adopt(_sock, handle))
+		{
+			log(logid_, L"Error: websocket_backend::adopt() failed.");
+			_ws.close(handle);
+			return;
+		}
+
+		// 読込待ち
+		if (!_ws.read(handle))
+		{
+			log(logid_, L"Error: websocket_server::read() failed.");
+		}
+	}
+
+	void websocket_thread::disown(size_t _index, SOCKET _sock)
+	{
+		std::lock_guard<std::mutex> lock(mtx_owner_);
+		auto it = owner_.find(_sock);
+		if (it != owner_.end() && it->second == _index) owner_.erase(it);
+	}
+
+	void websocket_thread::release(size_t _index)
+	{
+		workers_.at(_index)->conn_count--;
+		conn_total_--;
 	}
 
 	bool websocket_thread::run()
 	{
-		// CompPort作成
-		compport_ = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
-		if (compport_ == NULL)
+		// IOCP/epoll作成
+		for (auto& w : workers_)
 		{
-			log(logid_, L"Error: CreateIoCompletionPort() failed.");
-			return false;
+			w->backend = make_websocket_backend(logid_);
+			if (!w->backend)
+			{
+				log(logid_, L"Error: make_websocket_backend() failed.");
+				return false;
+			}
 		}
 
 		// イベント作成
-		event_out_ = ::CreateEvent(NULL, FALSE, FALSE, NULL);
-		if (event_out_ == NULL)
+		event_out_ = create_ws_notify();
+		if (event_out_ == WS_NOTIFY_INVALID)
 		{
-			log(logid_, L"Error: CreateEvent() failed.");
+			log(logid_, L"Error: create_ws_notify() failed.");
 			return false;
 		}
 
 		// スレッド起動
-		thread_ = ::CreateThread(NULL, 0, proc_common, this, 0, NULL);
-		return thread_ != NULL;
+		for (size_t i = 0; i < workers_.size(); ++i)
+		{
+			workers_.at(i)->thread = std::thread(&websocket_thread::proc, this, i);
+		}
+		return true;
 	}
 
 	void websocket_thread::stop()
 	{
-		if (thread_ != NULL)
+		for (auto& w : workers_)
+		{
+			// 受け取り側が止まっていても満杯で待たないように
+			w->q_out.close();
+			if (w->thread.joinable()) w->backend->stop();
+		}
+		for (auto& w : workers_)
 		{
-			::PostQueuedCompletionStatus(compport_, 0, 0, NULL);
-			::WaitForSingleObject(thread_, INFINITE);
-			thread_ = NULL;
+			if (w->thread.joinable()) w->thread.join();
 		}
 
-		if (event_out_ != NULL)
+		if (event_out_ != WS_NOTIFY_INVALID)
 		{
-			::CloseHandle(event_out_);
-			event_out_ = NULL;
+			close_ws_notify(event_out_);
+			event_out_ = WS_NOTIFY_INVALID;
 		}
 
-		if (compport_ != NULL)
+		for (auto& w : workers_)
 		{
-			::CloseHandle(compport_);
-			compport_ = NULL;
+			w->backend.reset();
 		}
 	}
 
-	void websocket_thread::push_in(websocket_message_in&& _message)
+	void websocket_thread::push_in(size_t _index, websocket_message_in&& _message)
 	{
+		auto& w = *workers_.at(_index);
 		{
-			std::lock_guard<std::mutex> lock(mtx_in_);
-			q_in_.push(std::move(_message));
+			std::lock_guard<std::mutex> lock(w.mtx_in);
+			w.q_in.push(std::move(_message));
 		}
 
-		if (thread_ != NULL && compport_ != NULL)
+		if (w.thread.joinable())
 		{
-			::PostQueuedCompletionStatus(compport_, 1, 0, NULL);
+			w.backend->wakeup();
 		}
 	}
 
-	void websocket_thread::push_out(websocket_message_out&& _message)
+	void websocket_thread::push_in_all(const websocket_message_in& _message)
 	{
+		for (size_t i = 0; i < workers_.size(); ++i)
 		{
-			std::lock_guard<std::mutex> lock(mtx_out_);
-			q_out_.push(std::move(_message));
-		}
-
-		if (event_out_ != NULL)
-		{
-			::SetEvent(event_out_);
+			push_in(i, websocket_message_in(_message));
 		}
 	}
 
-	std::queue<websocket_message_in> websocket_thread::pull_q_in()
+	void websocket_thread::push_out(size_t _index, websocket_message_out&& _message)
 	{
-		std::queue<websocket_message_in> q;
+		// 空だったときだけ通知
+		if (workers_.at(_index)->q_out.push(std::move(_message)) && event_out_ != WS_NOTIFY_INVALID)
 		{
-			std::lock_guard<std::mutex> lock(mtx_in_);
-			q.swap(q_in_);
+			signal_ws_notify(event_out_);
 		}
-		return q;
 	}
 
-	std::queue<websocket_message_out> websocket_thread::pull_q_out()
+	std::queue<websocket_message_in> websocket_thread::pull_q_in(size_t _index)
 	{
-		std::queue<websocket_message_out> q;
+		auto& w = *workers_.at(_index);
+		std::queue<websocket_message_in> q;
 		{
-			std::lock_guard<std::mutex> lock(mtx_out_);
-			q.swap(q_out_);
+			std::lock_guard<std::mutex> lock(w.mtx_in);
+			q.swap(w.q_in);
 		}
 		return q;
 	}
 
-	void websocket_thread::push_out_get_stats(uint64_t _conn_count, uint64_t _recv_count, uint64_t _send_count)
+	void websocket_thread::push_out_get_stats(size_t _index, uint64_t _conn_count, uint64_t _recv_count, uint64_t _send_count, uint64_t _rbuf_bytes, uint64_t _pool_bytes, uint64_t _queued_bytes)
 	{
-		push_out(websocket_message_out_get_stats{ _conn_count, _recv_count, _send_count });
+		push_out(_index, websocket_message_out_get_stats{ _conn_count, _recv_count, _send_count, _rbuf_bytes, _pool_bytes, _queued_bytes });
 	}
 
-	void websocket_thread::push_out_recv_binary(SOCKET _sock, std::vector<uint8_t>&& _data)
+	void websocket_thread::push_out_recv_binary(size_t _index, SOCKET _sock, std::vector<uint8_t>&& _data)
 	{
-		push_out(websocket_message_out_recv_binary{ _sock, std::move(_data) });
+		push_out(_index, websocket_message_out_recv_binary{ _sock, std::move(_data) });
 	}
 
 	void websocket_thread::ping()
 	{
-		push_in(websocket_message_in_ping{});
+		push_in_all(websocket_message_in_ping{});
 	}
 
 	void websocket_thread::get_stats()
 	{
-		push_in(websocket_message_in_get_stats{});
+		auto round = std::make_shared<websocket_stats_round>();
+		round->remaining = workers_.size();
+		push_in_all(websocket_message_in_get_stats{ round });
 	}
 
-	void websocket_thread::send_binary(SOCKET _sock, std::vector<uint8_t>&& _data)
+	void websocket_thread::send_binary(SOCKET _sock, std::vector<uint8_t>&& _data, uint32_t _topics, uint64_t _key, std::vector<wspart_t>&& _parts)
 	{
-		push_in(websocket_message_in_send_binary{ _sock, std::move(_data) });
+		auto data = std::make_shared<const std::vector<uint8_t>>(std::move(_data));
+		std::shared_ptr<const std::vector<wspart_t>> parts;
+		if (!_parts.empty()) parts = std::make_shared<const std::vector<wspart_t>>(std::move(_parts));
+		if (_sock == INVALID_SOCKET)
+		{
+			// ブロードキャストは全workerへ
+			push_in_all(websocket_message_in_send_binary{ _sock, data, _topics, _key, parts });
+			return;
+		}
+
+		size_t index = 0;
+		{
+			std::lock_guard<std::mutex> lock(mtx_owner_);
+			auto it = owner_.find(_sock);
+			if (it == owner_.end()) return; // 切断済み
+			index = it->second;
+		}
+		push_in(index, websocket_message_in_send_binary{ _sock, data, _topics, _key, parts });
+	}
+
+	void websocket_thread::subscribe(SOCKET _sock, uint32_t _topics)
+	{
+		size_t index = 0;
+		{
+			std::lock_guard<std::mutex> lock(mtx_owner_);
+			auto it = owner_.find(_sock);
+			if (it == owner_.end()) return; // 切断済み
+			index = it->second;
+		}
+		push_in(index, websocket_message_in_subscribe{ _sock, _topics });
 	}
 }
@@ -1,11 +1,18 @@
 ﻿#pragma once
 
 #include "common.hpp"
+#include "websocket_backend.hpp"
+#include "websocket_server.hpp"
+#include "spsc_ring.hpp"
 
+#include <atomic>
 #include <string>
 #include <variant>
 #include <queue>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <cstdint>
 
@@ -15,21 +22,52 @@ namespace app
 	struct websocket_message_in_send_binary
 	{
 		SOCKET sock;
-		std::vector<uint8_t> data;
+		std::shared_ptr<const std::vector<uint8_t>> data; // ブロードキャストは全workerで共有
+		uint32_t topics;
+		uint64_t key;
+		std::shared_ptr<const std::vector<wspart_t>> parts; // 単体でも送れる部分 (nullptrは分けない)
+	};
+
+	struct websocket_message_in_subscribe
+	{
+		SOCKET sock;
+		uint32_t topics;
 	};
 
 	struct websocket_message_in_ping
 	{
 	};
 
+	// 各workerが足し込み、最後のworkerが結果を出力する
+	struct websocket_stats_round
+	{
+		std::atomic<uint64_t> conn_count;
+		std::atomic<uint64_t> recv_count;
+		std::atomic<uint64_t> send_count;
+		std::atomic<uint64_t> rbuf_bytes;
+		std::atomic<uint64_t> pool_bytes;
+		std::atomic<uint64_t> queued_bytes;
+		std::atomic<size_t> remaining;
+	};
+
 	struct websocket_message_in_get_stats
 	{
+		std::shared_ptr<websocket_stats_round> round;
+	};
+
+	// worker 0がACCEPTした接続を担当workerへ渡す
+	struct websocket_message_in_accepted
+	{
+		SOCKET sock;
+		std::wstring ipport;
 	};
 
 	using websocket_message_in = std::variant<
 		websocket_message_in_send_binary,
+		websocket_message_in_subscribe,
 		websocket_message_in_ping,
-		websocket_message_in_get_stats
+		websocket_message_in_get_stats,
+		websocket_message_in_accepted
 	>;
 
 	/* OUT */
@@ -55,6 +93,9 @@ namespace app
 		uint64_t conn_count;
 		uint64_t recv_count;
 		uint64_t send_count;
+		uint64_t rbuf_bytes; // 接続が使っている読込バッファ
+		uint64_t pool_bytes; // プールに残っている読込バッファ
+		uint64_t queued_bytes; // 送信待ち
 	};
 
 	using websocket_message_out = std::variant<
@@ -64,34 +105,56 @@ namespace app
 		websocket_message_out_get_stats
 	>;
 
+	class websocket_server;
+
+	// workerごとの出力キューの長さ
+	constexpr size_t WS_RING_OUT_SIZE = 4096;
+
+	// 接続はworkerに振り分け、1つの接続は常に同じworkerが扱う (接続毎の処理は直列になる)
+	//   worker 0だけがlistenし、ACCEPTした接続を接続数の少ないworkerへ渡す
 	class websocket_thread
 	{
 	private:
+		struct worker_t
+		{
+			std::thread thread;
+			std::unique_ptr<websocket_backend> backend;
+			std::mutex mtx_in;
+			std::queue<websocket_message_in> q_in;
+			std::atomic<size_t> conn_count;
+			spsc_ring<websocket_message_out> q_out{ WS_RING_OUT_SIZE }; // worker -> 受け取り側 (workerごとに持つので1対1)
+		};
+
 		DWORD logid_;
 		const std::string ip_;
 		const uint16_t port_;
 		const uint16_t maxconn_;
-		HANDLE thread_;
-		HANDLE compport_;
-		HANDLE event_out_;
-		std::mutex mtx_in_;
-		std::queue<websocket_message_in> q_in_;
-		std::mutex mtx_out_;
-		std::queue<websocket_message_out> q_out_;
-
-		static DWORD WINAPI proc_common(LPVOID);
-		DWORD proc();
-
-		void push_in(websocket_message_in&&);
-		void push_out(websocket_message_out&&);
-
-		std::queue<websocket_message_in> pull_q_in();
-
-		void push_out_get_stats(uint64_t _conn_count, uint64_t _recv_count, uint64_t _send_count);
-		void push_out_recv_binary(SOCKET _sock, std::vector<uint8_t>&& _data);
+		const size_t send_budget_;
+		const size_t send_limit_;
+		const size_t worker_count_;
+		std::vector<std::unique_ptr<worker_t>> workers_;
+		ws_notify_t event_out_;
+		std::mutex mtx_owner_;
+		std::unordered_map<SOCKET, size_t> owner_; // 接続を担当しているworker
+		std::atomic<size_t> conn_total_;
+
+		void proc(size_t _index);
+		void accept(size_t _index, websocket_server& _ws, SOCKET _sock, const std::wstring& _ipport);
+		void dispatch(SOCKET _sock, std::wstring&& _ipport);
+		void disown(size_t _index, SOCKET _sock);
+		void release(size_t _index);
+
+		void push_in(size_t _index, websocket_message_in&&);
+		void push_in_all(const websocket_message_in&);
+		void push_out(size_t _index, websocket_message_out&&);
+
+		std::queue<websocket_message_in> pull_q_in(size_t _index);
+
+		void push_out_get_stats(size_t _index, uint64_t _conn_count, uint64_t _recv_count, uint64_t _send_count, uint64_t _rbuf_bytes, uint64_t _pool_bytes, uint64_t _queued_bytes);
+		void push_out_recv_binary(size_t _index, SOCKET _sock, std::vector<uint8_t>&& _data);
 
 	public:
-		websocket_thread(DWORD _logid, const std::string &_ip, uint16_t _port, uint16_t _maxconn);
+		websocket_thread(DWORD _logid, const std::string &_ip, uint16_t _port, uint16_t _maxconn, size_t _send_budget = 0, size_t _send_limit = 0, size_t _workers = 1);
 		~websocket_thread();
 
 		// コピー不可
@@ -104,10 +167,25 @@ namespace app
 		bool run();
 		void ping();
 		void get_stats();
-		void send_binary(SOCKET _sock, std::vector<uint8_t>&& _data);
+		void send_binary(SOCKET _sock, std::vector<uint8_t>&& _data, uint32_t _topics = 0xffffffffu, uint64_t _key = 0, std::vector<wspart_t>&& _parts = {});
+		void subscribe(SOCKET _sock, uint32_t _topics);
 		void stop();
 
-		HANDLE get_event_out() const { return event_out_; }
-		std::queue<websocket_message_out> pull_q_out();
+		ws_notify_t get_event_out() const { return event_out_; }
+
+		// 溜まっている出力を取り出してfuncに渡す (受け取り側の1スレッドから呼ぶ)
+		//   同じ接続のメッセージは同じworkerから来るので、接続毎の順序は保たれる
+		template <typename F>
+		void consume_out(F&& _func)
+		{
+			bool remain = false;
+			for (auto& w : workers_)
+			{
+				if (w->q_out.consume(_func)) remain = true;
+			}
+
+			// 取り出し中に積まれた分は次の通知で拾う
+			if (remain && event_out_ != WS_NOTIFY_INVALID) signal_ws_notify(event_out_);
+		}
 	};
 }